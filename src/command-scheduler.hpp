@@ -0,0 +1,146 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "neonobd_types.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using neon::CommandPriority;
+
+// Queue of commands for an adapter that has to be told which header to
+// send with (ATSH).  Commands of a higher priority always go first.
+// Within a priority, commands are taken earliest deadline first, and in
+// FIFO order when the deadlines are equal (or not set).  A command using
+// the adapter's current header may be taken ahead of commands of the
+// same priority for other headers, saving a header change.  Reordering
+// is limited:
+//  - Only the first WINDOW commands are searched.
+//  - A command is passed over at most MAX_BYPASS times.
+//  - A command is not passed over if its deadline is within
+//    DEADLINE_GUARD.
+// The queues are short, so they are kept in vectors, which stop
+// allocating once they have reached their largest size.
+// Not thread safe; the owner provides locking.
+template <typename T> class CommandScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t WINDOW = 8;
+    static constexpr unsigned int MAX_BYPASS = 4;
+    static constexpr Clock::duration DEADLINE_GUARD =
+        std::chrono::milliseconds(100);
+
+    void push(unsigned int header, T command,
+              CommandPriority priority = neon::PRIORITY_NORMAL,
+              Clock::time_point deadline = Clock::time_point::max()) {
+        auto& queue = m_queues.at(priority);
+        const auto position = std::ranges::upper_bound(
+            queue, deadline, {}, [](const Entry& entry) {
+                return entry.deadline;
+            });
+        queue.insert(position, {header, deadline, 0, std::move(command)});
+    }
+
+    // Remove a command whose deadline has passed, if there is one.
+    std::optional<T> take_expired(Clock::time_point now = Clock::now()) {
+        for (auto& queue : m_queues) {
+            // Each queue is sorted by deadline.
+            if (!queue.empty() && queue.front().deadline < now) {
+                auto command = std::move(queue.front().command);
+                queue.erase(queue.begin());
+                return command;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Remove the next command to send, given the header the adapter is
+    // currently using.
+    std::optional<T> pop(unsigned int current_header,
+                         Clock::time_point now = Clock::now()) {
+        const auto queue = std::ranges::find_if(
+            m_queues, [](const auto& entries) { return !entries.empty(); });
+        if (queue == m_queues.end()) {
+            return std::nullopt;
+        }
+        return pop(*queue, current_header, now);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return std::ranges::all_of(
+            m_queues, [](const auto& queue) { return queue.empty(); });
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        std::size_t size = 0;
+        for (const auto& queue : m_queues) {
+            size += queue.size();
+        }
+        return size;
+    }
+
+    void clear() {
+        for (auto& queue : m_queues) {
+            queue.clear();
+        }
+    }
+
+  private:
+    static constexpr std::size_t PRIORITY_LEVELS = neon::PRIORITY_LOW + 1;
+
+    struct Entry {
+        unsigned int header;
+        Clock::time_point deadline;
+        unsigned int bypass_count;
+        T command;
+    };
+
+    std::array<std::vector<Entry>, PRIORITY_LEVELS> m_queues;
+
+    static T pop(std::vector<Entry>& queue, unsigned int current_header,
+                 Clock::time_point now) {
+        auto selected = queue.begin();
+        if (selected->header != current_header) {
+            const auto end =
+                queue.size() > WINDOW ? queue.begin() + WINDOW : queue.end();
+            for (auto entry = queue.begin(); entry != end; ++entry) {
+                if (entry->header == current_header) {
+                    selected = entry;
+                    break;
+                }
+                if (entry->bypass_count >= MAX_BYPASS ||
+                    entry->deadline <= now + DEADLINE_GUARD) {
+                    break;
+                }
+            }
+
+            for (auto entry = queue.begin(); entry != selected; ++entry) {
+                ++entry->bypass_count;
+            }
+        }
+
+        auto command = std::move(selected->command);
+        queue.erase(selected);
+        return command;
+    }
+};
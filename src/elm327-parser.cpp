@@ -0,0 +1,331 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "elm327-parser.hpp"
+#include "hex-decode.hpp"
+#include "logger.hpp"
+#include "neonobd_types.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <utility>
+
+namespace {
+constexpr unsigned int BITS_PER_NIBBLE = 4;
+constexpr unsigned char NIBBLE_MASK = 0x0F;
+
+// ISO 15765-2 protocol control information (upper nibble of first byte)
+constexpr unsigned char SINGLE_FRAME = 0;
+constexpr unsigned char FIRST_FRAME = 1;
+constexpr unsigned char CONSECUTIVE_FRAME = 2;
+constexpr unsigned char FLOW_CONTROL_FRAME = 3;
+
+// Status for a message from the adapter.  Receive errors may follow the
+// data on the same line.
+CommandStatus classify_message(std::string_view line) {
+    if (line.ends_with("RX ERROR") || line.ends_with("DATA ERROR")) {
+        return neon::CMD_RX_ERROR;
+    }
+    if (line == "BUS BUSY") {
+        return neon::CMD_BUS_BUSY;
+    }
+    if (line == "BUS ERROR" || line == "CAN ERROR" || line == "FB ERROR" ||
+        line.starts_with("BUS INIT")) {
+        return neon::CMD_BUS_ERROR;
+    }
+    if (line == "BUFFER FULL") {
+        return neon::CMD_BUFFER_FULL;
+    }
+    if (line == "STOPPED") {
+        return neon::CMD_STOPPED;
+    }
+    if (line == "?") {
+        return neon::CMD_REJECTED;
+    }
+    if (line == "UNABLE TO CONNECT") {
+        return neon::CMD_UNABLE_TO_CONNECT;
+    }
+    return neon::CMD_ERROR;
+}
+} // namespace
+
+Elm327Parser::Elm327Parser(FrameCallback callback)
+    : m_callback{std::move(callback)} {}
+
+void Elm327Parser::set_protocol(int protocol) {
+    // Protocols 6 and above are CAN.  7, 9 and A use 29 bit identifiers.
+    static constexpr int MIN_CAN_PROTOCOL = 6;
+    static constexpr std::size_t CAN_11BIT_DIGITS = 3;
+    static constexpr std::size_t CAN_29BIT_DIGITS = 8;
+    static constexpr std::size_t LEGACY_HEADER_DIGITS = 6;
+
+    m_is_can = protocol >= MIN_CAN_PROTOCOL;
+    if (!m_is_can) {
+        m_header_digits = LEGACY_HEADER_DIGITS;
+    } else if (protocol == 0x7 || protocol == 0x9 || protocol == 0xA) {
+        m_header_digits = CAN_29BIT_DIGITS;
+    } else {
+        m_header_digits = CAN_11BIT_DIGITS;
+    }
+}
+
+void Elm327Parser::begin(std::string_view command) {
+    m_command_size = std::min(command.size(), m_command.size());
+    std::copy_n(command.begin(), m_command_size, m_command.begin());
+    m_line_size = 0;
+    m_line_overflow = false;
+    m_prompt_received = false;
+    m_status = neon::CMD_OK;
+    m_error_size = 0;
+    m_line_count = 0;
+    for (auto& assembly : m_assemblies) {
+        assembly.active = false;
+    }
+}
+
+bool Elm327Parser::feed(std::string_view data) {
+    if (m_prompt_received) {
+        return true;
+    }
+
+    for (const char character : data) {
+        switch (character) {
+        case '>':
+            process_line();
+            finish();
+            return true;
+        case '\r':
+        case '\n':
+            process_line();
+            break;
+        case '\0':
+            // The adapter occasionally sends NUL bytes; ignore them.
+            break;
+        default:
+            if (m_line_size < m_line.size()) {
+                m_line.at(m_line_size++) = character;
+            } else {
+                m_line_overflow = true;
+            }
+        }
+    }
+
+    return false;
+}
+
+CommandStatus Elm327Parser::get_status() const { return m_status; }
+
+std::string_view Elm327Parser::get_error() const {
+    return {m_error.data(), m_error_size};
+}
+
+unsigned int Elm327Parser::get_line_count() const { return m_line_count; }
+
+void Elm327Parser::process_line() {
+    std::string_view line(m_line.data(), m_line_size);
+    const bool overflow = m_line_overflow;
+    m_line_size = 0;
+    m_line_overflow = false;
+
+    while (!line.empty() && line.back() == ' ') {
+        line.remove_suffix(1);
+    }
+
+    if (line.empty() ||
+        line == std::string_view(m_command.data(), m_command_size) ||
+        line.starts_with("SEARCHING")) {
+        return;
+    }
+
+    if (overflow) {
+        set_error("Response line too long");
+        return;
+    }
+
+    if (line.starts_with("BUS INIT")) {
+        if (line.find("ERROR") != std::string_view::npos) {
+            set_error(line, neon::CMD_BUS_ERROR);
+        }
+        return;
+    }
+
+    std::array<char, MAX_LINE_SIZE> digits{};
+    const std::size_t digit_count = HexDecode::remove_spaces(line, digits);
+    if (process_frame(std::string_view(digits.data(), digit_count))) {
+        return;
+    }
+
+    // Not a frame, so it's a message from the adapter.
+    if (line == "NO DATA") {
+        if (m_status == neon::CMD_OK) {
+            m_status = neon::CMD_NO_DATA;
+        }
+    } else {
+        set_error(line, classify_message(line));
+    }
+}
+
+bool Elm327Parser::process_frame(std::string_view digits) {
+    const auto is_hex = [](char digit) {
+        return HexDecode::digit_value(digit) >= 0;
+    };
+
+    if (digits.size() <= m_header_digits ||
+        (digits.size() - m_header_digits) % 2 != 0) {
+        if (!std::ranges::all_of(digits, is_hex)) {
+            return false;
+        }
+        set_error("Malformed response line");
+        return true;
+    }
+
+    unsigned int header = 0;
+    for (const char digit : digits.substr(0, m_header_digits)) {
+        const int value = HexDecode::digit_value(digit);
+        if (value < 0) {
+            return false;
+        }
+        header = (header << BITS_PER_NIBBLE) | static_cast<unsigned int>(value);
+    }
+
+    std::array<unsigned char, MAX_LINE_SIZE / 2> bytes{};
+    const auto data_digits = digits.substr(m_header_digits);
+    if (!HexDecode::decode(data_digits, bytes)) {
+        return false;
+    }
+
+    ++m_line_count;
+    const auto data = std::span(bytes).first(data_digits.size() / 2);
+    if (m_is_can) {
+        process_can_frame(header, data);
+    } else if (data.size() > 1) {
+        // Drop the checksum byte at the end of the frame.
+        m_callback(header, data.first(data.size() - 1));
+    }
+    return true;
+}
+
+Elm327Parser::Assembly* Elm327Parser::find_assembly(unsigned int header) {
+    for (auto& assembly : m_assemblies) {
+        if (assembly.active && assembly.header == header) {
+            return &assembly;
+        }
+    }
+    return nullptr;
+}
+
+void Elm327Parser::process_can_frame(unsigned int header,
+                                     std::span<const unsigned char> bytes) {
+    if (bytes.empty()) {
+        set_error("Empty CAN frame");
+        return;
+    }
+
+    const auto frame_type = static_cast<unsigned char>(bytes[0] >> 4U);
+    const auto pci_low = static_cast<unsigned char>(bytes[0] & NIBBLE_MASK);
+
+    switch (frame_type) {
+    case SINGLE_FRAME:
+        if (pci_low == 0 || pci_low >= bytes.size()) {
+            set_error("Invalid single frame length");
+            return;
+        }
+        m_callback(header, bytes.subspan(1, pci_low));
+        break;
+    case FIRST_FRAME: {
+        static constexpr std::size_t FIRST_FRAME_HEADER = 2;
+        if (bytes.size() <= FIRST_FRAME_HEADER) {
+            set_error("Invalid first frame");
+            return;
+        }
+
+        Assembly* assembly = find_assembly(header);
+        if (assembly == nullptr) {
+            const auto* free_slot =
+                std::ranges::find(m_assemblies, false, &Assembly::active);
+            if (free_slot == m_assemblies.end()) {
+                set_error("Too many multi-frame responses");
+                return;
+            }
+            assembly = &m_assemblies.at(static_cast<std::size_t>(
+                free_slot - m_assemblies.begin()));
+        }
+
+        assembly->header = header;
+        assembly->active = true;
+        assembly->expected_size =
+            (static_cast<std::size_t>(pci_low) << 8U) | bytes[1];
+        assembly->next_sequence = 1;
+        const auto payload = bytes.subspan(FIRST_FRAME_HEADER);
+        assembly->data.assign(
+            payload.begin(),
+            payload.begin() + static_cast<std::ptrdiff_t>(std::min(
+                                  payload.size(), assembly->expected_size)));
+        break;
+    }
+    case CONSECUTIVE_FRAME: {
+        Assembly* assembly = find_assembly(header);
+        if (assembly == nullptr) {
+            set_error("Consecutive frame without first frame");
+            return;
+        }
+        if (pci_low != assembly->next_sequence) {
+            assembly->active = false;
+            set_error("Consecutive frame out of sequence");
+            return;
+        }
+        assembly->next_sequence = (assembly->next_sequence + 1) & NIBBLE_MASK;
+
+        const auto payload = bytes.subspan(1);
+        const std::size_t remaining =
+            assembly->expected_size - assembly->data.size();
+        assembly->data.insert(
+            assembly->data.end(), payload.begin(),
+            payload.begin() + static_cast<std::ptrdiff_t>(
+                                  std::min(payload.size(), remaining)));
+
+        if (assembly->data.size() == assembly->expected_size) {
+            assembly->active = false;
+            m_callback(header, assembly->data);
+        }
+        break;
+    }
+    case FLOW_CONTROL_FRAME:
+        break;
+    default:
+        set_error("Unknown CAN frame type");
+    }
+}
+
+void Elm327Parser::finish() {
+    m_prompt_received = true;
+    for (auto& assembly : m_assemblies) {
+        if (assembly.active) {
+            assembly.active = false;
+            set_error("Incomplete multi-frame response");
+        }
+    }
+}
+
+void Elm327Parser::set_error(std::string_view text, CommandStatus status) {
+    Logger::debug << "ELM327 error response: " << text << "\n";
+    m_status = status;
+    m_error_size = std::min(text.size(), m_error.size());
+    std::copy_n(text.begin(), m_error_size, m_error.begin());
+}
@@ -0,0 +1,101 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "neonobd_types.hpp"
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+using neon::CommandStatus;
+
+// Incremental parser for ELM327 responses to OBD commands.  Data read
+// from the adapter is fed to the parser as it arrives, and a frame is
+// reported as soon as the line(s) containing it have been received.
+// The adapter must be configured with headers enabled (ATH1).  Spaces
+// (ATS0/ATS1) and command echo (ATE0/ATE1) are handled either way.
+class Elm327Parser {
+  public:
+    using FrameCallback = std::function<void(
+        unsigned int header, std::span<const unsigned char> data)>;
+
+    explicit Elm327Parser(FrameCallback callback);
+
+    // Protocol number, as reported by ATDPN.  Determines the size of the
+    // header and how the data bytes are framed.
+    void set_protocol(int protocol);
+
+    // Prepare for the response to command (without the trailing CR).
+    void begin(std::string_view command);
+
+    // Returns true once the prompt has been received.  Anything after
+    // the prompt is discarded.
+    bool feed(std::string_view data);
+
+    CommandStatus get_status() const;
+
+    // Text of the last error reported by the adapter.
+    std::string_view get_error() const;
+
+    // Number of data lines received for the current command.
+    unsigned int get_line_count() const;
+
+  private:
+    static constexpr std::size_t MAX_LINE_SIZE = 128;
+    static constexpr std::size_t MAX_ASSEMBLIES = 8;
+
+    // Multi-frame (ISO 15765-2) message being assembled for one ECU.
+    struct Assembly {
+        unsigned int header = 0;
+        bool active = false;
+        std::size_t expected_size = 0;
+        unsigned char next_sequence = 0;
+        std::vector<unsigned char> data;
+    };
+
+    FrameCallback m_callback;
+    bool m_is_can = false;
+    std::size_t m_header_digits = 6;
+
+    std::array<char, MAX_LINE_SIZE> m_command{};
+    std::size_t m_command_size = 0;
+    std::array<char, MAX_LINE_SIZE> m_line{};
+    std::size_t m_line_size = 0;
+    bool m_line_overflow = false;
+    bool m_prompt_received = false;
+
+    CommandStatus m_status = neon::CMD_OK;
+    std::array<char, MAX_LINE_SIZE> m_error{};
+    std::size_t m_error_size = 0;
+    unsigned int m_line_count = 0;
+
+    std::array<Assembly, MAX_ASSEMBLIES> m_assemblies;
+
+    void process_line();
+    // Returns false if digits is not hex, i.e. the line is text.
+    bool process_frame(std::string_view digits);
+    void process_can_frame(unsigned int header,
+                           std::span<const unsigned char> bytes);
+    Assembly* find_assembly(unsigned int header);
+    void finish();
+    void set_error(std::string_view text,
+                   CommandStatus status = neon::CMD_ERROR);
+};
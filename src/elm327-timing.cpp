@@ -0,0 +1,141 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "elm327-timing.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+
+using namespace std::chrono_literals;
+
+namespace {
+// Samples needed from an ECU before its response time is trusted.
+constexpr std::uint64_t MIN_SAMPLES = 16;
+constexpr std::uint64_t WINDOW_SAMPLES = 256;
+constexpr double PERCENTILE = 99.0;
+
+// Timeout = slowest 99th percentile * 3 / 2 + MARGIN.
+constexpr auto MARGIN = 8ms;
+constexpr unsigned int MIN_TIMEOUT = 0x05;
+constexpr unsigned int MAX_TIMEOUT = 0xFF;
+
+// Aggressive adaptive timing is only used when every ECU is this fast.
+constexpr auto AGGRESSIVE_LIMIT = 40ms;
+
+// Two misses in the last 16 commands doubles the timeout, up to 8 times
+// the learned value.
+constexpr unsigned int MISS_WINDOW = 16;
+constexpr std::uint32_t MISS_WINDOW_MASK = (1U << MISS_WINDOW) - 1;
+constexpr int MISS_LIMIT = 2;
+constexpr unsigned int MAX_BACKOFF = 3;
+constexpr unsigned int RECOVERY_COMMANDS = 128;
+} // namespace
+
+void Elm327Timing::record_response(unsigned int header,
+                                   std::chrono::nanoseconds response_time) {
+    auto& times = m_ecu_times[header];
+    times.current.record(response_time);
+    if (times.current.count() >= WINDOW_SAMPLES) {
+        times.previous_window = times.current.percentile(PERCENTILE);
+        times.current.reset();
+    }
+}
+
+void Elm327Timing::record_result(bool missed) {
+    m_missed = ((m_missed << 1) | (missed ? 1U : 0U)) & MISS_WINDOW_MASK;
+
+    if (std::popcount(m_missed) >= MISS_LIMIT) {
+        if (m_backoff < MAX_BACKOFF) {
+            ++m_backoff;
+            Logger::info << "ELM327 responses missed; timeout backoff "
+                         << m_backoff << ".\n";
+        }
+        m_missed = 0;
+        m_clean_commands = 0;
+    } else if (missed) {
+        m_clean_commands = 0;
+    } else if (m_backoff > 0 && ++m_clean_commands >= RECOVERY_COMMANDS) {
+        --m_backoff;
+        m_clean_commands = 0;
+    }
+}
+
+void Elm327Timing::seed(unsigned int header,
+                        std::chrono::nanoseconds response_time) {
+    m_ecu_times[header].previous_window = response_time;
+}
+
+std::map<unsigned int, std::chrono::nanoseconds>
+Elm327Timing::get_response_times() const {
+    std::map<unsigned int, std::chrono::nanoseconds> times;
+    for (const auto& [header, ecu_times] : m_ecu_times) {
+        const auto time = response_time(ecu_times);
+        if (time > 0ns) {
+            times.emplace(header, time);
+        }
+    }
+    return times;
+}
+
+std::chrono::nanoseconds Elm327Timing::response_time(const EcuTimes& times) {
+    if (times.current.count() >= MIN_SAMPLES) {
+        return std::max(times.previous_window,
+                        times.current.percentile(PERCENTILE));
+    }
+    return times.previous_window;
+}
+
+std::chrono::nanoseconds Elm327Timing::slowest_response() const {
+    std::chrono::nanoseconds slowest{0};
+    for (const auto& [header, times] : m_ecu_times) {
+        slowest = std::max(slowest, response_time(times));
+    }
+    return slowest;
+}
+
+std::optional<Elm327Timing::Settings> Elm327Timing::update() {
+    Settings settings = DEFAULT_SETTINGS;
+
+    const auto slowest = slowest_response();
+    if (slowest > 0ns) {
+        const auto timeout = slowest * 3 / 2 + MARGIN;
+        const auto units = static_cast<unsigned int>(
+            (timeout + TIMEOUT_UNIT - 1ns) / TIMEOUT_UNIT);
+        settings.timeout = std::clamp(units, MIN_TIMEOUT, MAX_TIMEOUT);
+        settings.adaptive_mode = slowest < AGGRESSIVE_LIMIT ? 2 : 1;
+    }
+
+    if (m_backoff > 0) {
+        settings.timeout =
+            std::min(settings.timeout << m_backoff, MAX_TIMEOUT);
+        settings.adaptive_mode = 1;
+    }
+
+    if (settings == m_applied) {
+        return std::nullopt;
+    }
+    m_applied = settings;
+    return settings;
+}
+
+void Elm327Timing::reset() { *this = Elm327Timing(); }
+
+void Elm327Timing::adapter_reset() { m_applied = DEFAULT_SETTINGS; }
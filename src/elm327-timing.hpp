@@ -0,0 +1,88 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "latency-histogram.hpp"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+
+// Chooses the ELM327 response timeout (ATST) and adaptive timing mode
+// (ATAT) from the response times seen for each ECU.  The timeout is set
+// a margin above the slowest ECU's 99th percentile response time.  If
+// commands that used to be answered start returning NO DATA, the timeout
+// is doubled, and only brought back down after a run of clean commands.
+class Elm327Timing {
+  public:
+    struct Settings {
+        // ATAT0, ATAT1 or ATAT2.
+        int adaptive_mode;
+        // ATST value, in units of TIMEOUT_UNIT.
+        unsigned int timeout;
+
+        bool operator==(const Settings&) const = default;
+    };
+
+    static constexpr std::chrono::microseconds TIMEOUT_UNIT{4096};
+    // The adapter's power on settings.
+    static constexpr Settings DEFAULT_SETTINGS{1, 0x32};
+
+    // Time from sending a command until the response from header arrived.
+    void record_response(unsigned int header,
+                         std::chrono::nanoseconds response_time);
+
+    // Start from a response time seen on an earlier connection.
+    void seed(unsigned int header, std::chrono::nanoseconds response_time);
+
+    // Slowest (99th percentile) response time of each ECU, once known.
+    std::map<unsigned int, std::chrono::nanoseconds>
+    get_response_times() const;
+
+    // Record the outcome of a command.  missed is true if a command that
+    // has been answered before returned NO DATA.
+    void record_result(bool missed);
+
+    // Returns the settings to send to the adapter, if they have changed
+    // since the last call.
+    std::optional<Settings> update();
+
+    void reset();
+
+    // The adapter is back at its power on settings, e.g. after a warm
+    // start.  The next update() sends the learned settings again.
+    void adapter_reset();
+
+  private:
+    // Response times are kept for a window of commands, so that the
+    // timeout follows changes in ECU behavior.
+    struct EcuTimes {
+        LatencyHistogram current;
+        std::chrono::nanoseconds previous_window{0};
+    };
+
+    std::map<unsigned int, EcuTimes> m_ecu_times;
+    Settings m_applied = DEFAULT_SETTINGS;
+    // Bit i is set if the command i commands ago was missed.
+    std::uint32_t m_missed = 0;
+    unsigned int m_backoff = 0;
+    unsigned int m_clean_commands = 0;
+
+    static std::chrono::nanoseconds response_time(const EcuTimes& times);
+    std::chrono::nanoseconds slowest_response() const;
+};
@@ -16,23 +16,53 @@
  */
 
 #include "elm327.hpp"
+#include "elm327-parser.hpp"
+#include "elm327-timing.hpp"
 #include "hardware-interface.hpp"
+#include "logger.hpp"
 #include "neonobd_exceptions.hpp"
+#include "profile-store.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <future>
-#include <glibmm/ustring.h>
 #include <iomanip>
 #include <ios>
+#include <iterator>
 #include <memory>
 #include <mutex>
-#include <sigc++/signal.h>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
+Elm327::Elm327()
+    : m_cmd_semaphore{0}, m_parser{[this](unsigned int header, auto data) {
+          receive_frame(header, data);
+      }} {
+    // Give a busy or faulty bus time to clear rather than add to its
+    // traffic.  Corrupted or interrupted responses are simply asked for
+    // again.
+    static constexpr std::chrono::milliseconds BUS_BUSY_DELAY{100};
+    static constexpr std::chrono::milliseconds BUS_ERROR_DELAY{250};
+    static constexpr unsigned int BUS_BUSY_RETRIES = 3;
+    static constexpr unsigned int RX_ERROR_RETRIES = 2;
+    m_retry_policies.at(neon::CMD_BUS_BUSY) = {BUS_BUSY_RETRIES,
+                                               BUS_BUSY_DELAY};
+    m_retry_policies.at(neon::CMD_BUS_ERROR) = {1, BUS_ERROR_DELAY};
+    m_retry_policies.at(neon::CMD_RX_ERROR) = {RX_ERROR_RETRIES, {}};
+    m_retry_policies.at(neon::CMD_BUFFER_FULL) = {1, {}};
+    m_retry_policies.at(neon::CMD_STOPPED) = {1, {}};
+}
+
 Elm327::~Elm327() {
     if (m_command_thread) {
         m_disconnect_in_progress = true;
@@ -48,6 +78,10 @@ void Elm327::init(HardwareInterface* hwif, std::function<void(bool)> callback) {
 
     m_hwif = hwif;
     m_init_callback = std::move(callback);
+    m_timing.reset();
+    for (const auto& [header, response_time] : m_response_time_hints) {
+        m_timing.seed(header, response_time);
+    }
     m_init_result = std::async(std::launch::async, &Elm327::init_thread, this);
 }
 
@@ -56,6 +90,8 @@ std::string Elm327::get_error_string() const { return m_error_string; }
 void Elm327::process_event(std::string_view event) {
     if (event == "CommandComplete") {
         command_complete();
+    } else if (event == "CommandFrame") {
+        frame_complete();
     } else if (event == "InitDone") {
         init_done();
     } else if (event == "CommandThreadExit") {
@@ -65,6 +101,8 @@ void Elm327::process_event(std::string_view event) {
 
 bool Elm327::init_thread() {
     try {
+        m_hwif->set_timeout(READ_TIMEOUT);
+
         if (!reset()) {
             throw std::runtime_error("ELM327 reset failed.");
         }
@@ -81,11 +119,23 @@ bool Elm327::init_thread() {
                 throw std::runtime_error("ELM237 failed to disable spaces.");
             }
         */
-        if (!scan_protocol()) {
+        if (!select_protocol()) {
             throw std::runtime_error(
                 "ELM327 failed to determine OBD protocol.");
         }
 
+        m_parser.set_protocol(m_protocol);
+
+        m_raw_can_active = false;
+        m_flow_control_mode = -1;
+        if (m_raw_can && is_CAN()) {
+            if (!enable_raw_can()) {
+                throw std::runtime_error(
+                    "ELM327 failed to enable raw CAN mode.");
+            }
+            m_raw_can_active = true;
+        }
+
         m_init_complete = true;
 
         m_command_thread =
@@ -102,17 +152,126 @@ void Elm327::init_done() {
     m_init_callback = nullptr;
 }
 
-void Elm327::send_command(unsigned char obd_address, unsigned char obd_service,
-                          const std::vector<unsigned char>& obd_data,
-                          CommandCallback callback) {
+CommandHandle Elm327::send_command(unsigned int obd_address,
+                                  unsigned char obd_service,
+                                  std::span<const unsigned char> obd_data,
+                                  CommandCallback callback,
+                                  CommandOptions options) {
 
     if (!m_init_complete || m_disconnect_in_progress) {
-        return;
+        if (callback) {
+            callback(neon::CMD_CANCELLED, {});
+        }
+        return {};
     }
+
+    const auto timeout =
+        options.timeout.count() > 0 ? options.timeout : COMMAND_TIMEOUT;
+    Command command{obd_address,
+                    obd_service,
+                    {},
+                    std::move(callback),
+                    std::move(options.frame_callback),
+                    timeout,
+                    get_cancel_flag()};
+    command.obd_data.assign(obd_data);
+    auto cancelled = command.cancelled;
+
     const std::scoped_lock lock(m_cmd_queue_lock);
-    m_cmd_queue.emplace(
-        Command{obd_address, obd_service, obd_data, std::move(callback)});
+    m_cmd_queue.push(obd_address, std::move(command), options.priority,
+                     options.deadline);
     m_cmd_semaphore.release();
+    return CommandHandle(std::move(cancelled));
+}
+
+void Elm327::set_protocol_hint(int protocol) {
+    if (m_init_result.valid() || m_init_complete) {
+        throw neon::InvalidState("Protocol hint must be set before init.");
+    }
+    m_protocol_hint = protocol;
+}
+
+void Elm327::set_raw_can(bool enabled) {
+    if (m_init_result.valid() || m_init_complete) {
+        throw neon::InvalidState("Raw CAN mode must be set before init.");
+    }
+    m_raw_can = enabled;
+}
+
+int Elm327::get_protocol() const { return m_protocol; }
+
+void Elm327::apply_profile(const VehicleProfile& profile) {
+    set_protocol_hint(profile.protocol);
+
+    m_identified = !profile.firmware.empty();
+    m_firmware = profile.firmware;
+    m_st_firmware = profile.st_firmware;
+    m_response_count_supported =
+        (profile.extensions & EXTENSION_RESPONSE_COUNT) != 0;
+
+    m_response_time_hints.clear();
+    for (const auto& ecu : profile.ecus) {
+        if (ecu.response_time.count() > 0) {
+            m_response_time_hints.emplace(ecu.header, ecu.response_time);
+        }
+    }
+}
+
+void Elm327::update_profile(VehicleProfile& profile) const {
+    profile.firmware = m_firmware;
+    profile.st_firmware = m_st_firmware;
+    profile.extensions = 0;
+    if (m_response_count_supported) {
+        profile.extensions |= EXTENSION_RESPONSE_COUNT;
+    }
+    if (!m_st_firmware.empty()) {
+        profile.extensions |= EXTENSION_ST_COMMANDS;
+    }
+    if (m_protocol > 0) {
+        profile.protocol = m_protocol;
+    }
+
+    for (const auto& [header, response_time] : m_timing.get_response_times()) {
+        auto ecu = std::ranges::find(profile.ecus, header, &EcuProfile::header);
+        if (ecu == profile.ecus.end()) {
+            profile.ecus.push_back({header, {}, {}});
+            ecu = std::prev(profile.ecus.end());
+        }
+        ecu->response_time =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                response_time);
+    }
+}
+
+void Elm327::set_retry_policy(CommandStatus status, RetryPolicy policy) {
+    if (status == neon::CMD_OK || status == neon::CMD_EXPIRED ||
+        status == neon::CMD_CANCELLED) {
+        throw std::invalid_argument("Status can not be retried.");
+    }
+    const std::scoped_lock lock(m_retry_policy_lock);
+    m_retry_policies.at(status) = policy;
+}
+
+Elm327::RetryPolicy Elm327::get_retry_policy(CommandStatus status) const {
+    const std::scoped_lock lock(m_retry_policy_lock);
+    return m_retry_policies.at(status);
+}
+
+Elm327::StatusCounts Elm327::get_status_counts() const {
+    StatusCounts counts{};
+    std::ranges::transform(m_status_counts, counts.begin(),
+                           [](const auto& count) { return count.load(); });
+    return counts;
+}
+
+void Elm327::reset_status_counts() {
+    for (auto& count : m_status_counts) {
+        count = 0;
+    }
+}
+
+void Elm327::count_status(CommandStatus status) {
+    ++m_status_counts.at(status);
 }
 
 bool Elm327::is_CAN() const {
@@ -138,95 +297,279 @@ void Elm327::disconnect(std::function<void()> callback) {
 
 void Elm327::send_completion(Completion&& completion) {
     const std::lock_guard lock(m_completion_queue_lock);
-    m_completion_queue.emplace(std::move(completion));
+    m_completion_queue.push_back(std::move(completion));
 }
 
 namespace {
-template <typename T> T get_next(std::queue<T>& queue, std::mutex& mutex) {
+template <typename T> T get_next(std::vector<T>& queue, std::mutex& mutex) {
     const std::lock_guard lock(mutex);
     auto result = std::move(queue.front());
-    queue.pop();
+    queue.erase(queue.begin());
     return result;
 }
 } // namespace
 
-Elm327::Command Elm327::get_next_cmd() {
-    return get_next(m_cmd_queue, m_cmd_queue_lock);
+std::optional<Elm327::Command> Elm327::get_next_cmd() {
+    const std::lock_guard lock(m_cmd_queue_lock);
+    const auto now = std::chrono::steady_clock::now();
+    while (auto expired = m_cmd_queue.take_expired(now)) {
+        count_status(neon::CMD_EXPIRED);
+        send_completion(Completion{neon::CMD_EXPIRED,
+                                   {},
+                                   std::move(expired->callback),
+                                   std::move(expired->cancelled)});
+        signal_event("CommandComplete");
+    }
+    return m_cmd_queue.pop(m_current_obd_address, now);
 }
 
 Elm327::Completion Elm327::get_next_completion() {
     return get_next(m_completion_queue, m_completion_queue_lock);
 }
 
-std::string Elm327::command_to_string(const Elm327::Command& command) {
-    std::stringstream cmd;
-    cmd << std::setw(2) << std::hex << command.obd_service;
-    for (auto data : command.obd_data) {
-        cmd << data;
+Elm327::CancelFlag Elm327::get_cancel_flag() {
+    {
+        const std::lock_guard lock(m_pool_lock);
+        // A flag can be reused once no handle or command refers to it.
+        const auto unused =
+            std::ranges::find_if(m_cancel_flag_pool, [](const auto& flag) {
+                return flag.use_count() == 1;
+            });
+        if (unused != m_cancel_flag_pool.end()) {
+            std::swap(*unused, m_cancel_flag_pool.back());
+            auto flag = std::move(m_cancel_flag_pool.back());
+            m_cancel_flag_pool.pop_back();
+            *flag = false;
+            return flag;
+        }
     }
-    cmd << std::setw(0) << "\r";
-    return cmd.str();
+    return std::make_shared<std::atomic<bool>>(false);
 }
 
-namespace {
-unsigned int get_header(std::stringstream& bytestream, bool is_CAN) {
-    unsigned int result = 0;
-    const int count = is_CAN ? 1 : 3;
-    for (int i = 0; i < count && bytestream; ++i) {
-        if (bytestream.peek() == '\r') {
-            return 0;
-        }
-        unsigned int temp = 0;
-        bytestream >> std::hex >> temp;
-        static constexpr unsigned int BITS_PER_BYTE = 8;
-        result <<= BITS_PER_BYTE;
-        result += temp;
+FrameSet Elm327::get_frame_set() {
+    const std::lock_guard lock(m_pool_lock);
+    if (m_frame_set_pool.empty()) {
+        return {};
     }
-    return result;
+    auto frames = std::move(m_frame_set_pool.back());
+    m_frame_set_pool.pop_back();
+    return frames;
+}
+
+void Elm327::recycle(Completion& completion) {
+    completion.frames.clear();
+    const std::lock_guard lock(m_pool_lock);
+    if (m_frame_set_pool.size() < MAX_POOLED) {
+        m_frame_set_pool.push_back(std::move(completion.frames));
+    }
+    if (completion.cancelled && m_cancel_flag_pool.size() < MAX_POOLED) {
+        m_cancel_flag_pool.push_back(std::move(completion.cancelled));
+    }
+}
+
+namespace {
+void append_hex(std::string& str, unsigned char byte) {
+    static constexpr std::string_view HEX_DIGITS = "0123456789ABCDEF";
+    static constexpr unsigned int BITS_PER_NIBBLE = 4;
+    static constexpr unsigned int NIBBLE_MASK = 0x0F;
+    str.push_back(HEX_DIGITS.at(byte >> BITS_PER_NIBBLE));
+    str.push_back(HEX_DIGITS.at(byte & NIBBLE_MASK));
 }
 } // namespace
 
-Elm327::Completion
-Elm327::string_to_completion(const std::string& bytes) const {
-    Completion cpl;
-    const bool is_can = is_CAN();
+std::uint64_t Elm327::command_key(const Command& command) {
+    // 64 bit FNV-1a hash of the header, service and data bytes.
+    static constexpr std::uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325;
+    static constexpr std::uint64_t FNV_PRIME = 0x100000001B3;
+    static constexpr unsigned int BITS_PER_BYTE = 8;
+    static constexpr unsigned int BYTE_MASK = 0xFF;
+
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+    auto add_byte = [&hash](unsigned int byte) {
+        hash ^= byte & BYTE_MASK;
+        hash *= FNV_PRIME;
+    };
+    for (unsigned int shift = 0; shift < sizeof(command.obd_address) *
+                                             BITS_PER_BYTE;
+         shift += BITS_PER_BYTE) {
+        add_byte(command.obd_address >> shift);
+    }
+    add_byte(command.obd_service);
+    for (auto data : command.obd_data) {
+        add_byte(data);
+    }
+    return hash;
+}
+
+void Elm327::command_to_string(const Elm327::Command& command,
+                               unsigned int response_count, bool with_pci,
+                               std::string& cmd) {
+    static constexpr std::string_view HEX_DIGITS = "0123456789ABCDEF";
+    cmd.clear();
+    cmd.reserve(2 * (command.obd_data.size() + 2) + 2);
+    if (with_pci) {
+        // Single frame: the length of the rest of the frame.
+        append_hex(cmd,
+                   static_cast<unsigned char>(command.obd_data.size() + 1));
+    }
+    append_hex(cmd, command.obd_service);
+    for (auto data : command.obd_data) {
+        append_hex(cmd, data);
+    }
+    if (response_count > 0 && response_count < HEX_DIGITS.size()) {
+        cmd.push_back(HEX_DIGITS.at(response_count));
+    }
+    cmd.push_back('\r');
+}
+
+void Elm327::receive_frame(unsigned int header,
+                           std::span<const unsigned char> data) {
+    m_timing.record_response(header,
+                             std::chrono::steady_clock::now() - m_command_sent);
 
-    std::stringstream bytestream(bytes);
-    while (bytestream && bytestream.peek() != '>') {
-        const unsigned int header = get_header(bytestream, is_can);
-        if (header == 0) {
-            break; // Some kind of error occurred...
+    m_current_completion.frames.append(header, data);
+
+    if (m_current_frame_callback && !*m_current_cancelled) {
+        FrameCompletion frame{
+            header, {}, m_current_frame_callback, m_current_cancelled};
+        frame.data.assign(data);
+        {
+            const std::lock_guard lock(m_completion_queue_lock);
+            m_frame_queue.push_back(std::move(frame));
         }
+        signal_event("CommandFrame");
+    }
+}
 
-        while (bytestream && bytestream.peek() != '\r') {
-            unsigned int temp = 0;
-            bytestream >> std::hex >> temp;
-            cpl.obd_data[header].push_back(static_cast<unsigned char>(temp));
+void Elm327::send_obd_command(const Command& command) {
+    // The adapter does not split requests into frames in raw CAN mode.
+    static constexpr std::size_t MAX_SINGLE_FRAME_DATA = 7;
+    if (m_raw_can_active &&
+        command.obd_data.size() + 1 > MAX_SINGLE_FRAME_DATA) {
+        Logger::error << "Request too long for raw CAN mode.\n";
+        m_current_completion.status = neon::CMD_ERROR;
+        return;
+    }
+
+    const auto key = command_key(command);
+    unsigned int expected_lines = 0;
+    if (m_response_count_supported) {
+        const auto count = m_response_counts.find(key);
+        if (count != m_response_counts.end()) {
+            expected_lines = count->second;
         }
+    }
+
+    command_to_string(command, expected_lines, m_raw_can_active,
+                      m_command_string);
+    const std::string_view cmd = m_command_string;
+    m_parser.begin(cmd.substr(0, cmd.size() - 1));
+    m_hwif->write(cmd);
+    m_command_sent = std::chrono::steady_clock::now();
+
+    const bool prompt_received = read_until_prompt(
+        [this](std::string_view data) { return m_parser.feed(data); },
+        command.timeout);
+
+    m_current_completion.status = m_parser.get_status();
+    if (!prompt_received) {
+        Logger::error << "No prompt received from ELM327.\n";
+        m_current_completion.status = neon::CMD_TIMEOUT;
+        recover();
+    }
+
+    // An ECU that stops answering must not leave a count that is too
+    // high, which would make every later request wait for the timeout.
+    // Fewer lines than expected means that just happened, so relearn.
+    const auto lines = m_parser.get_line_count();
+    m_timing.record_result(m_current_completion.status == neon::CMD_NO_DATA &&
+                           m_response_counts.contains(key));
+    if (m_current_completion.status != neon::CMD_OK || lines == 0) {
+        m_response_counts.erase(key);
+    } else if (lines != expected_lines) {
+        m_response_counts[key] = lines;
+    }
+}
 
-        if (bytestream && bytestream.peek() == '\r') {
-            bytestream.get();
+void Elm327::send_with_retries(const Command& command) {
+    static constexpr unsigned int MAX_DOUBLINGS = 10;
+    for (unsigned int attempt = 0;; ++attempt) {
+        send_obd_command(command);
+        const auto status = m_current_completion.status;
+        count_status(status);
+
+        const auto policy = get_retry_policy(status);
+        if (status == neon::CMD_OK || attempt >= policy.retries) {
+            return;
+        }
+        const auto delay =
+            std::min(policy.delay * (1U << std::min(attempt, MAX_DOUBLINGS)),
+                     std::chrono::milliseconds(MAX_RETRY_DELAY));
+        Logger::debug << "Retrying ELM327 command after status " << status
+                      << " in " << delay.count() << " ms.\n";
+        if (!retry_wait(delay, command.cancelled)) {
+            return;
         }
+        m_current_completion.frames.clear();
     }
+}
 
-    return cpl;
+bool Elm327::retry_wait(std::chrono::milliseconds delay,
+                        const CancelFlag& cancelled) const {
+    const auto until = std::chrono::steady_clock::now() + delay;
+    while (!m_disconnect_in_progress && !*cancelled) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= until) {
+            return true;
+        }
+        std::this_thread::sleep_for(
+            std::min<std::chrono::steady_clock::duration>(READ_TIMEOUT,
+                                                          until - now));
+    }
+    return false;
 }
 
 void Elm327::command_thread() {
     while (!m_disconnect_in_progress) {
         m_cmd_semaphore.acquire();
-        while (!m_cmd_queue.empty() && !m_disconnect_in_progress) {
-            auto command = get_next_cmd();
+        while (!m_disconnect_in_progress) {
+            auto next = get_next_cmd();
+            if (!next) {
+                break;
+            }
+            auto& command = *next;
+            if (*command.cancelled) {
+                count_status(neon::CMD_CANCELLED);
+                send_completion(Completion{neon::CMD_CANCELLED,
+                                           {},
+                                           std::move(command.callback),
+                                           std::move(command.cancelled)});
+                signal_event("CommandComplete");
+                continue;
+            }
+
+            if (const auto settings = m_timing.update()) {
+                set_timing(*settings);
+            }
             if (m_current_obd_address != command.obd_address) {
                 set_header(command.obd_address);
+                if (m_raw_can_active) {
+                    set_flow_control(command.obd_address);
+                }
                 m_current_obd_address = command.obd_address;
             }
-            auto response = send_command(command_to_string(command));
 
-            auto completion = string_to_completion(response);
-            completion.callback = std::move(command.callback);
+            m_current_completion = Completion{};
+            m_current_completion.frames = get_frame_set();
+            m_current_frame_callback = std::move(command.frame_callback);
+            m_current_cancelled = command.cancelled;
+            send_with_retries(command);
+            m_current_frame_callback = nullptr;
+            m_current_cancelled = nullptr;
 
-            send_completion(std::move(completion));
+            m_current_completion.callback = std::move(command.callback);
+            m_current_completion.cancelled = std::move(command.cancelled);
+            send_completion(std::move(m_current_completion));
 
             signal_event("CommandComplete");
         }
@@ -236,41 +579,112 @@ void Elm327::command_thread() {
 
 void Elm327::command_complete() {
     auto cpl = get_next_completion();
-    cpl.callback(cpl.obd_data);
+    if (cpl.callback) {
+        if (*cpl.cancelled) {
+            cpl.callback(neon::CMD_CANCELLED, {});
+        } else {
+            cpl.callback(cpl.status, cpl.frames.frames());
+        }
+    }
+    recycle(cpl);
 }
 
-namespace {
-template <typename T> void clear_queue(std::queue<T>& queue) {
-    while (!queue.empty()) {
-        queue.pop();
+void Elm327::frame_complete() {
+    auto frame = get_next(m_frame_queue, m_completion_queue_lock);
+    if (!*frame.cancelled) {
+        frame.callback(frame.header, frame.data);
     }
 }
-} // namespace
 
 void Elm327::command_thread_exit() {
     m_command_thread->join();
     m_command_thread.reset();
     m_init_complete = false;
     m_disconnect_in_progress = false;
-    clear_queue(m_cmd_queue);
-    clear_queue(m_completion_queue);
+    cancel_queued_commands();
+    m_response_counts.clear();
     m_disconnect_callback();
 }
 
-std::string Elm327::send_command(const std::string& cmd) {
+void Elm327::cancel_queued_commands() {
+    // Every command gets its callback, even if the device goes away
+    // before sending it.  Commands sent from these callbacks are
+    // cancelled at once.
+    std::vector<CommandCallback> callbacks;
+    for (auto& completion : m_completion_queue) {
+        callbacks.push_back(std::move(completion.callback));
+    }
+    while (auto command = m_cmd_queue.pop(0)) {
+        callbacks.push_back(std::move(command->callback));
+    }
+    m_completion_queue.clear();
+    m_frame_queue.clear();
+    for (const auto& callback : callbacks) {
+        if (callback) {
+            callback(neon::CMD_CANCELLED, {});
+        }
+    }
+}
+
+bool Elm327::read_until_prompt(
+    const std::function<bool(std::string_view)>& consume,
+    std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    do {
+        m_hwif->read(m_read_buffer);
+        if (!m_read_buffer.empty() && consume(m_read_buffer)) {
+            return true;
+        }
+    } while (std::chrono::steady_clock::now() < deadline &&
+             !m_disconnect_in_progress);
+    return false;
+}
+
+std::string Elm327::send_command(const std::string& cmd,
+                                 std::chrono::milliseconds timeout) {
     std::string response;
-    std::string buffer;
     m_hwif->write(cmd);
-    size_t prompt_position = 0;
-    do {
-        m_hwif->read(buffer);
-        prompt_position = buffer.find('>');
-        response.append(buffer);
-    } while (!buffer.empty() && prompt_position == std::string::npos);
+    // Callers check the response for the prompt.
+    read_until_prompt(
+        [&response](std::string_view data) {
+            response.append(data);
+            return data.find('>') != std::string_view::npos;
+        },
+        timeout);
+    return response;
+}
 
-    // What if we don't get a prompt back????  Let caller take care of it?
+bool Elm327::recover() {
+    // Any character aborts the command in progress, and the adapter
+    // returns to the prompt.  A carriage return at the prompt would
+    // repeat the last command, but a space is ignored there.
+    Logger::info << "Aborting ELM327 command.\n";
+    m_hwif->write(std::string_view(" "));
+    if (read_until_prompt(
+            [](std::string_view data) {
+                return data.find('>') != std::string_view::npos;
+            },
+            COMMAND_TIMEOUT)) {
+        return true;
+    }
 
-    return response;
+    // No answer; warm start the adapter and restore its settings.
+    Logger::error << "ELM327 not responding; warm starting.\n";
+    static constexpr std::chrono::milliseconds RESET_TIMEOUT{5000};
+    if (send_command("ATWS\r", RESET_TIMEOUT).find('>') ==
+            std::string::npos ||
+        !disable_echo() || !enable_headers() || !set_protocol(m_protocol) ||
+        (m_raw_can_active && !enable_raw_can())) {
+        Logger::error << "ELM327 recovery failed.\n";
+        return false;
+    }
+
+    // The header, flow control and timing settings are back to their
+    // defaults.  The learned response times still hold.
+    m_current_obd_address = 0;
+    m_flow_control_mode = -1;
+    m_timing.adapter_reset();
+    return true;
 }
 
 // Elm327 Config commands
@@ -292,9 +706,139 @@ bool Elm327::set_header(unsigned int header) {
     return check_response(response);
 }
 
+bool Elm327::enable_raw_can() {
+    // Flow control frames: continue to send, no block limit, no
+    // separation time.
+    return check_response(send_command("ATCAF0\r")) &&
+           check_response(send_command("ATFCSD300000\r"));
+}
+
+bool Elm327::set_flow_control(unsigned int header) {
+    // Only the addressed ECU answers a physical request, so its flow
+    // control goes to that same header.  Answers to a functional request
+    // need the header of whichever ECU sent them, which the adapter
+    // works out itself.
+    static constexpr unsigned int FUNCTIONAL_11BIT = 0x7DF;
+    static constexpr unsigned int FUNCTIONAL_29BIT = 0x18DB33F1;
+    static constexpr int USER_HEADER_AND_DATA = 1;
+    static constexpr int USER_DATA = 2;
+    const bool functional =
+        header == FUNCTIONAL_11BIT || header == FUNCTIONAL_29BIT;
+    const int mode = functional ? USER_DATA : USER_HEADER_AND_DATA;
+
+    std::stringstream cmd;
+    if (!functional) {
+        static constexpr unsigned int MAX_11BIT_HEADER = 0x7FF;
+        static constexpr int HEADER_11BIT_NIBBLES = 3;
+        static constexpr int HEADER_29BIT_NIBBLES = 8;
+        cmd << "ATFCSH" << std::uppercase << std::hex
+            << std::setw(header > MAX_11BIT_HEADER ? HEADER_29BIT_NIBBLES
+                                                   : HEADER_11BIT_NIBBLES)
+            << std::setfill('0') << header << "\r";
+        if (!check_response(send_command(cmd.str()))) {
+            return false;
+        }
+    }
+    if (mode == m_flow_control_mode) {
+        return true;
+    }
+
+    cmd.str("");
+    cmd << "ATFCSM" << mode << "\r";
+    if (!check_response(send_command(cmd.str()))) {
+        return false;
+    }
+    m_flow_control_mode = mode;
+    return true;
+}
+
+bool Elm327::set_timing(const Elm327Timing::Settings& settings) {
+    Logger::debug << "ELM327 timing: ATAT" << settings.adaptive_mode
+                  << ", ATST " << settings.timeout << ".\n";
+
+    std::stringstream cmd;
+    cmd << "ATAT" << settings.adaptive_mode << "\r";
+    if (!check_response(send_command(cmd.str()))) {
+        return false;
+    }
+
+    static constexpr int TIMEOUT_NIBBLES = 2;
+    cmd.str("");
+    cmd << "ATST" << std::uppercase << std::hex << std::setw(TIMEOUT_NIBBLES)
+        << std::setfill('0') << settings.timeout << "\r";
+    return check_response(send_command(cmd.str()));
+}
+
 bool Elm327::reset() {
-    auto response = send_command("ATZ\r");
-    return response.find('>') != std::string::npos;
+    // An adapter that is already running only needs its settings put
+    // back to the defaults, which saves the second a full reset takes.
+    if (!check_response(send_command("ATD\r"))) {
+        Logger::info << "ELM327 not responding to ATD; resetting.\n";
+        static constexpr std::chrono::milliseconds RESET_TIMEOUT{5000};
+        if (send_command("ATZ\r", RESET_TIMEOUT).find('>') ==
+            std::string::npos) {
+            return false;
+        }
+    }
+    // Already known from an earlier connection.
+    if (m_identified) {
+        return true;
+    }
+    return identify();
+}
+
+namespace {
+// First line of the response that is not the command echo.
+std::string response_text(std::string_view response, std::string_view cmd) {
+    while (!response.empty()) {
+        const auto end = std::min(response.find_first_of("\r>"),
+                                  response.size());
+        const auto line = response.substr(0, end);
+        if (!line.empty() && line != cmd) {
+            return std::string(line);
+        }
+        response.remove_prefix(std::min(end + 1, response.size()));
+    }
+    return "";
+}
+} // namespace
+
+bool Elm327::identify() {
+    auto response = send_command("ATI\r");
+    if (response.find('>') == std::string::npos) {
+        return false;
+    }
+    m_firmware = response_text(response, "ATI");
+
+    // STN chips answer STI; others report an unknown command.
+    const auto st_response = send_command("STI\r");
+    m_st_firmware = response_text(st_response, "STI");
+    if (m_st_firmware == "?") {
+        m_st_firmware.clear();
+    }
+
+    // The identification string is "ELM327 vX.Y".  The response count
+    // suffix was added in v1.3.
+    static constexpr std::string_view ID = "ELM327 v";
+    static constexpr int MIN_MAJOR = 1;
+    static constexpr int MIN_MINOR = 3;
+    m_response_count_supported = false;
+    const auto id_pos = m_firmware.find(ID);
+    if (id_pos != std::string::npos) {
+        int major = 0;
+        int minor = 0;
+        std::istringstream version(m_firmware.substr(id_pos + ID.size()));
+        char dot = 0;
+        if (version >> major >> dot >> minor && dot == '.') {
+            m_response_count_supported =
+                major > MIN_MAJOR || (major == MIN_MAJOR && minor >= MIN_MINOR);
+        }
+    }
+    Logger::debug << "ELM327 response count "
+                  << (m_response_count_supported ? "supported" : "unsupported")
+                  << ".\n";
+    m_identified = true;
+    return true;
 }
 
 bool Elm327::enable_echo() { return check_response(send_command("ATE1\r")); }
@@ -311,12 +855,45 @@ bool Elm327::enable_spaces() { return check_response(send_command("ATS1\r")); }
 
 bool Elm327::disable_spaces() { return check_response(send_command("ATS0\r")); }
 
+bool Elm327::select_protocol() {
+    if (m_protocol_hint > 0) {
+        if (try_protocol(m_protocol_hint)) {
+            return true;
+        }
+        Logger::info << "Protocol " << m_protocol_hint
+                     << " failed; searching.\n";
+    }
+    return scan_protocol();
+}
+
+bool Elm327::try_protocol(int protocol) {
+    if (!set_protocol(protocol)) {
+        return false;
+    }
+
+    // Any ECU answering PID 00 confirms the protocol.  K-line protocols
+    // need a few seconds for the bus initialization.
+    static constexpr std::chrono::milliseconds INIT_TIMEOUT{5000};
+    const auto response = send_command("0100\r", INIT_TIMEOUT);
+    if (response.find('>') == std::string::npos ||
+        (response.find("41 00") == std::string::npos &&
+         response.find("4100") == std::string::npos)) {
+        return false;
+    }
+
+    m_protocol = protocol;
+    return true;
+}
+
 bool Elm327::scan_protocol() {
     if (!check_response(send_command("ATSP0\r"))) {
         return false;
     }
 
-    if (send_command("0100\r").find('>') == std::string::npos) {
+    // The adapter tries each protocol in turn.
+    static constexpr std::chrono::milliseconds SEARCH_TIMEOUT{20000};
+    if (send_command("0100\r", SEARCH_TIMEOUT).find('>') ==
+        std::string::npos) {
         return false;
     }
 
@@ -336,3 +913,9 @@ bool Elm327::scan_protocol() {
 
     return m_protocol > 0;
 }
+
+bool Elm327::set_protocol(int protocol) {
+    std::stringstream cmd;
+    cmd << "ATSP" << std::uppercase << std::hex << protocol << "\r";
+    return check_response(send_command(cmd.str()));
+}
@@ -17,21 +17,31 @@
 
 #pragma once
 
+#include "command-scheduler.hpp"
+#include "elm327-parser.hpp"
+#include "elm327-timing.hpp"
+#include "frame-set.hpp"
 #include "hardware-interface.hpp"
 #include "obd-device.hpp"
-#include <arrary>
+#include "profile-store.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
 #include <semaphore>
+#include <span>
 #include <string>
 #include <string_view>
 #include <thread>
 #include <unordered_map>
-
-using ObdDevice::CommandCallback;
+#include <vector>
 
 class Elm327 : public ObdDevice {
   public:
@@ -45,9 +55,11 @@ class Elm327 : public ObdDevice {
 
     std::string get_error_string() const override;
 
-    void send_command(unsigned char obd_address, unsigned char obd_service,
-                      const std::vector<unsigned char>& obd_data,
-                      CommandCallback callback) override;
+    CommandHandle send_command(unsigned int obd_address,
+                               unsigned char obd_service,
+                               std::span<const unsigned char> obd_data,
+                               CommandCallback callback,
+                               CommandOptions options) override;
 
     bool is_CAN() const override;
 
@@ -57,19 +69,91 @@ class Elm327 : public ObdDevice {
 
     void disconnect(std::function<void()> callback) override;
 
+    // Protocol to try before searching, e.g. the one found on an earlier
+    // connection to the same vehicle.  Set before calling init().
+    void set_protocol_hint(int protocol);
+
+    // On CAN, turn off the adapter's formatting (ATCAF0) and send our own
+    // flow control, asking ECUs for the rest of a multi-frame response
+    // without pauses or waits between blocks.  Frames are passed through
+    // as they are and reassembled by the parser.  Requests then carry
+    // their own PCI byte, so they must fit in a single frame.  Set
+    // before calling init().
+    void set_raw_can(bool enabled);
+
+    // Protocol number, as reported by ATDPN.  Zero until connected.
+    int get_protocol() const;
+
+    // Use what was learned on an earlier connection: the protocol is
+    // tried first, the adapter is not identified again, and the timeout
+    // starts from the response times seen before.  Set before calling
+    // init().
+    void apply_profile(const VehicleProfile& profile) override;
+
+    // Record what was learned on this connection in profile.  Call while
+    // not connected, e.g. once disconnect completes.
+    void update_profile(VehicleProfile& profile) const override;
+
+    // How a command that fails with a given status is retried.  Frames
+    // from the failed attempt are dropped, though frame callbacks may
+    // already have seen them.
+    struct RetryPolicy {
+        // Times the command is sent again.
+        unsigned int retries = 0;
+        // Wait before the first retry, doubled for each one after that.
+        std::chrono::milliseconds delay{0};
+    };
+
+    void set_retry_policy(CommandStatus status, RetryPolicy policy);
+    RetryPolicy get_retry_policy(CommandStatus status) const;
+
+    // Number of commands that ended with each status, counting every
+    // attempt of a retried command.
+    using StatusCounts = std::array<std::uint64_t, neon::COMMAND_STATUS_COUNT>;
+    StatusCounts get_status_counts() const;
+    void reset_status_counts();
+
   private:
+    using CancelFlag = std::shared_ptr<std::atomic<bool>>;
+
+    // Longest command data stored without allocating.
+    static constexpr std::size_t INLINE_DATA = 8;
+
     struct Command {
         unsigned int obd_address;
         unsigned char obd_service;
-        std::vector<unsigned char> obd_data;
+        SmallBuffer<unsigned char, INLINE_DATA> obd_data;
         CommandCallback callback;
+        FrameCallback frame_callback;
+        std::chrono::milliseconds timeout;
+        CancelFlag cancelled;
     };
 
     struct Completion {
-        std::unordered_map<unsigned int, std::vector<unsigned char>> obd_data;
+        CommandStatus status = neon::CMD_OK;
+        FrameSet frames;
         CommandCallback callback;
+        CancelFlag cancelled;
+    };
+
+    // Response from one ECU, delivered before the command completes.
+    struct FrameCompletion {
+        unsigned int header;
+        SmallBuffer<unsigned char, FrameSet::INLINE_BYTES> data;
+        FrameCallback callback;
+        CancelFlag cancelled;
     };
 
+    // Default time allowed for the adapter to return to the prompt.
+    static constexpr std::chrono::milliseconds COMMAND_TIMEOUT{2000};
+    // Reads return at least this often, so timeouts can be checked.  A
+    // serial port's read timeout is in whole deciseconds.
+    static constexpr std::chrono::milliseconds READ_TIMEOUT{100};
+    // Most frame sets and cancel flags kept for reuse.
+    static constexpr std::size_t MAX_POOLED = 16;
+    // Longest wait between retries.
+    static constexpr std::chrono::milliseconds MAX_RETRY_DELAY{2000};
+
     void process_event(std::string_view event) override;
 
     HardwareInterface* m_hwif = nullptr;
@@ -79,33 +163,95 @@ class Elm327 : public ObdDevice {
     bool m_init_in_progress = false;
     bool m_init_complete = false;
     std::future<bool> m_init_result;
-    sigc::signal<void(bool)> m_init_signal;
-    sigc::signal<void()> m_disconnect_signal;
     std::mutex m_cmd_queue_lock;
     std::binary_semaphore m_cmd_semaphore;
-    std::queue<Command> m_cmd_queue;
+    CommandScheduler<Command> m_cmd_queue;
     std::unique_ptr<std::thread> m_command_thread;
     std::mutex m_completion_queue_lock;
-    std::queue<Completion> m_completion_queue;
+    std::vector<Completion> m_completion_queue;
+    std::vector<FrameCompletion> m_frame_queue;
+    // Frame sets and cancel flags of completed commands are reused, so
+    // that polling does not allocate once it has settled.  The frame
+    // sets keep any heap storage grown by large responses.
+    std::mutex m_pool_lock;
+    std::vector<FrameSet> m_frame_set_pool;
+    std::vector<CancelFlag> m_cancel_flag_pool;
     unsigned int m_current_obd_address = 0;
     std::string m_error_string;
     int m_protocol = 0;
+    int m_protocol_hint = 0;
+    std::string m_firmware;
+    std::string m_st_firmware;
+    bool m_identified = false;
+    bool m_raw_can = false;
+    std::map<unsigned int, std::chrono::nanoseconds> m_response_time_hints;
+    mutable std::mutex m_retry_policy_lock;
+    std::array<RetryPolicy, neon::COMMAND_STATUS_COUNT> m_retry_policies;
+    std::array<std::atomic<std::uint64_t>, neon::COMMAND_STATUS_COUNT>
+        m_status_counts{};
+
+    // Only used by the command thread
+    Elm327Parser m_parser;
+    Completion m_current_completion;
+    FrameCallback m_current_frame_callback;
+    CancelFlag m_current_cancelled;
+    std::string m_command_string;
+    std::string m_read_buffer;
+    // Set once raw CAN mode is configured on a CAN protocol.
+    bool m_raw_can_active = false;
+    // ATFCSM mode in use, or -1 before the first raw CAN request.
+    int m_flow_control_mode = -1;
+
+    // Number of response lines seen for each command, keyed by
+    // command_key().  Once known, it is appended to the command so the
+    // adapter returns as soon as the last response arrives instead of
+    // waiting for its timeout.  Requires ELM327 v1.3 or later.
+    bool m_response_count_supported = false;
+    std::unordered_map<std::uint64_t, unsigned int> m_response_counts;
+
+    // ATST/ATAT are tuned from the time each ECU takes to respond.
+    Elm327Timing m_timing;
+    std::chrono::steady_clock::time_point m_command_sent;
 
     bool init_thread();
     void init_done();
     void send_completion(Completion&& completion);
-    Command get_next_cmd();
+    std::optional<Command> get_next_cmd();
     Completion get_next_completion();
-    static std::string command_to_string(const Command& command);
-    Completion string_to_completion(const std::string& s) const;
+    CancelFlag get_cancel_flag();
+    FrameSet get_frame_set();
+    void recycle(Completion& completion);
+    static std::uint64_t command_key(const Command& command);
+    static void command_to_string(const Command& command,
+                                  unsigned int response_count, bool with_pci,
+                                  std::string& cmd);
+    void receive_frame(unsigned int header, std::span<const unsigned char> data);
+    void send_obd_command(const Command& command);
+    void send_with_retries(const Command& command);
+    bool retry_wait(std::chrono::milliseconds delay,
+                    const CancelFlag& cancelled) const;
+    void count_status(CommandStatus status);
     void command_thread();
     void command_complete();
+    void frame_complete();
     void command_thread_exit();
-    std::string send_command(const std::string& cmd);
+    void cancel_queued_commands();
+    bool read_until_prompt(const std::function<bool(std::string_view)>& consume,
+                           std::chrono::milliseconds timeout);
+    std::string send_command(const std::string& cmd,
+                             std::chrono::milliseconds timeout =
+                                 COMMAND_TIMEOUT);
+    bool recover();
 
     // ELM327 Config commands
     bool set_header(unsigned int header);
+    bool set_flow_control(unsigned int header);
+    bool enable_raw_can();
+    bool set_timing(const Elm327Timing::Settings& settings);
     bool reset();
+    bool identify();
+    bool select_protocol();
+    bool try_protocol(int protocol);
     bool enable_echo();
     bool disable_echo();
     bool enable_headers();
@@ -113,4 +259,5 @@ class Elm327 : public ObdDevice {
     bool enable_spaces();
     bool disable_spaces();
     bool scan_protocol();
+    bool set_protocol(int protocol);
 };
@@ -17,16 +17,21 @@
 
 #include "event-handler.hpp"
 #include "logger.hpp"
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
 #include <linux/limits.h>
+#include <mutex>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <sys/poll.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 EventHandler::~EventHandler() {
@@ -48,31 +53,49 @@ void EventHandler::process_events() {
     std::array<char, PIPE_BUF> buf{};
     pollfd pfd = {.fd = m_event_fd.at(0), .events = POLLIN, .revents = 0};
 
+    // Each event is a timestamp followed by a null terminated string.
+    static constexpr size_t STAMP_SIZE = sizeof(EventTimestamp);
     size_t count = 0;
     do {
         const std::span<char> subarray =
             std::span(buf).last(buf.size() - count);
 
         const auto res =
-            ::read(m_event_fd.at(0), subarray.data(), subarray.size() - 1);
+            ::read(m_event_fd.at(0), subarray.data(), subarray.size());
 
         if (res > 0) {
             count += static_cast<size_t>(res);
-            buf.at(count) = '\0';
-            for (std::span<char> substr(buf); count > 0;) {
-                const std::string_view event = substr.data();
-
-                // We didn't get a whole string
-                if (event.size() == count) {
-                    // Copy the string to the beginning of the buffer,
-                    // and break out to read the rest of the string.
-                    std::memmove(buf.data(), event.data(), count);
+            const EventTimestamp dispatch_time = now();
+            std::span<char> substr = std::span(buf).first(count);
+            while (substr.size() > STAMP_SIZE) {
+                const auto text = substr.subspan(STAMP_SIZE);
+                const auto* terminator = static_cast<const char*>(
+                    std::memchr(text.data(), '\0', text.size()));
+
+                // We didn't get a whole event
+                if (terminator == nullptr) {
                     break;
                 }
+
+                EventTimestamp signal_time = 0;
+                std::memcpy(&signal_time, substr.data(), STAMP_SIZE);
+                const std::string_view event(text.data(), terminator);
+
+                --m_queue_depth;
+                {
+                    const std::scoped_lock lock(m_stats_lock);
+                    m_latency.record(
+                        std::chrono::nanoseconds(dispatch_time - signal_time));
+                }
+
                 process_event(event);
-                substr = substr.last(substr.size() - event.size() - 1);
-                count -= event.size() + 1;
+                substr = substr.subspan(STAMP_SIZE + event.size() + 1);
             }
+
+            // Copy any partial event to the beginning of the buffer,
+            // and read the rest of it.
+            std::memmove(buf.data(), substr.data(), substr.size());
+            count = substr.size();
         } else if (res < 0) {
             throw std::runtime_error("Read of event pipe fd failed...");
         }
@@ -82,6 +105,54 @@ void EventHandler::process_events() {
 
 int EventHandler::get_event_fd() const { return m_event_fd.at(0); }
 
+EventHandler::EventTimestamp EventHandler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
 void EventHandler::signal_event(const std::string& event) {
-    ::write(m_event_fd.at(1), event.c_str(), event.size() + 1);
+    // Only the bytes written are set; this runs for every frame.
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init)
+    std::array<char, PIPE_BUF> message;
+    static constexpr size_t STAMP_SIZE = sizeof(EventTimestamp);
+    const size_t length =
+        std::min(event.size(), message.size() - STAMP_SIZE - 1);
+
+    const EventTimestamp timestamp = now();
+    std::memcpy(message.data(), &timestamp, STAMP_SIZE);
+    std::memcpy(std::span(message).subspan(STAMP_SIZE).data(), event.data(),
+                length);
+    message.at(STAMP_SIZE + length) = '\0';
+
+    // Count the event before writing it, so that the reader never sees
+    // it first, and take it back if the write fails.
+    const size_t size = STAMP_SIZE + length + 1;
+    const size_t depth = ++m_queue_depth;
+    if (::write(m_event_fd.at(1), message.data(), size) !=
+        static_cast<ssize_t>(size)) {
+        --m_queue_depth;
+        Logger::error << "Write to event pipe failed; event " << event
+                      << " dropped.\n";
+        return;
+    }
+
+    size_t high_water = m_queue_depth_high_water;
+    while (depth > high_water &&
+           !m_queue_depth_high_water.compare_exchange_weak(high_water, depth)) {
+    }
+}
+
+EventHandler::EventStats EventHandler::get_event_stats() const {
+    EventStats stats;
+    stats.queue_depth_high_water = m_queue_depth_high_water;
+    const std::scoped_lock lock(m_stats_lock);
+    stats.latency = m_latency;
+    return stats;
+}
+
+void EventHandler::reset_event_stats() {
+    m_queue_depth_high_water = m_queue_depth.load();
+    const std::scoped_lock lock(m_stats_lock);
+    m_latency.reset();
 }
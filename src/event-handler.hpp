@@ -16,7 +16,12 @@
  */
 
 #pragma once
+#include "latency-histogram.hpp"
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <string_view>
 
@@ -30,6 +35,18 @@ class EventHandler {
     virtual void process_events();
     virtual int get_event_fd() const;
 
+    // Dispatch statistics, used to tell whether slow event processing is
+    // caused by the event loop or by the code signaling the events.
+    struct EventStats {
+        // Time from signal_event() until process_event() is called.
+        LatencyHistogram latency;
+        // Largest number of events signaled but not yet dispatched.
+        std::size_t queue_depth_high_water = 0;
+    };
+
+    EventStats get_event_stats() const;
+    void reset_event_stats();
+
   protected:
     virtual void process_event(std::string_view /*unused*/){};
     virtual void init_event_handler();
@@ -37,4 +54,11 @@ class EventHandler {
 
   private:
     std::array<int, 2> m_event_fd = {-1, -1};
+    std::atomic<std::size_t> m_queue_depth = 0;
+    std::atomic<std::size_t> m_queue_depth_high_water = 0;
+    mutable std::mutex m_stats_lock;
+    LatencyHistogram m_latency;
+
+    using EventTimestamp = std::int64_t;
+    static EventTimestamp now();
 };
@@ -0,0 +1,252 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "event-loop.hpp"
+#include "event-handler.hpp"
+#include "logger.hpp"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+EventLoop::EventLoop() {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Creation of epoll fd failed");
+    }
+
+    m_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_stop_fd < 0) {
+        close(m_epoll_fd);
+        throw std::system_error(errno, std::generic_category(),
+                                "Creation of event loop stop fd failed");
+    }
+
+    watch(m_stop_fd, EPOLLIN);
+    Logger::debug << "Created EventLoop.\n";
+}
+
+EventLoop::~EventLoop() {
+    for (auto& [fd, callback] : m_sources) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    for (const auto& [timer_fd, repeat] : m_timers) {
+        close(timer_fd);
+    }
+    close(m_stop_fd);
+    close(m_epoll_fd);
+}
+
+void EventLoop::watch(int fd, std::uint32_t events) {
+    epoll_event evt = {.events = events, .data = {.fd = fd}};
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &evt) < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Could not add fd to event loop");
+    }
+}
+
+void EventLoop::add_event_handler(EventHandler& event_handler) {
+    add_fd(event_handler.get_event_fd(), EPOLLIN,
+           [&event_handler](std::uint32_t /*unused*/) {
+               event_handler.process_events();
+           });
+}
+
+void EventLoop::remove_event_handler(const EventHandler& event_handler) {
+    remove_fd(event_handler.get_event_fd());
+}
+
+void EventLoop::add_fd(int fd, std::uint32_t events, FdCallback callback) {
+    auto [iter, is_added] = m_sources.emplace(
+        fd, std::make_shared<FdCallback>(std::move(callback)));
+    if (!is_added) {
+        Logger::error << "fd " << fd << " already attached to event loop.\n";
+        return;
+    }
+
+    try {
+        watch(fd, events);
+    } catch (const std::system_error&) {
+        m_sources.erase(iter);
+        throw;
+    }
+}
+
+void EventLoop::modify_fd(int fd, std::uint32_t events) {
+    epoll_event evt = {.events = events, .data = {.fd = fd}};
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &evt) < 0) {
+        Logger::error << "Could not modify fd " << fd << " in event loop.\n";
+    }
+}
+
+void EventLoop::remove_fd(int fd) {
+    if (m_sources.erase(fd) > 0) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+int EventLoop::add_timer(std::chrono::nanoseconds interval,
+                         TimerCallback callback, bool repeat) {
+    const int timer_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Creation of timer fd failed");
+    }
+
+    if (!arm_timer(timer_fd, interval, repeat)) {
+        close(timer_fd);
+        throw std::system_error(errno, std::generic_category(),
+                                "Could not arm timer fd");
+    }
+
+    try {
+        add_fd(timer_fd, EPOLLIN,
+               [this, timer_fd, repeat,
+                callback = std::move(callback)](std::uint32_t /*unused*/) {
+                   std::uint64_t expirations = 0;
+                   if (::read(timer_fd, &expirations,
+                              sizeof(expirations)) < 0) {
+                       return;
+                   }
+                   if (!repeat) {
+                       // run_once() holds a reference to this closure, so
+                       // it outlives the removal of the timer.
+                       remove_timer(timer_fd);
+                   }
+                   callback();
+               });
+    } catch (const std::system_error&) {
+        close(timer_fd);
+        throw;
+    }
+    m_timers.emplace(timer_fd, repeat);
+
+    return timer_fd;
+}
+
+bool EventLoop::arm_timer(int timer_fd, std::chrono::nanoseconds interval,
+                          bool repeat) {
+    // A zero it_value disarms the timer, so round up to 1ns.
+    if (interval.count() <= 0) {
+        interval = std::chrono::nanoseconds(1);
+    }
+
+    const auto seconds =
+        std::chrono::duration_cast<std::chrono::seconds>(interval);
+    const timespec period = {.tv_sec = seconds.count(),
+                             .tv_nsec = (interval - seconds).count()};
+    const itimerspec spec = {.it_interval = repeat ? period : timespec{},
+                             .it_value = period};
+    return timerfd_settime(timer_fd, 0, &spec, nullptr) == 0;
+}
+
+void EventLoop::remove_timer(int timer_id) {
+    // Only close our own timers: a stale id may since have been reused
+    // for a descriptor that someone else watches.
+    if (m_timers.erase(timer_id) > 0) {
+        remove_fd(timer_id);
+        close(timer_id);
+    }
+}
+
+void EventLoop::rearm_timer(int timer_id,
+                            std::chrono::nanoseconds interval) {
+    const auto timer = m_timers.find(timer_id);
+    if (timer == m_timers.end()) {
+        return;
+    }
+    if (!arm_timer(timer_id, interval, timer->second)) {
+        throw std::system_error(errno, std::generic_category(),
+                                "Could not arm timer fd");
+    }
+}
+
+void EventLoop::disarm_timer(int timer_id) {
+    if (!m_timers.contains(timer_id)) {
+        return;
+    }
+    const itimerspec spec{};
+    if (timerfd_settime(timer_id, 0, &spec, nullptr) < 0) {
+        Logger::error << "Could not disarm timer fd " << timer_id << ".\n";
+    }
+}
+
+int EventLoop::get_fd() const { return m_epoll_fd; }
+
+int EventLoop::run_once(std::chrono::milliseconds timeout) {
+    static constexpr int MAX_EVENTS = 16;
+    std::array<epoll_event, MAX_EVENTS> events{};
+
+    const int nfds = epoll_wait(m_epoll_fd, events.data(), MAX_EVENTS,
+                                static_cast<int>(timeout.count()));
+    if (nfds < 0) {
+        if (errno != EINTR) {
+            Logger::error << "Error " << errno << " returned from epoll.\n";
+        }
+        return 0;
+    }
+
+    int dispatched = 0;
+    for (const auto& event : std::span(events).first(
+             static_cast<std::size_t>(nfds))) {
+        const int event_fd = event.data.fd;
+
+        if (event_fd == m_stop_fd) {
+            std::uint64_t count = 0;
+            static_cast<void>(::read(m_stop_fd, &count, sizeof(count)));
+            m_stop_requested = true;
+            continue;
+        }
+
+        // An earlier callback in this batch may have removed the source.
+        auto iter = m_sources.find(event_fd);
+        if (iter == m_sources.end()) {
+            continue;
+        }
+
+        // Hold a reference, in case the callback removes its own source.
+        const auto callback = iter->second;
+        (*callback)(event.events);
+        ++dispatched;
+    }
+
+    return dispatched;
+}
+
+void EventLoop::run() {
+    m_stop_requested = false;
+    while (!m_stop_requested) {
+        run_once(std::chrono::milliseconds(-1));
+    }
+}
+
+void EventLoop::stop() {
+    const std::uint64_t one = 1;
+    static_cast<void>(::write(m_stop_fd, &one, sizeof(one)));
+}
@@ -0,0 +1,89 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "event-handler.hpp"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+// Event loop built on epoll.  It has no dependency on Qt, so the core
+// can run headless by calling run().  A GUI can instead watch the single
+// descriptor returned by get_fd() and call run_once() with a zero timeout
+// whenever it becomes readable.
+class EventLoop {
+  public:
+    using FdCallback = std::function<void(std::uint32_t events)>;
+    using TimerCallback = std::function<void()>;
+
+    EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    ~EventLoop();
+
+    // Dispatch EventHandler::process_events() whenever the handler's
+    // event fd becomes readable.
+    void add_event_handler(EventHandler& event_handler);
+    void remove_event_handler(const EventHandler& event_handler);
+
+    // Watch an arbitrary file descriptor (transport socket, etc.).
+    // events is a mask of EPOLLIN, EPOLLOUT, ...
+    void add_fd(int fd, std::uint32_t events, FdCallback callback);
+    void modify_fd(int fd, std::uint32_t events);
+    void remove_fd(int fd);
+
+    // Returns a timer id that can be passed to remove_timer().  A timer
+    // that is not repeating is removed automatically after it fires.  An
+    // id that is not a live timer is ignored.
+    int add_timer(std::chrono::nanoseconds interval, TimerCallback callback,
+                  bool repeat = true);
+    void remove_timer(int timer_id);
+    // Restart a live timer, which next fires after interval and, if it
+    // is repeating, every interval after that.  Cheaper than removing
+    // the timer and adding a new one.
+    void rearm_timer(int timer_id, std::chrono::nanoseconds interval);
+    // Stop a live timer from firing until it is rearmed.
+    void disarm_timer(int timer_id);
+
+    // Readable whenever one of the registered sources is ready.
+    int get_fd() const;
+
+    // Wait up to timeout for events and dispatch them.  Returns the
+    // number of sources dispatched.
+    int run_once(std::chrono::milliseconds timeout);
+
+    // Dispatch events until stop() is called.
+    void run();
+
+    // May be called from any thread.
+    void stop();
+
+  private:
+    int m_epoll_fd = -1;
+    int m_stop_fd = -1;
+    bool m_stop_requested = false;
+    std::unordered_map<int, std::shared_ptr<FdCallback>> m_sources;
+    // Timer fds, which the loop owns and closes, and whether each one
+    // repeats.
+    std::unordered_map<int, bool> m_timers;
+
+    void watch(int fd, std::uint32_t events);
+    static bool arm_timer(int timer_fd, std::chrono::nanoseconds interval,
+                          bool repeat);
+};
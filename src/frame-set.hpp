@@ -0,0 +1,154 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Array of trivially copyable values, stored inline while there are at
+// most N of them.  Larger contents move to a heap buffer, which is kept
+// when the array is cleared, so an array that is reused stops allocating
+// once it has held its largest contents.
+template <typename T, std::size_t N> class SmallBuffer {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+  public:
+    T* data() { return m_on_heap ? m_heap.data() : m_inline.data(); }
+    const T* data() const {
+        return m_on_heap ? m_heap.data() : m_inline.data();
+    }
+    T* begin() { return data(); }
+    T* end() { return data() + m_size; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + m_size; }
+    T& operator[](std::size_t index) { return data()[index]; }
+    const T& operator[](std::size_t index) const { return data()[index]; }
+
+    [[nodiscard]] std::size_t size() const { return m_size; }
+    [[nodiscard]] bool empty() const { return m_size == 0; }
+
+    void clear() {
+        m_size = 0;
+        m_on_heap = false;
+    }
+
+    void resize(std::size_t size) {
+        if (size > N && !m_on_heap) {
+            if (m_heap.size() < size) {
+                m_heap.resize(std::max(size, 2 * N));
+            }
+            std::copy_n(m_inline.begin(), m_size, m_heap.begin());
+            m_on_heap = true;
+        } else if (m_on_heap && m_heap.size() < size) {
+            m_heap.resize(std::max(size, 2 * m_heap.size()));
+        }
+        m_size = size;
+    }
+
+    void push_back(const T& value) {
+        resize(m_size + 1);
+        data()[m_size - 1] = value;
+    }
+
+    void assign(std::span<const T> values) {
+        clear();
+        resize(values.size());
+        std::ranges::copy(values, data());
+    }
+
+  private:
+    std::array<T, N> m_inline{};
+    std::vector<T> m_heap;
+    std::size_t m_size = 0;
+    bool m_on_heap = false;
+};
+
+// Responses to one command, one frame per ECU, kept in a flat buffer.
+// Up to INLINE_FRAMES frames totalling INLINE_BYTES are stored without
+// allocating.
+class FrameSet {
+  public:
+    static constexpr std::size_t INLINE_FRAMES = 3;
+    static constexpr std::size_t INLINE_BYTES = 64;
+
+    struct Frame {
+        unsigned int header;
+        std::span<const unsigned char> data;
+    };
+
+    void clear() {
+        m_bytes.clear();
+        m_entries.clear();
+        m_frames.clear();
+    }
+
+    // Data for a header that is already in the set is appended to its
+    // frame.
+    void append(unsigned int header, std::span<const unsigned char> data) {
+        const auto offset = m_bytes.size();
+        m_bytes.resize(offset + data.size());
+        std::ranges::copy(data, m_bytes.begin() + offset);
+
+        const auto entry = std::ranges::find(m_entries, header, &Entry::header);
+        if (entry == m_entries.end()) {
+            m_entries.push_back({header, offset, data.size()});
+            return;
+        }
+
+        // Move the new bytes to the end of the header's frame.
+        const auto frame_end = entry->offset + entry->size;
+        std::rotate(m_bytes.begin() + frame_end, m_bytes.begin() + offset,
+                    m_bytes.end());
+        entry->size += data.size();
+        for (auto& later : m_entries) {
+            if (later.offset >= frame_end && &later != entry) {
+                later.offset += data.size();
+            }
+        }
+    }
+
+    // Frames in the order the ECUs first responded.  Valid until the set
+    // is changed or moved.
+    std::span<const Frame> frames() {
+        m_frames.resize(m_entries.size());
+        for (std::size_t i = 0; i < m_entries.size(); ++i) {
+            const auto& entry = m_entries[i];
+            m_frames[i] = {entry.header, std::span<const unsigned char>(
+                                             m_bytes.begin() + entry.offset,
+                                             entry.size)};
+        }
+        return {m_frames.begin(), m_frames.size()};
+    }
+
+    [[nodiscard]] std::size_t size() const { return m_entries.size(); }
+    [[nodiscard]] bool empty() const { return m_entries.empty(); }
+
+  private:
+    struct Entry {
+        unsigned int header;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    SmallBuffer<unsigned char, INLINE_BYTES> m_bytes;
+    SmallBuffer<Entry, INLINE_FRAMES> m_entries;
+    SmallBuffer<Frame, INLINE_FRAMES> m_frames;
+};
@@ -0,0 +1,315 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hex-decode.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// The SIMD kernels convert a block of characters at a time.  Each
+// character is mapped to its nibble value as either a digit (c - '0')
+// or a letter ((c | 0x20) - 'a' + 10), and the block is rejected unless
+// every character matched one of the two.  Adjacent nibbles are then
+// combined into a byte as 16 bit lanes: (low_byte << 4) | high_byte.
+// The kernels only convert whole blocks.  The scalar code converts
+// whatever is left over.
+
+namespace {
+constexpr int NOT_HEX = -1;
+constexpr unsigned int BITS_PER_NIBBLE = 4;
+
+constexpr std::array<int, 256> HEX_VALUES = []() {
+    std::array<int, 256> table{};
+    table.fill(NOT_HEX);
+    for (int i = 0; i < 10; ++i) {
+        table.at(static_cast<std::size_t>('0' + i)) = i;
+    }
+    constexpr int HEX_LETTER_BASE = 10;
+    for (int i = 0; i < 6; ++i) {
+        table.at(static_cast<std::size_t>('A' + i)) = HEX_LETTER_BASE + i;
+        table.at(static_cast<std::size_t>('a' + i)) = HEX_LETTER_BASE + i;
+    }
+    return table;
+}();
+
+// Convert digits from position start to the end.  Returns false if a
+// non-hex character is found.
+bool decode_scalar(std::string_view digits, std::span<unsigned char> out,
+                   std::size_t start) {
+    for (std::size_t i = start; i + 1 < digits.size(); i += 2) {
+        const int high = HEX_VALUES.at(static_cast<unsigned char>(digits[i]));
+        const int low =
+            HEX_VALUES.at(static_cast<unsigned char>(digits[i + 1]));
+        if ((high | low) < 0) {
+            return false;
+        }
+        out[i / 2] = static_cast<unsigned char>(
+            (static_cast<unsigned int>(high) << BITS_PER_NIBBLE) |
+            static_cast<unsigned int>(low));
+    }
+    return true;
+}
+
+// Number of characters converted by the SIMD kernel.  Sets valid to
+// false on a non-hex character.
+using BlockFunction = std::size_t (*)(std::string_view digits,
+                                      std::span<unsigned char> out,
+                                      bool& valid);
+
+std::size_t decode_blocks_scalar(std::string_view /*unused*/,
+                                 std::span<unsigned char> /*unused*/,
+                                 bool& /*unused*/) {
+    return 0;
+}
+
+// NOLINTBEGIN(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic,portability-simd-intrinsics)
+#if defined(__x86_64__)
+constexpr std::size_t SSE2_BLOCK = 16;
+constexpr std::size_t AVX2_BLOCK = 32;
+
+std::size_t decode_blocks_sse2(std::string_view digits,
+                               std::span<unsigned char> out, bool& valid) {
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i lower_a = _mm_set1_epi8('a');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i six = _mm_set1_epi8(6);
+    const __m128i minus_one = _mm_set1_epi8(-1);
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+
+    std::size_t pos = 0;
+    for (; pos + SSE2_BLOCK <= digits.size(); pos += SSE2_BLOCK) {
+        const __m128i chars = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(digits.data() + pos));
+
+        const __m128i digit = _mm_sub_epi8(chars, zero_char);
+        const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, minus_one),
+                                               _mm_cmplt_epi8(digit, ten));
+
+        const __m128i letter =
+            _mm_sub_epi8(_mm_or_si128(chars, case_bit), lower_a);
+        const __m128i is_letter = _mm_and_si128(
+            _mm_cmpgt_epi8(letter, minus_one), _mm_cmplt_epi8(letter, six));
+
+        if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF) {
+            valid = false;
+            return pos;
+        }
+
+        const __m128i nibbles =
+            _mm_or_si128(_mm_and_si128(is_digit, digit),
+                         _mm_and_si128(is_letter, _mm_add_epi8(letter, ten)));
+
+        const __m128i bytes = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(nibbles, low_byte), BITS_PER_NIBBLE),
+            _mm_srli_epi16(nibbles, 8));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out.data() + pos / 2),
+                         _mm_packus_epi16(bytes, bytes));
+    }
+    return pos;
+}
+
+__attribute__((target("avx2"))) std::size_t
+decode_blocks_avx2(std::string_view digits, std::span<unsigned char> out,
+                   bool& valid) {
+    const __m256i zero_char = _mm256_set1_epi8('0');
+    const __m256i lower_a = _mm256_set1_epi8('a');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i ten = _mm256_set1_epi8(10);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i five = _mm256_set1_epi8(5);
+    const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+
+    std::size_t pos = 0;
+    for (; pos + AVX2_BLOCK <= digits.size(); pos += AVX2_BLOCK) {
+        const __m256i chars = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(digits.data() + pos));
+
+        // x <= n (unsigned) is min(x, n) == x
+        const __m256i digit = _mm256_sub_epi8(chars, zero_char);
+        const __m256i is_digit =
+            _mm256_cmpeq_epi8(_mm256_min_epu8(digit, nine), digit);
+
+        const __m256i letter =
+            _mm256_sub_epi8(_mm256_or_si256(chars, case_bit), lower_a);
+        const __m256i is_letter =
+            _mm256_cmpeq_epi8(_mm256_min_epu8(letter, five), letter);
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_letter)) !=
+            -1) {
+            valid = false;
+            return pos;
+        }
+
+        const __m256i nibbles = _mm256_blendv_epi8(
+            _mm256_add_epi8(letter, ten), digit, is_digit);
+
+        const __m256i bytes = _mm256_or_si256(
+            _mm256_slli_epi16(_mm256_and_si256(nibbles, low_byte),
+                              BITS_PER_NIBBLE),
+            _mm256_srli_epi16(nibbles, 8));
+
+        // packus works on each 128 bit lane, so gather the low
+        // 64 bits of both lanes.
+        const __m256i packed = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(bytes, bytes), 0xD8);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + pos / 2),
+                         _mm256_castsi256_si128(packed));
+    }
+    return pos;
+}
+#elif defined(__aarch64__)
+constexpr std::size_t NEON_BLOCK = 16;
+
+std::size_t decode_blocks_neon(std::string_view digits,
+                               std::span<unsigned char> out, bool& valid) {
+    const uint8x16_t zero_char = vdupq_n_u8('0');
+    const uint8x16_t lower_a = vdupq_n_u8('a');
+    const uint8x16_t case_bit = vdupq_n_u8(0x20);
+    const uint8x16_t ten = vdupq_n_u8(10);
+    const uint8x16_t six = vdupq_n_u8(6);
+    const uint16x8_t low_byte = vdupq_n_u16(0x00FF);
+
+    std::size_t pos = 0;
+    for (; pos + NEON_BLOCK <= digits.size(); pos += NEON_BLOCK) {
+        const uint8x16_t chars =
+            vld1q_u8(reinterpret_cast<const uint8_t*>(digits.data() + pos));
+
+        const uint8x16_t digit = vsubq_u8(chars, zero_char);
+        const uint8x16_t is_digit = vcltq_u8(digit, ten);
+
+        const uint8x16_t letter =
+            vsubq_u8(vorrq_u8(chars, case_bit), lower_a);
+        const uint8x16_t is_letter = vcltq_u8(letter, six);
+
+        if (vminvq_u8(vorrq_u8(is_digit, is_letter)) != 0xFF) {
+            valid = false;
+            return pos;
+        }
+
+        const uint16x8_t nibbles = vreinterpretq_u16_u8(
+            vbslq_u8(is_digit, digit, vaddq_u8(letter, ten)));
+
+        const uint16x8_t bytes =
+            vorrq_u16(vshlq_n_u16(vandq_u16(nibbles, low_byte), 4),
+                      vshrq_n_u16(nibbles, 8));
+
+        vst1_u8(out.data() + pos / 2, vmovn_u16(bytes));
+    }
+    return pos;
+}
+#endif
+// NOLINTEND(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic,portability-simd-intrinsics)
+
+HexDecode::Kernel best_kernel() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") != 0) {
+        return HexDecode::AVX2;
+    }
+    return HexDecode::SSE2;
+#elif defined(__aarch64__)
+    return HexDecode::NEON;
+#else
+    return HexDecode::SCALAR;
+#endif
+}
+
+BlockFunction block_function(HexDecode::Kernel kernel) {
+    switch (kernel) {
+#if defined(__x86_64__)
+    case HexDecode::SSE2:
+        return decode_blocks_sse2;
+    case HexDecode::AVX2:
+        return decode_blocks_avx2;
+#elif defined(__aarch64__)
+    case HexDecode::NEON:
+        return decode_blocks_neon;
+#endif
+    default:
+        return decode_blocks_scalar;
+    }
+}
+
+// Selected once at startup.  Only changed by set_kernel().
+// NOLINTBEGIN(cppcoreguidelines-avoid-non-const-global-variables)
+HexDecode::Kernel selected_kernel = best_kernel();
+BlockFunction decode_blocks = block_function(selected_kernel);
+// NOLINTEND(cppcoreguidelines-avoid-non-const-global-variables)
+} // namespace
+
+std::size_t HexDecode::remove_spaces(std::string_view line,
+                                     std::span<char> out) {
+    // Branch free; a space is written, but then overwritten by the
+    // next character.
+    std::size_t count = 0;
+    for (const char character : line) {
+        out[count] = character;
+        count += static_cast<std::size_t>(character != ' ');
+    }
+    return count;
+}
+
+bool HexDecode::decode(std::string_view digits, std::span<unsigned char> out) {
+    if (digits.size() % 2 != 0) {
+        return false;
+    }
+    bool valid = true;
+    const std::size_t converted = decode_blocks(digits, out, valid);
+    return valid && decode_scalar(digits, out, converted);
+}
+
+int HexDecode::digit_value(char digit) {
+    return HEX_VALUES.at(static_cast<unsigned char>(digit));
+}
+
+HexDecode::Kernel HexDecode::get_kernel() { return selected_kernel; }
+
+bool HexDecode::set_kernel(Kernel kernel) {
+    const auto kernels = get_available_kernels();
+    if (std::ranges::find(kernels, kernel) == kernels.end()) {
+        return false;
+    }
+    selected_kernel = kernel;
+    decode_blocks = block_function(kernel);
+    return true;
+}
+
+std::vector<HexDecode::Kernel> HexDecode::get_available_kernels() {
+    std::vector<Kernel> kernels = {SCALAR};
+#if defined(__x86_64__)
+    kernels.push_back(SSE2);
+    if (best_kernel() == AVX2) {
+        kernels.push_back(AVX2);
+    }
+#elif defined(__aarch64__)
+    kernels.push_back(NEON);
+#endif
+    return kernels;
+}
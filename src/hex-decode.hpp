@@ -0,0 +1,50 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Conversion of ASCII hex, as sent by the adapter, to binary.  The
+// conversion kernel is chosen at runtime from the best instruction set
+// supported by the CPU (AVX2 or SSE2 on x86-64, NEON on ARM64), with a
+// scalar fallback.
+namespace HexDecode {
+enum Kernel { SCALAR, SSE2, AVX2, NEON };
+
+// Copy line to out, without spaces.  out must be at least as large as
+// line.  Returns the number of characters copied.
+std::size_t remove_spaces(std::string_view line, std::span<char> out);
+
+// Convert pairs of hex digits to bytes.  out must hold at least
+// digits.size() / 2 bytes, and digits.size() must be even.  Returns
+// false if digits contains anything other than hex digits.
+bool decode(std::string_view digits, std::span<unsigned char> out);
+
+// Value of a single hex digit, or -1 if it isn't one.
+int digit_value(char digit);
+
+Kernel get_kernel();
+
+// Returns false if the kernel isn't supported on this CPU.
+bool set_kernel(Kernel kernel);
+
+std::vector<Kernel> get_available_kernels();
+} // namespace HexDecode
@@ -0,0 +1,126 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Log-linear (HDR style) histogram of durations.  Each power of two range
+// is split into SUB_BUCKETS linear buckets, so every recorded value is
+// kept with a relative error of about 3%, from 1ns up to MAX_VALUE.
+// Recording is a couple of shifts and an increment, with no allocation.
+class LatencyHistogram {
+  public:
+    using Duration = std::chrono::nanoseconds;
+
+    void record(Duration value) {
+        const auto ns = static_cast<std::uint64_t>(
+            std::clamp<Duration::rep>(value.count(), 0, MAX_VALUE));
+        ++m_counts.at(bucket_index(ns));
+        ++m_count;
+        m_sum += ns;
+        m_min = std::min(m_min, ns);
+        m_max = std::max(m_max, ns);
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            m_counts.at(i) += other.m_counts.at(i);
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    [[nodiscard]] std::uint64_t count() const { return m_count; }
+
+    [[nodiscard]] Duration min() const {
+        return Duration(m_count == 0 ? 0 : static_cast<Duration::rep>(m_min));
+    }
+
+    [[nodiscard]] Duration max() const {
+        return Duration(static_cast<Duration::rep>(m_max));
+    }
+
+    [[nodiscard]] Duration mean() const {
+        return Duration(m_count == 0
+                            ? 0
+                            : static_cast<Duration::rep>(m_sum / m_count));
+    }
+
+    // percentile is in the range 0 - 100.
+    [[nodiscard]] Duration percentile(double percentile) const {
+        if (m_count == 0) {
+            return Duration(0);
+        }
+
+        const auto target = static_cast<std::uint64_t>(
+            std::clamp(percentile, 0.0, 100.0) / 100.0 *
+            static_cast<double>(m_count));
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += m_counts.at(i);
+            if (seen > target || seen == m_count) {
+                // Report the highest value that falls into the bucket.
+                const auto upper = bucket_value(i + 1) - 1;
+                return Duration(
+                    static_cast<Duration::rep>(std::min(upper, m_max)));
+            }
+        }
+        return max();
+    }
+
+  private:
+    static constexpr unsigned int SUB_BUCKET_BITS = 6;
+    static constexpr std::uint64_t SUB_BUCKETS = 1U << (SUB_BUCKET_BITS - 1);
+    static constexpr unsigned int MAX_VALUE_BITS = 40; // About 18 minutes
+    static constexpr Duration::rep MAX_VALUE = (1LL << MAX_VALUE_BITS) - 1;
+    static constexpr std::size_t BUCKET_COUNT =
+        (MAX_VALUE_BITS - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    static constexpr std::size_t bucket_index(std::uint64_t value) {
+        if (value < (1U << SUB_BUCKET_BITS)) {
+            return value;
+        }
+        const auto shift = static_cast<unsigned int>(std::bit_width(value)) -
+                           SUB_BUCKET_BITS;
+        return shift * SUB_BUCKETS + (value >> shift);
+    }
+
+    static constexpr std::uint64_t bucket_value(std::size_t index) {
+        if (index < (1U << SUB_BUCKET_BITS)) {
+            return index;
+        }
+        const auto shift = index / SUB_BUCKETS - 1;
+        return (index - shift * SUB_BUCKETS) << shift;
+    }
+
+    std::array<std::uint32_t, BUCKET_COUNT> m_counts{};
+    std::uint64_t m_count = 0;
+    std::uint64_t m_sum = 0;
+    std::uint64_t m_min = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t m_max = 0;
+};
@@ -17,7 +17,7 @@
 
 #include "mainwindow.hpp"
 #include "bluetooth-serial-port.hpp"
-#include "event-handler.hpp"
+#include "event-loop.hpp"
 #include "hardware-interface.hpp"
 #include "home.hpp"
 #include "logger.hpp"
@@ -32,9 +32,9 @@
 #include <QSocketNotifier>
 #include <QString>
 #include <QVBoxLayout>
+#include <chrono>
 #include <climits>
 #include <memory>
-#include <utility>
 
 MainWindow::MainWindow()
     : m_ui{}, m_window_layout(this), m_view_stack(this), m_home(this),
@@ -45,8 +45,14 @@ MainWindow::MainWindow()
     m_settings.init();
     m_terminal.init();
 
-    add_event_handler(m_bluetooth_serial_port);
-    add_event_handler(m_serial_port);
+    m_event_loop.add_event_handler(m_bluetooth_serial_port);
+    m_event_loop.add_event_handler(m_serial_port);
+
+    // The whole event loop is embedded in Qt through the epoll fd.
+    m_event_notifier = std::make_unique<QSocketNotifier>(
+        m_event_loop.get_fd(), QSocketNotifier::Read, this);
+    connect(m_event_notifier.get(), &QSocketNotifier::activated, this,
+            &MainWindow::process_events);
 
     m_window_layout.addWidget(&m_view_stack);
 
@@ -66,21 +72,6 @@ void MainWindow::set_hardware_interface(InterfaceType if_type) {
     }
 }
 
-void MainWindow::add_event_handler(EventHandler& event_handler) {
-    const int event_fd = event_handler.get_event_fd();
-    auto [iter, is_added] = m_event_handlers.emplace(event_fd, &event_handler);
-
-    if (!is_added) {
-        Logger::error << "Could not attach event handler to event loop.\n";
-    } else {
-        auto notifier = std::make_unique<QSocketNotifier>(
-            event_fd, QSocketNotifier::Read, this);
-        connect(notifier.get(), &QSocketNotifier::activated, this,
-                &MainWindow::process_events);
-        m_socket_notifiers.push_back(std::move(notifier));
-    }
-}
-
 int MainWindow::user_get_int(const QString& prompt, bool& ok_clicked) {
     return QInputDialog::getInt(nullptr, "", prompt, 0, INT_MIN, INT_MAX, 1,
                                 &ok_clicked);
@@ -109,8 +100,10 @@ HardwareInterface* MainWindow::get_hardware_interface() {
     return m_hardware_interface;
 }
 
-void MainWindow::process_events(QSocketDescriptor sock_fd,
+EventLoop& MainWindow::get_event_loop() { return m_event_loop; }
+
+void MainWindow::process_events(QSocketDescriptor /*unused*/,
                                 QSocketNotifier::Type /*unused*/) {
 
-    m_event_handlers.at(sock_fd)->process_events();
+    m_event_loop.run_once(std::chrono::milliseconds(0));
 }
@@ -19,6 +19,7 @@
 
 #include "bluetooth-serial-port.hpp"
 #include "event-handler.hpp"
+#include "event-loop.hpp"
 #include "hardware-interface.hpp"
 #include "home.hpp"
 #include "neonobd_types.hpp"
@@ -29,8 +30,7 @@
 #include <QSocketNotifier>
 #include <QVBoxLayout>
 #include <QWidget>
-#include <unordered_map>
-#include <vector>
+#include <memory>
 
 using neon::InterfaceType;
 
@@ -49,13 +49,14 @@ class MainWindow : public QWidget {
     BluetoothSerialPort& get_bt_serial_port();
     SerialPort& get_serial_port();
     HardwareInterface* get_hardware_interface();
+    EventLoop& get_event_loop();
 
   private:
     Ui::ViewStack m_ui;
     BluetoothSerialPort m_bluetooth_serial_port;
     SerialPort m_serial_port;
-    std::vector<std::unique_ptr<QSocketNotifier>> m_socket_notifiers;
-    std::unordered_map<int, EventHandler*> m_event_handlers;
+    EventLoop m_event_loop;
+    std::unique_ptr<QSocketNotifier> m_event_notifier;
     HardwareInterface* m_hardware_interface = nullptr;
     QVBoxLayout m_window_layout;
     QStackedWidget m_view_stack;
@@ -66,6 +67,5 @@ class MainWindow : public QWidget {
     Terminal m_terminal;
 
   private:
-    void add_event_handler(EventHandler& event_handler);
     void process_events(QSocketDescriptor sock_fd, QSocketNotifier::Type);
 };
@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <variant>
 
@@ -26,4 +27,36 @@ enum InterfaceType { BLUETOOTH_IF = 0, SERIAL_IF = 1 };
 enum ResponseType { USER_YN, USER_STRING, USER_INT, USER_NONE };
 using ResponseVariant = std::variant<std::monostate, bool, std::string, int>;
 
+// Result of a command sent to an OBD device.  CMD_EXPIRED means the
+// command's deadline passed before it could be sent.  CMD_TIMEOUT means
+// the device did not finish the command in time.  The statuses after it
+// are errors reported by the device; CMD_ERROR is any other error.
+enum CommandStatus {
+    CMD_OK,
+    CMD_NO_DATA,
+    CMD_ERROR,
+    CMD_EXPIRED,
+    CMD_CANCELLED,
+    CMD_TIMEOUT,
+    // Another node kept the bus busy.
+    CMD_BUS_BUSY,
+    // Bus wiring or signalling fault, e.g. CAN ERROR or BUS INIT failure.
+    CMD_BUS_ERROR,
+    // A response was received corrupted, e.g. <RX ERROR or a bad checksum.
+    CMD_RX_ERROR,
+    // The device's receive buffer overflowed.
+    CMD_BUFFER_FULL,
+    // The command was interrupted, e.g. by a character from the host.
+    CMD_STOPPED,
+    // The device did not understand the command.
+    CMD_REJECTED,
+    // No protocol could be established with the vehicle.
+    CMD_UNABLE_TO_CONNECT
+};
+
+constexpr std::size_t COMMAND_STATUS_COUNT = CMD_UNABLE_TO_CONNECT + 1;
+
+// Commands of a higher priority are always sent first.
+enum CommandPriority { PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_LOW };
+
 }; // namespace neon
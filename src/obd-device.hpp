@@ -18,12 +18,41 @@
 #pragma once
 
 #include "event-handler.hpp"
+#include "frame-set.hpp"
 #include "hardware-interface.hpp"
+#include "neonobd_types.hpp"
+#include "profile-store.hpp"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
 #include <functional>
-#include <optional>
+#include <memory>
+#include <span>
 #include <string>
-#include <unistd.h>
-#include <vector>
+#include <utility>
+
+using neon::CommandPriority;
+using neon::CommandStatus;
+
+// Returned by ObdDevice::send_command().  Once cancel() is called, the
+// command's callback gets CMD_CANCELLED instead of a result, and frame
+// callbacks stop.  A command that has not been sent yet is not sent.
+// May be called from any thread.
+class CommandHandle {
+  public:
+    CommandHandle() = default;
+    explicit CommandHandle(std::shared_ptr<std::atomic<bool>> cancelled)
+        : m_cancelled{std::move(cancelled)} {}
+
+    void cancel() {
+        if (m_cancelled) {
+            *m_cancelled = true;
+        }
+    }
+
+  private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+};
 
 class ObdDevice : public EventHandler {
   public:
@@ -37,16 +66,147 @@ class ObdDevice : public EventHandler {
 
     virtual std::string get_error_string() const = 0;
 
-    using CommandCallback = std::function<void(
-        const std::unordered_map<unsigned int, std::vector<unsigned char>>&)>;
+    // Response data from each ECU, in the order the ECUs responded.  Only
+    // valid during the callback.
+    using CommandResult = std::span<const FrameSet::Frame>;
+
+    // Called once all ECUs have responded to a command.
+    using CommandCallback = std::function<void(CommandStatus, CommandResult)>;
+
+    // Called as soon as each ECU's response arrives.
+    using FrameCallback = std::function<void(
+        unsigned int header, std::span<const unsigned char> data)>;
+
+    struct CommandOptions {
+        FrameCallback frame_callback = nullptr;
+        CommandPriority priority = neon::PRIORITY_NORMAL;
+        // Latest time the command may be sent.  Within a priority, the
+        // command with the earliest deadline goes first.  If the deadline
+        // passes first, the callback gets CMD_EXPIRED.
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::time_point::max();
+        // Time allowed for the device to answer once the command is sent.
+        // Zero uses the device's default.
+        std::chrono::milliseconds timeout{0};
+    };
 
-    virtual void send_command(unsigned char obd_module,
-                              unsigned char obd_service,
-                              const std::vector<unsigned char>& obd_data,
-                              CommandCallback callback) = 0;
+    virtual CommandHandle send_command(
+        unsigned int obd_address, unsigned char obd_service,
+        std::span<const unsigned char> obd_data, CommandCallback callback,
+        CommandOptions options) = 0;
+
+    // Answer to a command awaited with command().  The frames are only
+    // valid until the awaiting coroutine next awaits.
+    struct CommandReply {
+        CommandStatus status;
+        CommandResult result;
+    };
+
+    // Sends the command when awaited, and resumes the coroutine from the
+    // command's callback.  The awaiter lives in the coroutine's frame.
+    // The callback reaches it through a shared pointer that the awaiter
+    // clears when it is destroyed, so a task destroyed while it awaits
+    // cancels the command and its answer is dropped.  An answer given
+    // before the coroutine suspends is copied to m_awaited_frames, which
+    // only the next such answer replaces.
+    class CommandAwaiter {
+      public:
+        CommandAwaiter(ObdDevice& device, unsigned int obd_address,
+                       unsigned char obd_service,
+                       std::span<const unsigned char> obd_data,
+                       CommandOptions options)
+            : m_device{device}, m_address{obd_address},
+              m_service{obd_service}, m_data{obd_data},
+              m_options{std::move(options)} {}
+        CommandAwaiter(const CommandAwaiter&) = delete;
+        CommandAwaiter& operator=(const CommandAwaiter&) = delete;
+        ~CommandAwaiter() {
+            if (m_self) {
+                *m_self = nullptr;
+                m_command.cancel();
+            }
+        }
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            m_handle = handle;
+            m_self = std::make_shared<CommandAwaiter*>(this);
+            m_command = m_device.send_command(
+                m_address, m_service, m_data,
+                [self = m_self](CommandStatus status, CommandResult result) {
+                    if (*self != nullptr) {
+                        (*self)->complete(status, result);
+                    }
+                },
+                std::move(m_options));
+            // The device may have answered at once.
+            m_suspended = !m_done;
+            return m_suspended;
+        }
+        [[nodiscard]] CommandReply await_resume() const {
+            return {m_status, m_result};
+        }
+
+      private:
+        ObdDevice& m_device;
+        unsigned int m_address;
+        unsigned char m_service;
+        std::span<const unsigned char> m_data;
+        CommandOptions m_options;
+        std::coroutine_handle<> m_handle;
+        // Cleared when the awaiter is destroyed.
+        std::shared_ptr<CommandAwaiter*> m_self;
+        CommandHandle m_command;
+        bool m_suspended = false;
+        bool m_done = false;
+        CommandStatus m_status = neon::CMD_OK;
+        CommandResult m_result;
+
+        void complete(CommandStatus status, CommandResult result) {
+            m_done = true;
+            m_status = status;
+            if (m_suspended) {
+                m_result = result;
+                m_handle.resume();
+                return;
+            }
+            auto& frames = m_device.m_awaited_frames;
+            frames.clear();
+            for (const auto& frame : result) {
+                frames.append(frame.header, frame.data);
+            }
+            m_result = frames.frames();
+        }
+    };
+
+    // Send a command from a coroutine (see Task):
+    //     auto [status, result] = co_await device.command(...);
+    CommandAwaiter command(unsigned int obd_address,
+                           unsigned char obd_service,
+                           std::span<const unsigned char> obd_data,
+                           CommandOptions options) {
+        return {*this, obd_address, obd_service, obd_data,
+                std::move(options)};
+    }
+    CommandAwaiter command(unsigned int obd_address,
+                           unsigned char obd_service,
+                           std::span<const unsigned char> obd_data) {
+        return command(obd_address, obd_service, obd_data, {});
+    }
 
     virtual bool is_connecting() const = 0;
     virtual bool is_connected() const = 0;
     virtual bool is_CAN() const = 0;
-    virtual disconnect(std::function<void()> callback) = 0;
+    virtual void disconnect(std::function<void()> callback) = 0;
+
+    // Use what was learned about the adapter and vehicle on an earlier
+    // connection.  Called before init().
+    virtual void apply_profile(const VehicleProfile& /*profile*/) {}
+
+    // Record what was learned on this connection in profile.  Called
+    // once disconnect completes.
+    virtual void update_profile(VehicleProfile& /*profile*/) const {}
+
+  private:
+    FrameSet m_awaited_frames;
 };
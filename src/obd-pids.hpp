@@ -0,0 +1,664 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string_view>
+
+// Service $01/$02 PIDs (SAE J1979), and how to decode them.
+//
+// Each PID's data is made of fields.  A field is an integer taken from
+// a run of bits, big-endian, counting from the most significant bit of
+// the first data byte, and its value is integer * scale + offset.  Bit
+// maps, such as the supported PID maps and monitor status, are fields
+// with a scale of 1 and no unit.  Adding a PID is one row in PID_TABLE.
+
+enum class PidUnit : unsigned char {
+    NONE,
+    PERCENT,
+    CELSIUS,
+    KPA,
+    PA,
+    RPM,
+    KM_PER_HOUR,
+    DEGREES,
+    GRAMS_PER_SECOND,
+    VOLTS,
+    MILLIAMPS,
+    SECONDS,
+    MINUTES,
+    KILOMETERS,
+    RATIO,
+    LITERS_PER_HOUR,
+    NEWTON_METERS,
+    PPM,
+    MG_PER_CUBIC_METER,
+    KG_PER_HOUR,
+    MG_PER_STROKE,
+};
+
+struct PidField {
+    unsigned char bit_offset = 0;
+    unsigned char bit_length = 0;
+    // Top bit of a two's complement field, otherwise zero.
+    std::uint64_t sign_bit = 0;
+    double scale = 1;
+    double offset = 0;
+    PidUnit unit = PidUnit::NONE;
+    // Smallest and largest values the field can hold.
+    double min = 0;
+    double max = 0;
+};
+
+constexpr std::size_t MAX_PID_FIELDS = 11;
+
+// How long an answer may be reused for.  PID_TTL_CONSTANT answers are
+// kept until the cache is invalidated.
+constexpr std::chrono::milliseconds PID_TTL_CONSTANT =
+    std::chrono::milliseconds::max();
+constexpr std::chrono::milliseconds PID_TTL_SLOW = std::chrono::seconds(10);
+
+struct PidDefinition {
+    unsigned char pid = 0;
+    // Number of data bytes.
+    unsigned char size = 0;
+    std::string_view name;
+    std::array<PidField, MAX_PID_FIELDS> fields{};
+    std::size_t field_count = 0;
+    // Zero if answers are not to be reused.
+    std::chrono::milliseconds ttl{0};
+};
+
+namespace pid_table {
+constexpr unsigned int BITS_PER_BYTE = 8;
+
+constexpr PidField field(unsigned int bit_offset, unsigned int bit_length,
+                         double scale, double offset, PidUnit unit,
+                         bool is_signed = false) {
+    PidField result;
+    result.bit_offset = static_cast<unsigned char>(bit_offset);
+    result.bit_length = static_cast<unsigned char>(bit_length);
+    result.scale = scale;
+    result.offset = offset;
+    result.unit = unit;
+
+    const auto top = static_cast<double>(std::uint64_t{1} << bit_length) - 1;
+    if (is_signed) {
+        result.sign_bit = std::uint64_t{1} << (bit_length - 1);
+        const auto half = static_cast<double>(result.sign_bit);
+        result.min = -half * scale + offset;
+        result.max = (half - 1) * scale + offset;
+    } else {
+        result.min = offset;
+        result.max = top * scale + offset;
+    }
+    return result;
+}
+
+// Fields of one, two or four whole bytes, starting at data byte `byte`.
+constexpr PidField u8(unsigned int byte, double scale, double offset,
+                      PidUnit unit) {
+    return field(byte * BITS_PER_BYTE, BITS_PER_BYTE, scale, offset, unit);
+}
+constexpr PidField u16(unsigned int byte, double scale, double offset,
+                       PidUnit unit) {
+    return field(byte * BITS_PER_BYTE, 2 * BITS_PER_BYTE, scale, offset, unit);
+}
+constexpr PidField s16(unsigned int byte, double scale, double offset,
+                       PidUnit unit) {
+    return field(byte * BITS_PER_BYTE, 2 * BITS_PER_BYTE, scale, offset, unit,
+                 true);
+}
+constexpr PidField u32(unsigned int byte, double scale, double offset,
+                       PidUnit unit) {
+    return field(byte * BITS_PER_BYTE, 4 * BITS_PER_BYTE, scale, offset, unit);
+}
+// Bit map or enumeration.
+constexpr PidField bits(unsigned int bit_offset, unsigned int bit_length) {
+    return field(bit_offset, bit_length, 1, 0, PidUnit::NONE);
+}
+
+// Common scalings.
+constexpr PidField percent(unsigned int byte) {
+    return u8(byte, 100.0 / 255, 0, PidUnit::PERCENT);
+}
+// Fuel trims and other -100% to 99.2% values.
+constexpr PidField trim(unsigned int byte) {
+    return u8(byte, 100.0 / 128, -100, PidUnit::PERCENT);
+}
+constexpr PidField temperature(unsigned int byte) {
+    return u8(byte, 1, -40, PidUnit::CELSIUS);
+}
+// Exhaust and catalyst temperatures.
+constexpr PidField hot_temperature(unsigned int byte) {
+    return u16(byte, 0.1, -40, PidUnit::CELSIUS);
+}
+constexpr PidField torque(unsigned int byte) {
+    return u8(byte, 1, -125, PidUnit::PERCENT);
+}
+constexpr PidField supported(unsigned int byte) {
+    return bits(byte * BITS_PER_BYTE, BITS_PER_BYTE);
+}
+
+constexpr PidDefinition pid(unsigned int number, unsigned int size,
+                            std::string_view name,
+                            std::initializer_list<PidField> fields,
+                            std::chrono::milliseconds ttl = {}) {
+    PidDefinition result;
+    result.pid = static_cast<unsigned char>(number);
+    result.size = static_cast<unsigned char>(size);
+    result.name = name;
+    result.ttl = ttl;
+    for (const auto& item : fields) {
+        result.fields.at(result.field_count++) = item;
+    }
+    return result;
+}
+
+using enum PidUnit;
+
+// Oxygen sensor voltage and short term fuel trim.
+constexpr PidDefinition o2_sensor(unsigned int number, std::string_view name) {
+    return pid(number, 2, name, {u8(0, 0.005, 0, VOLTS), trim(1)});
+}
+// Wide range oxygen sensor equivalence ratio and voltage.
+constexpr PidDefinition o2_voltage(unsigned int number, std::string_view name) {
+    return pid(number, 4, name,
+               {u16(0, 2.0 / 65536, 0, RATIO), u16(2, 8.0 / 65536, 0, VOLTS)});
+}
+// Wide range oxygen sensor equivalence ratio and current.
+constexpr PidDefinition o2_current(unsigned int number, std::string_view name) {
+    return pid(number, 4, name,
+               {u16(0, 2.0 / 65536, 0, RATIO),
+                u16(2, 1.0 / 256, -128, MILLIAMPS)});
+}
+constexpr PidDefinition catalyst(unsigned int number, std::string_view name) {
+    return pid(number, 2, name, {hot_temperature(0)});
+}
+constexpr PidDefinition supported_pids(unsigned int number,
+                                       std::string_view name) {
+    return pid(number, 4, name, {bits(0, 4 * BITS_PER_BYTE)},
+               PID_TTL_CONSTANT);
+}
+// Five pairs of 4 byte timers, after a support byte.
+constexpr PidDefinition aecd_times(unsigned int number,
+                                   std::string_view name) {
+    return pid(number, 41, name,
+               {supported(0), u32(1, 1, 0, SECONDS), u32(5, 1, 0, SECONDS),
+                u32(9, 1, 0, SECONDS), u32(13, 1, 0, SECONDS),
+                u32(17, 1, 0, SECONDS), u32(21, 1, 0, SECONDS),
+                u32(25, 1, 0, SECONDS), u32(29, 1, 0, SECONDS),
+                u32(33, 1, 0, SECONDS), u32(37, 1, 0, SECONDS)});
+}
+// Support byte, then four temperatures of two bytes each.
+constexpr PidDefinition four_temperatures(unsigned int number,
+                                          std::string_view name) {
+    return pid(number, 9, name,
+               {supported(0), hot_temperature(1), hot_temperature(3),
+                hot_temperature(5), hot_temperature(7)});
+}
+// Support byte, then four NOx concentrations of two bytes each.
+constexpr PidDefinition nox_sensors(unsigned int number,
+                                    std::string_view name) {
+    return pid(number, 9, name,
+               {supported(0), u16(1, 1, 0, PPM), u16(3, 1, 0, PPM),
+                u16(5, 1, 0, PPM), u16(7, 1, 0, PPM)});
+}
+// Support byte, then data we do not break down.
+constexpr PidDefinition support_only(unsigned int number, unsigned int size,
+                                     std::string_view name) {
+    return pid(number, size, name, {supported(0)});
+}
+} // namespace pid_table
+
+// In PID order.
+inline constexpr std::array PID_TABLE{
+    pid_table::supported_pids(0x00, "PIDs supported [01-20]"),
+    pid_table::pid(0x01, 4, "Monitor status since DTCs cleared",
+                   {pid_table::bits(0, 1), pid_table::bits(1, 7),
+                    pid_table::supported(1), pid_table::supported(2),
+                    pid_table::supported(3)}, PID_TTL_SLOW),
+    pid_table::pid(0x02, 2, "DTC that caused freeze frame",
+                   {pid_table::bits(0, 16)}),
+    pid_table::pid(0x03, 2, "Fuel system status",
+                   {pid_table::supported(0), pid_table::supported(1)}),
+    pid_table::pid(0x04, 1, "Calculated engine load",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x05, 1, "Engine coolant temperature",
+                   {pid_table::temperature(0)}),
+    pid_table::pid(0x06, 1, "Short term fuel trim, bank 1",
+                   {pid_table::trim(0)}),
+    pid_table::pid(0x07, 1, "Long term fuel trim, bank 1",
+                   {pid_table::trim(0)}),
+    pid_table::pid(0x08, 1, "Short term fuel trim, bank 2",
+                   {pid_table::trim(0)}),
+    pid_table::pid(0x09, 1, "Long term fuel trim, bank 2",
+                   {pid_table::trim(0)}),
+    pid_table::pid(0x0A, 1, "Fuel pressure",
+                   {pid_table::u8(0, 3, 0, PidUnit::KPA)}),
+    pid_table::pid(0x0B, 1, "Intake manifold absolute pressure",
+                   {pid_table::u8(0, 1, 0, PidUnit::KPA)}),
+    pid_table::pid(0x0C, 2, "Engine speed",
+                   {pid_table::u16(0, 0.25, 0, PidUnit::RPM)}),
+    pid_table::pid(0x0D, 1, "Vehicle speed",
+                   {pid_table::u8(0, 1, 0, PidUnit::KM_PER_HOUR)}),
+    pid_table::pid(0x0E, 1, "Timing advance",
+                   {pid_table::u8(0, 0.5, -64, PidUnit::DEGREES)}),
+    pid_table::pid(0x0F, 1, "Intake air temperature",
+                   {pid_table::temperature(0)}),
+    pid_table::pid(0x10, 2, "Mass air flow rate",
+                   {pid_table::u16(0, 0.01, 0, PidUnit::GRAMS_PER_SECOND)}),
+    pid_table::pid(0x11, 1, "Throttle position", {pid_table::percent(0)}),
+    pid_table::pid(0x12, 1, "Commanded secondary air status",
+                   {pid_table::supported(0)}),
+    pid_table::pid(0x13, 1, "Oxygen sensors present (2 banks)",
+                   {pid_table::supported(0)}, PID_TTL_CONSTANT),
+    pid_table::o2_sensor(0x14, "Oxygen sensor 1"),
+    pid_table::o2_sensor(0x15, "Oxygen sensor 2"),
+    pid_table::o2_sensor(0x16, "Oxygen sensor 3"),
+    pid_table::o2_sensor(0x17, "Oxygen sensor 4"),
+    pid_table::o2_sensor(0x18, "Oxygen sensor 5"),
+    pid_table::o2_sensor(0x19, "Oxygen sensor 6"),
+    pid_table::o2_sensor(0x1A, "Oxygen sensor 7"),
+    pid_table::o2_sensor(0x1B, "Oxygen sensor 8"),
+    pid_table::pid(0x1C, 1, "OBD standards", {pid_table::supported(0)},
+                   PID_TTL_CONSTANT),
+    pid_table::pid(0x1D, 1, "Oxygen sensors present (4 banks)",
+                   {pid_table::supported(0)}, PID_TTL_CONSTANT),
+    pid_table::pid(0x1E, 1, "Auxiliary input status",
+                   {pid_table::supported(0)}),
+    pid_table::pid(0x1F, 2, "Run time since engine start",
+                   {pid_table::u16(0, 1, 0, PidUnit::SECONDS)}),
+    pid_table::supported_pids(0x20, "PIDs supported [21-40]"),
+    pid_table::pid(0x21, 2, "Distance traveled with MIL on",
+                   {pid_table::u16(0, 1, 0, PidUnit::KILOMETERS)},
+                   PID_TTL_SLOW),
+    pid_table::pid(0x22, 2, "Fuel rail pressure (relative to vacuum)",
+                   {pid_table::u16(0, 0.079, 0, PidUnit::KPA)}),
+    pid_table::pid(0x23, 2, "Fuel rail gauge pressure",
+                   {pid_table::u16(0, 10, 0, PidUnit::KPA)}),
+    pid_table::o2_voltage(0x24, "Oxygen sensor 1 (wide range voltage)"),
+    pid_table::o2_voltage(0x25, "Oxygen sensor 2 (wide range voltage)"),
+    pid_table::o2_voltage(0x26, "Oxygen sensor 3 (wide range voltage)"),
+    pid_table::o2_voltage(0x27, "Oxygen sensor 4 (wide range voltage)"),
+    pid_table::o2_voltage(0x28, "Oxygen sensor 5 (wide range voltage)"),
+    pid_table::o2_voltage(0x29, "Oxygen sensor 6 (wide range voltage)"),
+    pid_table::o2_voltage(0x2A, "Oxygen sensor 7 (wide range voltage)"),
+    pid_table::o2_voltage(0x2B, "Oxygen sensor 8 (wide range voltage)"),
+    pid_table::pid(0x2C, 1, "Commanded EGR", {pid_table::percent(0)}),
+    pid_table::pid(0x2D, 1, "EGR error", {pid_table::trim(0)}),
+    pid_table::pid(0x2E, 1, "Commanded evaporative purge",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x2F, 1, "Fuel tank level", {pid_table::percent(0)}),
+    pid_table::pid(0x30, 1, "Warm-ups since codes cleared",
+                   {pid_table::u8(0, 1, 0, PidUnit::NONE)}, PID_TTL_SLOW),
+    pid_table::pid(0x31, 2, "Distance traveled since codes cleared",
+                   {pid_table::u16(0, 1, 0, PidUnit::KILOMETERS)},
+                   PID_TTL_SLOW),
+    pid_table::pid(0x32, 2, "Evaporative system vapor pressure",
+                   {pid_table::s16(0, 0.25, 0, PidUnit::PA)}),
+    pid_table::pid(0x33, 1, "Absolute barometric pressure",
+                   {pid_table::u8(0, 1, 0, PidUnit::KPA)}),
+    pid_table::o2_current(0x34, "Oxygen sensor 1 (wide range current)"),
+    pid_table::o2_current(0x35, "Oxygen sensor 2 (wide range current)"),
+    pid_table::o2_current(0x36, "Oxygen sensor 3 (wide range current)"),
+    pid_table::o2_current(0x37, "Oxygen sensor 4 (wide range current)"),
+    pid_table::o2_current(0x38, "Oxygen sensor 5 (wide range current)"),
+    pid_table::o2_current(0x39, "Oxygen sensor 6 (wide range current)"),
+    pid_table::o2_current(0x3A, "Oxygen sensor 7 (wide range current)"),
+    pid_table::o2_current(0x3B, "Oxygen sensor 8 (wide range current)"),
+    pid_table::catalyst(0x3C, "Catalyst temperature, bank 1 sensor 1"),
+    pid_table::catalyst(0x3D, "Catalyst temperature, bank 2 sensor 1"),
+    pid_table::catalyst(0x3E, "Catalyst temperature, bank 1 sensor 2"),
+    pid_table::catalyst(0x3F, "Catalyst temperature, bank 2 sensor 2"),
+    pid_table::supported_pids(0x40, "PIDs supported [41-60]"),
+    pid_table::pid(0x41, 4, "Monitor status this drive cycle",
+                   {pid_table::supported(1), pid_table::supported(2),
+                    pid_table::supported(3)}, PID_TTL_SLOW),
+    pid_table::pid(0x42, 2, "Control module voltage",
+                   {pid_table::u16(0, 0.001, 0, PidUnit::VOLTS)}),
+    pid_table::pid(0x43, 2, "Absolute load value",
+                   {pid_table::u16(0, 100.0 / 255, 0, PidUnit::PERCENT)}),
+    pid_table::pid(0x44, 2, "Commanded air-fuel equivalence ratio",
+                   {pid_table::u16(0, 2.0 / 65536, 0, PidUnit::RATIO)}),
+    pid_table::pid(0x45, 1, "Relative throttle position",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x46, 1, "Ambient air temperature",
+                   {pid_table::temperature(0)}),
+    pid_table::pid(0x47, 1, "Absolute throttle position B",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x48, 1, "Absolute throttle position C",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x49, 1, "Accelerator pedal position D",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x4A, 1, "Accelerator pedal position E",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x4B, 1, "Accelerator pedal position F",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x4C, 1, "Commanded throttle actuator",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x4D, 2, "Time run with MIL on",
+                   {pid_table::u16(0, 1, 0, PidUnit::MINUTES)}, PID_TTL_SLOW),
+    pid_table::pid(0x4E, 2, "Time since trouble codes cleared",
+                   {pid_table::u16(0, 1, 0, PidUnit::MINUTES)}, PID_TTL_SLOW),
+    pid_table::pid(0x4F, 4, "Maximum sensor values",
+                   {pid_table::u8(0, 1, 0, PidUnit::RATIO),
+                    pid_table::u8(1, 1, 0, PidUnit::VOLTS),
+                    pid_table::u8(2, 1, 0, PidUnit::MILLIAMPS),
+                    pid_table::u8(3, 10, 0, PidUnit::KPA)}),
+    pid_table::pid(0x50, 4, "Maximum mass air flow rate",
+                   {pid_table::u8(0, 10, 0, PidUnit::GRAMS_PER_SECOND)}),
+    pid_table::pid(0x51, 1, "Fuel type", {pid_table::supported(0)},
+                   PID_TTL_CONSTANT),
+    pid_table::pid(0x52, 1, "Ethanol fuel", {pid_table::percent(0)}),
+    pid_table::pid(0x53, 2, "Absolute evaporative system vapor pressure",
+                   {pid_table::u16(0, 0.005, 0, PidUnit::KPA)}),
+    pid_table::pid(0x54, 2, "Evaporative system vapor pressure",
+                   {pid_table::s16(0, 1, 0, PidUnit::PA)}),
+    pid_table::pid(0x55, 2, "Short term secondary oxygen trim, banks 1/3",
+                   {pid_table::trim(0), pid_table::trim(1)}),
+    pid_table::pid(0x56, 2, "Long term secondary oxygen trim, banks 1/3",
+                   {pid_table::trim(0), pid_table::trim(1)}),
+    pid_table::pid(0x57, 2, "Short term secondary oxygen trim, banks 2/4",
+                   {pid_table::trim(0), pid_table::trim(1)}),
+    pid_table::pid(0x58, 2, "Long term secondary oxygen trim, banks 2/4",
+                   {pid_table::trim(0), pid_table::trim(1)}),
+    pid_table::pid(0x59, 2, "Fuel rail absolute pressure",
+                   {pid_table::u16(0, 10, 0, PidUnit::KPA)}),
+    pid_table::pid(0x5A, 1, "Relative accelerator pedal position",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x5B, 1, "Hybrid battery pack remaining life",
+                   {pid_table::percent(0)}),
+    pid_table::pid(0x5C, 1, "Engine oil temperature",
+                   {pid_table::temperature(0)}),
+    pid_table::pid(0x5D, 2, "Fuel injection timing",
+                   {pid_table::u16(0, 1.0 / 128, -210, PidUnit::DEGREES)}),
+    pid_table::pid(0x5E, 2, "Engine fuel rate",
+                   {pid_table::u16(0, 0.05, 0, PidUnit::LITERS_PER_HOUR)}),
+    pid_table::pid(0x5F, 1, "Emission requirements",
+                   {pid_table::supported(0)}, PID_TTL_CONSTANT),
+    pid_table::supported_pids(0x60, "PIDs supported [61-80]"),
+    pid_table::pid(0x61, 1, "Driver's demand engine percent torque",
+                   {pid_table::torque(0)}),
+    pid_table::pid(0x62, 1, "Actual engine percent torque",
+                   {pid_table::torque(0)}),
+    pid_table::pid(0x63, 2, "Engine reference torque",
+                   {pid_table::u16(0, 1, 0, PidUnit::NEWTON_METERS)},
+                   PID_TTL_CONSTANT),
+    pid_table::pid(0x64, 5, "Engine percent torque data",
+                   {pid_table::torque(0), pid_table::torque(1),
+                    pid_table::torque(2), pid_table::torque(3),
+                    pid_table::torque(4)}),
+    pid_table::pid(0x65, 2, "Auxiliary input/output",
+                   {pid_table::supported(0), pid_table::supported(1)},
+                   PID_TTL_CONSTANT),
+    pid_table::pid(
+        0x66, 5, "Mass air flow sensors",
+        {pid_table::supported(0),
+         pid_table::u16(1, 1.0 / 32, 0, PidUnit::GRAMS_PER_SECOND),
+         pid_table::u16(3, 1.0 / 32, 0, PidUnit::GRAMS_PER_SECOND)}),
+    pid_table::pid(0x67, 3, "Engine coolant temperature sensors",
+                   {pid_table::supported(0), pid_table::temperature(1),
+                    pid_table::temperature(2)}),
+    pid_table::pid(0x68, 7, "Intake air temperature sensors",
+                   {pid_table::supported(0), pid_table::temperature(1),
+                    pid_table::temperature(2), pid_table::temperature(3),
+                    pid_table::temperature(4), pid_table::temperature(5),
+                    pid_table::temperature(6)}),
+    pid_table::pid(0x69, 7, "Commanded and actual EGR, and EGR error",
+                   {pid_table::supported(0), pid_table::percent(1),
+                    pid_table::percent(2), pid_table::trim(3),
+                    pid_table::percent(4), pid_table::percent(5),
+                    pid_table::trim(6)}),
+    pid_table::pid(0x6A, 5, "Diesel intake air flow control",
+                   {pid_table::supported(0), pid_table::percent(1),
+                    pid_table::percent(2), pid_table::percent(3),
+                    pid_table::percent(4)}),
+    pid_table::pid(0x6B, 5, "Exhaust gas recirculation temperature",
+                   {pid_table::supported(0), pid_table::temperature(1),
+                    pid_table::temperature(2), pid_table::temperature(3),
+                    pid_table::temperature(4)}),
+    pid_table::pid(0x6C, 5, "Commanded and relative throttle position",
+                   {pid_table::supported(0), pid_table::percent(1),
+                    pid_table::percent(2), pid_table::percent(3),
+                    pid_table::percent(4)}),
+    pid_table::pid(0x6D, 11, "Fuel pressure control system",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 10, 0, PidUnit::KPA),
+                    pid_table::u16(3, 10, 0, PidUnit::KPA),
+                    pid_table::temperature(5),
+                    pid_table::u16(6, 10, 0, PidUnit::KPA),
+                    pid_table::u16(8, 10, 0, PidUnit::KPA),
+                    pid_table::temperature(10)}),
+    pid_table::pid(0x6E, 9, "Injection pressure control system",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 10, 0, PidUnit::KPA),
+                    pid_table::u16(3, 10, 0, PidUnit::KPA),
+                    pid_table::u16(5, 10, 0, PidUnit::KPA),
+                    pid_table::u16(7, 10, 0, PidUnit::KPA)}),
+    pid_table::pid(0x6F, 3, "Turbocharger compressor inlet pressure",
+                   {pid_table::supported(0),
+                    pid_table::u8(1, 1, 0, PidUnit::KPA),
+                    pid_table::u8(2, 1, 0, PidUnit::KPA)}),
+    pid_table::pid(0x70, 10, "Boost pressure control",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 1.0 / 32, 0, PidUnit::KPA),
+                    pid_table::u16(3, 1.0 / 32, 0, PidUnit::KPA),
+                    pid_table::u16(5, 1.0 / 32, 0, PidUnit::KPA),
+                    pid_table::u16(7, 1.0 / 32, 0, PidUnit::KPA),
+                    pid_table::supported(9)}),
+    pid_table::pid(0x71, 6, "Variable geometry turbo control",
+                   {pid_table::supported(0), pid_table::percent(1),
+                    pid_table::percent(2), pid_table::percent(3),
+                    pid_table::percent(4), pid_table::supported(5)}),
+    pid_table::pid(0x72, 5, "Wastegate control",
+                   {pid_table::supported(0), pid_table::percent(1),
+                    pid_table::percent(2), pid_table::percent(3),
+                    pid_table::percent(4)}),
+    pid_table::pid(0x73, 5, "Exhaust pressure",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 0.01, 0, PidUnit::KPA),
+                    pid_table::u16(3, 0.01, 0, PidUnit::KPA)}),
+    pid_table::pid(0x74, 5, "Turbocharger speed",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 10, 0, PidUnit::RPM),
+                    pid_table::u16(3, 10, 0, PidUnit::RPM)}),
+    pid_table::pid(0x75, 7, "Turbocharger A temperature",
+                   {pid_table::supported(0), pid_table::temperature(1),
+                    pid_table::temperature(2), pid_table::hot_temperature(3),
+                    pid_table::hot_temperature(5)}),
+    pid_table::pid(0x76, 7, "Turbocharger B temperature",
+                   {pid_table::supported(0), pid_table::temperature(1),
+                    pid_table::temperature(2), pid_table::hot_temperature(3),
+                    pid_table::hot_temperature(5)}),
+    pid_table::pid(0x77, 5, "Charge air cooler temperature",
+                   {pid_table::supported(0), pid_table::temperature(1),
+                    pid_table::temperature(2), pid_table::temperature(3),
+                    pid_table::temperature(4)}),
+    pid_table::four_temperatures(0x78, "Exhaust gas temperature, bank 1"),
+    pid_table::four_temperatures(0x79, "Exhaust gas temperature, bank 2"),
+    pid_table::pid(0x7A, 7, "Diesel particulate filter, bank 1",
+                   {pid_table::supported(0),
+                    pid_table::s16(1, 0.01, 0, PidUnit::KPA),
+                    pid_table::u16(3, 0.01, 0, PidUnit::KPA),
+                    pid_table::u16(5, 0.01, 0, PidUnit::KPA)}),
+    pid_table::pid(0x7B, 7, "Diesel particulate filter, bank 2",
+                   {pid_table::supported(0),
+                    pid_table::s16(1, 0.01, 0, PidUnit::KPA),
+                    pid_table::u16(3, 0.01, 0, PidUnit::KPA),
+                    pid_table::u16(5, 0.01, 0, PidUnit::KPA)}),
+    pid_table::four_temperatures(0x7C, "Diesel particulate filter "
+                                       "temperature"),
+    pid_table::pid(0x7D, 1, "NOx NTE control area status",
+                   {pid_table::supported(0)}),
+    pid_table::pid(0x7E, 1, "PM NTE control area status",
+                   {pid_table::supported(0)}),
+    pid_table::pid(0x7F, 13, "Engine run time",
+                   {pid_table::supported(0),
+                    pid_table::u32(1, 1, 0, PidUnit::SECONDS),
+                    pid_table::u32(5, 1, 0, PidUnit::SECONDS),
+                    pid_table::u32(9, 1, 0, PidUnit::SECONDS)}),
+    pid_table::supported_pids(0x80, "PIDs supported [81-A0]"),
+    pid_table::aecd_times(0x81, "Engine run time for AECD #1-#5"),
+    pid_table::aecd_times(0x82, "Engine run time for AECD #6-#10"),
+    pid_table::nox_sensors(0x83, "NOx sensor"),
+    pid_table::pid(0x84, 1, "Manifold surface temperature",
+                   {pid_table::temperature(0)}),
+    pid_table::pid(0x85, 10, "NOx reagent system",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 0.005, 0, PidUnit::LITERS_PER_HOUR),
+                    pid_table::u16(3, 0.005, 0, PidUnit::LITERS_PER_HOUR),
+                    pid_table::percent(5),
+                    pid_table::u32(6, 1, 0, PidUnit::SECONDS)}),
+    pid_table::pid(0x86, 5, "Particulate matter sensor",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 0.0125, 0,
+                                   PidUnit::MG_PER_CUBIC_METER),
+                    pid_table::u16(3, 0.0125, 0,
+                                   PidUnit::MG_PER_CUBIC_METER)}),
+    pid_table::pid(0x87, 5, "Intake manifold absolute pressure sensors",
+                   {pid_table::supported(0),
+                    pid_table::u16(1, 1.0 / 32, 0, PidUnit::KPA),
+                    pid_table::u16(3, 1.0 / 32, 0, PidUnit::KPA)}),
+    pid_table::support_only(0x88, 13, "SCR inducement system"),
+    pid_table::aecd_times(0x89, "Engine run time for AECD #11-#15"),
+    pid_table::aecd_times(0x8A, "Engine run time for AECD #16-#20"),
+    pid_table::support_only(0x8B, 7, "Diesel aftertreatment"),
+    pid_table::support_only(0x8C, 17, "Oxygen sensor (wide range)"),
+    pid_table::pid(0x8D, 1, "Throttle position G", {pid_table::percent(0)}),
+    pid_table::pid(0x8E, 1, "Engine friction percent torque",
+                   {pid_table::torque(0)}),
+    pid_table::support_only(0x8F, 7, "PM sensor, banks 1 and 2"),
+    pid_table::support_only(0x90, 3, "WWH-OBD vehicle OBD system"),
+    pid_table::support_only(0x91, 5, "WWH-OBD ECU OBD system"),
+    pid_table::pid(0x92, 2, "Fuel system control",
+                   {pid_table::supported(0), pid_table::supported(1)}),
+    pid_table::support_only(0x93, 3, "WWH-OBD counters"),
+    pid_table::support_only(0x94, 12, "NOx warning and inducement system"),
+    pid_table::four_temperatures(0x98, "Exhaust gas temperature sensor, "
+                                       "bank 1"),
+    pid_table::four_temperatures(0x99, "Exhaust gas temperature sensor, "
+                                       "bank 2"),
+    pid_table::support_only(0x9A, 6, "Hybrid/EV system data"),
+    pid_table::support_only(0x9B, 4, "Diesel exhaust fluid sensor"),
+    pid_table::support_only(0x9C, 17, "Oxygen sensor data"),
+    pid_table::pid(
+        0x9D, 4, "Engine fuel rate",
+        {pid_table::u16(0, 0.02, 0, PidUnit::GRAMS_PER_SECOND),
+         pid_table::u16(2, 0.02, 0, PidUnit::GRAMS_PER_SECOND)}),
+    pid_table::pid(0x9E, 2, "Engine exhaust flow rate",
+                   {pid_table::u16(0, 0.2, 0, PidUnit::KG_PER_HOUR)}),
+    pid_table::support_only(0x9F, 9, "Fuel system percentage use"),
+    pid_table::supported_pids(0xA0, "PIDs supported [A1-C0]"),
+    pid_table::nox_sensors(0xA1, "NOx sensor corrected data"),
+    pid_table::pid(0xA2, 2, "Cylinder fuel rate",
+                   {pid_table::u16(0, 1.0 / 32, 0, PidUnit::MG_PER_STROKE)}),
+    pid_table::support_only(0xA3, 9, "Evap system vapor pressure"),
+    pid_table::pid(0xA4, 4, "Transmission actual gear",
+                   {pid_table::supported(0), pid_table::bits(8, 4),
+                    pid_table::u16(2, 0.001, 0, PidUnit::RATIO)}),
+    pid_table::pid(0xA5, 4, "Commanded diesel exhaust fluid dosing",
+                   {pid_table::supported(0),
+                    pid_table::u8(1, 0.5, 0, PidUnit::PERCENT)}),
+    pid_table::pid(0xA6, 4, "Odometer",
+                   {pid_table::u32(0, 0.1, 0, PidUnit::KILOMETERS)}),
+    pid_table::nox_sensors(0xA7, "NOx sensor, sensors 3 and 4"),
+    pid_table::nox_sensors(0xA8, "NOx sensor corrected data, sensors 3 and 4"),
+    pid_table::support_only(0xA9, 4, "ABS disable switch state"),
+    pid_table::supported_pids(0xC0, "PIDs supported [C1-E0]"),
+};
+
+namespace pid_table {
+// Position of each PID's row in PID_TABLE, plus one; zero if it has none.
+inline constexpr std::array<unsigned char, 256> INDEX = [] {
+    static_assert(PID_TABLE.size() < 256);
+    std::array<unsigned char, 256> index{};
+    for (std::size_t row = 0; row < PID_TABLE.size(); ++row) {
+        index.at(PID_TABLE.at(row).pid) = static_cast<unsigned char>(row + 1);
+    }
+    return index;
+}();
+} // namespace pid_table
+
+// Definition of a PID, or nullptr if it is not in the table.
+constexpr const PidDefinition* find_pid(unsigned char pid) {
+    const auto row = pid_table::INDEX.at(pid);
+    return row == 0 ? nullptr : &PID_TABLE.at(row - 1U);
+}
+
+// Number of data bytes returned for a PID, or zero if it is unknown.
+constexpr std::size_t pid_size(unsigned char pid) {
+    const auto* definition = find_pid(pid);
+    return definition == nullptr ? 0 : definition->size;
+}
+
+constexpr double decode_field(const PidField& field,
+                              std::span<const unsigned char> data) {
+    constexpr unsigned int BITS_PER_BYTE = pid_table::BITS_PER_BYTE;
+    const unsigned int first = field.bit_offset / BITS_PER_BYTE;
+    const unsigned int end =
+        (field.bit_offset + field.bit_length + BITS_PER_BYTE - 1) /
+        BITS_PER_BYTE;
+    std::uint64_t raw = 0;
+    for (unsigned int byte = first; byte < end; ++byte) {
+        raw = (raw << BITS_PER_BYTE) | data[byte];
+    }
+    raw >>= end * BITS_PER_BYTE - field.bit_offset - field.bit_length;
+    raw &= (std::uint64_t{1} << field.bit_length) - 1;
+    // Sign extension without a branch; sign_bit is zero if unsigned.
+    const auto value = static_cast<std::int64_t>(raw ^ field.sign_bit) -
+                       static_cast<std::int64_t>(field.sign_bit);
+    return static_cast<double>(value) * field.scale + field.offset;
+}
+
+// Write the values of a PID's fields to values, in table order, and
+// return how many were written.  Returns zero if the PID is unknown or
+// data is shorter than the PID.
+constexpr std::size_t decode_pid(unsigned char pid,
+                                 std::span<const unsigned char> data,
+                                 std::span<double, MAX_PID_FIELDS> values) {
+    const auto* definition = find_pid(pid);
+    if (definition == nullptr || data.size() < definition->size) {
+        return 0;
+    }
+    for (std::size_t i = 0; i < definition->field_count; ++i) {
+        values[i] = decode_field(definition->fields.at(i), data);
+    }
+    return definition->field_count;
+}
+
+// Decoded values of one PID, for callers that keep them.
+struct PidValues {
+    std::array<double, MAX_PID_FIELDS> values{};
+    std::size_t count = 0;
+
+    [[nodiscard]] std::size_t size() const { return count; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+    double operator[](std::size_t index) const { return values.at(index); }
+    const double* begin() const { return values.data(); }
+    const double* end() const { return values.data() + count; }
+
+    bool operator==(const PidValues& other) const {
+        return std::ranges::equal(*this, other);
+    }
+};
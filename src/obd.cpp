@@ -1,5 +1,5 @@
 /* This file is part of neonobd - OBD diagnostic software.
- * Copyright (C) 2024  Brian LePage
+ * Copyright (C) 2024-2026  Brian LePage
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -16,33 +16,164 @@
  */
 
 #include "obd.hpp"
+#include "event-loop.hpp"
 #include "hardware-interface.hpp"
+#include "logger.hpp"
 #include "neonobd_exceptions.hpp"
 #include "obd-device.hpp"
+#include "obd-pids.hpp"
+#include "poll-scheduler.hpp"
+#include "profile-store.hpp"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <map>
 #include <memory>
-#include <sigc++/signal.h>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 // Service $01: Power train and diagnostic data.
 // Service $02: Power train freeze frame data.
 
-typedef std::vector<Obd::ResultTypes> (Obd::*CompletionCallback)(
-    std::span<unsigned char>&);
+namespace {
+constexpr unsigned char SERVICE_1 = 0x01;
+constexpr unsigned char SERVICE_2 = 0x02;
+// Service $09: Vehicle information.  PID $02 is the VIN.
+constexpr unsigned char SERVICE_9 = 0x09;
+constexpr unsigned char VIN_PID = 0x02;
+constexpr std::size_t VIN_LENGTH = 17;
+constexpr unsigned char POSITIVE_RESPONSE = 0x40;
+constexpr unsigned char NEGATIVE_RESPONSE = 0x7F;
+
+// ISO 15765-4 allows up to six PIDs in one service $01 request, and
+// three PID/frame number pairs in one service $02 request.
+constexpr std::size_t MAX_SERVICE_1_PIDS = 6;
+constexpr std::size_t MAX_SERVICE_2_PIDS = 3;
+
+constexpr unsigned int FUNCTIONAL_11BIT = 0x7DF;
+constexpr unsigned int FUNCTIONAL_29BIT = 0x18DB33F1;
+constexpr unsigned int MAX_11BIT_HEADER = 0x7FF;
+// ISO 15765-4: ECUs answer from 7E8-7EF to requests to 7E0-7E7, and
+// from 18DAF1xx to requests to 18DAxxF1.
+constexpr unsigned int RESPONSE_11BIT = 0x7E8;
+constexpr unsigned int PHYSICAL_11BIT = 0x7E0;
+constexpr unsigned int ECU_COUNT_11BIT = 8;
+constexpr unsigned int RESPONSE_29BIT = 0x18DAF100;
+constexpr unsigned int RESPONSE_29BIT_MASK = 0x1FFFFF00;
+constexpr unsigned int PHYSICAL_29BIT = 0x18DA00F1;
+constexpr unsigned int ECU_ADDRESS_MASK = 0xFF;
+constexpr unsigned int BITS_PER_BYTE = 8;
+
+// Supported PID maps: PID 00 covers PIDs 01-20, PID 20 covers 21-40,
+// and so on.  The last PID of each map says whether the next map is
+// supported.
+constexpr unsigned int PIDS_PER_MAP = 0x20;
+constexpr unsigned int PID_COUNT = 256;
 
-constexpr std::array<CompletionCallback, 100> service_1_pid_table {
-    nullptr, &Obd::get_MIL_status_complete
+// Requests to an address before the ECUs answering it are trusted,
+// unless they come from a profile.
+constexpr unsigned int LEARN_REQUESTS = 8;
+
+bool is_functional(unsigned int address) {
+    return address == FUNCTIONAL_11BIT || address == FUNCTIONAL_29BIT;
 }
 
-constexpr std::array<std::array<Obd::CommandCompleteFunction>*, 10>
-    pid_request_table{
-        nullptr,
-        &service_1_pid_table, // Service $01
-        &service_1_pid_table, // Service $02
+unsigned int functional_address(unsigned int header) {
+    return header > MAX_11BIT_HEADER ? FUNCTIONAL_29BIT : FUNCTIONAL_11BIT;
+}
 
-    };
+PollScheduler::Clock::duration poll_period(double rate) {
+    if (!(rate > 0)) {
+        throw std::invalid_argument("Poll rate must be positive.");
+    }
+    return std::chrono::duration_cast<PollScheduler::Clock::duration>(
+        std::chrono::duration<double>(1 / rate));
+}
+
+// Physical request address of the ECU answering from header, or zero
+// if it has none.
+unsigned int physical_address(unsigned int header) {
+    if (header >= RESPONSE_11BIT && header < RESPONSE_11BIT + ECU_COUNT_11BIT) {
+        return header - RESPONSE_11BIT + PHYSICAL_11BIT;
+    }
+    if ((header & RESPONSE_29BIT_MASK) == RESPONSE_29BIT) {
+        return PHYSICAL_29BIT | ((header & ECU_ADDRESS_MASK) << BITS_PER_BYTE);
+    }
+    return 0;
+}
+
+// Split a (possibly multi-PID) service $01/$02 response into the data
+// bytes for each PID.  Returns false if the response is malformed or
+// contains a PID of unknown size.
+bool split_response(
+    unsigned char service, std::span<const unsigned char> response,
+    std::map<unsigned char, std::span<const unsigned char>>& pid_data) {
+    if (response.empty() || response[0] != (service | POSITIVE_RESPONSE)) {
+        return false;
+    }
+
+    std::size_t pos = 1;
+    while (pos < response.size()) {
+        const unsigned char pid = response[pos++];
+        if (service == SERVICE_2) {
+            // Skip the frame number.
+            if (pos++ >= response.size()) {
+                return false;
+            }
+        }
+        const std::size_t size = pid_size(pid);
+        if (size == 0 || pos + size > response.size()) {
+            return false;
+        }
+        pid_data.emplace(pid, response.subspan(pos, size));
+        pos += size;
+    }
+    return true;
+}
+
+// VIN from the first ECU's answer to service $09 PID $02, or empty if
+// it is not valid.  On CAN the answer is one message: 49 02 01 and the
+// 17 characters.  Other protocols send five messages of 49 02, the
+// message number and four bytes, the first padded with zeros.
+std::string parse_VIN(ObdDevice::CommandResult result) {
+    static constexpr std::size_t HEADER_BYTES = 3;
+    std::string vin;
+    for (const auto& frame : result) {
+        if (frame.header != result.front().header ||
+            frame.data.size() < HEADER_BYTES ||
+            frame.data[0] != (SERVICE_9 | POSITIVE_RESPONSE) ||
+            frame.data[1] != VIN_PID) {
+            continue;
+        }
+        for (const unsigned char byte : frame.data.subspan(HEADER_BYTES)) {
+            if (byte != 0) {
+                vin.push_back(static_cast<char>(byte));
+            }
+        }
+    }
+    const bool valid =
+        vin.size() == VIN_LENGTH &&
+        std::ranges::all_of(vin, [](char character) {
+            return (character >= '0' && character <= '9') ||
+                   (character >= 'A' && character <= 'Z');
+        });
+    return valid ? vin : std::string{};
+}
+
+} // namespace
 
-sigc::signal<void(bool)>
-Obd::init(const std::shared_ptr<ObdDevice>& obd_device,
-          const std::shared_ptr<HardwareInterface>& hwif) {
+void Obd::init(const std::shared_ptr<ObdDevice>& obd_device,
+               const std::shared_ptr<HardwareInterface>& hwif,
+               std::function<void(bool)> callback) {
 
     if (m_connected || m_connecting) {
         throw neon::InvalidState("Invalid state to initialize OBD device.");
@@ -50,107 +181,962 @@ Obd::init(const std::shared_ptr<ObdDevice>& obd_device,
 
     m_obdDevice = obd_device;
     m_hwif = hwif;
+    m_init_callback = std::move(callback);
+    m_connecting = true;
 
-    m_init_connection = obd_device->init(hwif).connect(
-        [this](bool success) { initComplete(success); });
+    if (m_profile_store != nullptr) {
+        // The VIN is not known until connected, so start from the
+        // vehicle last used with the adapter.
+        const auto* profile = m_profile_store->find(m_adapter_id);
+        m_profile = profile != nullptr ? *profile : VehicleProfile{};
+        m_profile.adapter_id = m_adapter_id;
+        use_profile(m_profile);
+        obd_device->apply_profile(m_profile);
+    }
 
-    m_connecting = true;
+    obd_device->init(hwif.get(),
+                     [this](bool success) { initComplete(success); });
+}
 
-    return m_init_signal;
+Obd::~Obd() {
+    if (m_event_loop != nullptr && m_poll_timer >= 0) {
+        m_event_loop->remove_timer(m_poll_timer);
+    }
 }
 
 void Obd::initComplete(bool success) {
+    m_is_CAN = m_obdDevice->is_CAN();
+    if (success && m_profile_store != nullptr) {
+        read_VIN();
+        return;
+    }
+    finish_init(success);
+}
+
+void Obd::read_VIN() {
+    static constexpr std::array<unsigned char, 1> REQUEST{VIN_PID};
+    m_obdDevice->send_command(
+        m_vin_address, SERVICE_9, REQUEST,
+        [this](CommandStatus status, ObdDevice::CommandResult result) {
+            vin_received(status, result);
+        },
+        {});
+}
+
+void Obd::vin_received(CommandStatus status,
+                       ObdDevice::CommandResult result) {
+    const std::string vin =
+        status == neon::CMD_OK ? parse_VIN(result) : std::string{};
+    if (vin.empty()) {
+        Logger::info << "Vehicle did not report its VIN.\n";
+    }
+    if (vin != m_profile.vin) {
+        // Not the vehicle last used with the adapter.
+        const auto* profile = m_profile_store->find(m_adapter_id, vin);
+        m_profile = profile != nullptr ? *profile : VehicleProfile{};
+        m_profile.adapter_id = m_adapter_id;
+        m_profile.vin = vin;
+        use_profile(m_profile);
+    }
+    finish_init(true);
+}
+
+void Obd::finish_init(bool success) {
     m_connected = success;
     m_connecting = false;
-    m_is_CAN = m_obdDevice->is_CAN();
-    m_init_connection.disconnect();
-    if (success) {
-        m_command_connection = m_obdDevice->signal_command_complete().connect(
-            [this](const auto& result) { command_complete(result); });
+
+    auto callback = std::move(m_init_callback);
+    m_init_callback = nullptr;
+    callback(success);
+
+    invalidate_cache();
+    if (m_connected) {
+        m_poll_scheduler.restart();
+        run_polls();
+    }
+}
+
+void Obd::apply_profile(const VehicleProfile& profile) {
+    if (m_connected || m_connecting) {
+        throw neon::InvalidState("Profile must be applied before init.");
+    }
+    use_profile(profile);
+}
+
+void Obd::set_profile_store(ProfileStore* store, std::string adapter_id,
+                            unsigned int vin_address) {
+    if (m_connected || m_connecting) {
+        throw neon::InvalidState("Profile store must be set before init.");
+    }
+    m_profile_store = store;
+    m_adapter_id = std::move(adapter_id);
+    m_vin_address = vin_address;
+}
+
+void Obd::use_profile(const VehicleProfile& profile) {
+    m_responders.clear();
+    m_pid_routes.clear();
+    for (const auto& ecu : profile.ecus) {
+        const unsigned int address = functional_address(ecu.header);
+        auto& responders = m_responders[address];
+        responders.headers.insert(ecu.header);
+        responders.requests = LEARN_REQUESTS;
+
+        for (std::size_t pid = 0; pid < ecu.supported_pids.size(); ++pid) {
+            if (ecu.supported_pids.test(pid)) {
+                m_pid_routes[{address, SERVICE_1,
+                              static_cast<unsigned char>(pid)}]
+                    .headers.insert(ecu.header);
+            }
+        }
     }
 
-    m_init_signal.emit(success);
+    // Addresses whose ECUs all have their supported PIDs in the profile
+    // need no discovery.
+    m_supported.clear();
+    m_discovery.clear();
+    std::map<BatchKey, bool> complete;
+    for (const auto& ecu : profile.ecus) {
+        m_supported[{ecu.header, SERVICE_1}] = ecu.supported_pids;
+        for (const unsigned int address :
+             {functional_address(ecu.header), physical_address(ecu.header)}) {
+            if (address == 0) {
+                continue;
+            }
+            const BatchKey key{address, SERVICE_1};
+            m_discovery[key].headers.insert(ecu.header);
+            complete.try_emplace(key, true).first->second &=
+                ecu.supported_pids.any();
+        }
+    }
+    for (const auto& [key, found] : complete) {
+        auto& discovery = m_discovery[key];
+        if (!found) {
+            discovery.headers.clear();
+            continue;
+        }
+        discovery.done = true;
+        for (const unsigned int header : discovery.headers) {
+            discovery.pids |= m_supported[{header, SERVICE_1}];
+        }
+    }
 }
 
-sigc::signal<void()> Obd::disconnect() {
+void Obd::update_profile(VehicleProfile& profile) const {
+    for (const auto& [key, pids] : m_supported) {
+        const auto [header, service] = key;
+        if (service != SERVICE_1 || pids.none()) {
+            continue;
+        }
+        auto ecu = std::ranges::find(profile.ecus, header, &EcuProfile::header);
+        if (ecu == profile.ecus.end()) {
+            profile.ecus.push_back({header, {}, {}});
+            ecu = std::prev(profile.ecus.end());
+        }
+        ecu->supported_pids = pids;
+    }
+}
+
+void Obd::disconnect(std::function<void()> callback) {
     if (!m_connected || disconnecting) {
         throw neon::InvalidState("Invalid state to disconnect OBD device.");
     }
-    m_disconnect_connection =
-        m_obdDevice->disconnect().connect([this]() { disconnectComplete(); });
-    return m_disconnect_signal;
+    disconnecting = true;
+    m_disconnect_callback = std::move(callback);
+    m_obdDevice->disconnect([this]() { disconnectComplete(); });
+}
+
+void Obd::save_profile() {
+    update_profile(m_profile);
+    m_obdDevice->update_profile(m_profile);
+    m_profile_store->update(m_profile);
+    m_profile_store->save();
 }
 
 void Obd::disconnectComplete() {
-    m_disconnect_connection.disconnect();
-    m_disconnect_signal.emit();
+    m_connected = false;
+    disconnecting = false;
+    if (m_profile_store != nullptr) {
+        save_profile();
+    }
+    auto pending = std::move(m_pending);
+    auto discovery = std::move(m_discovery);
+    m_pending.clear();
+    m_no_batching.clear();
+    m_rejecting.clear();
+    m_responders.clear();
+    m_pid_routes.clear();
+    m_supported.clear();
+    m_discovery.clear();
+    invalidate_cache();
+    // Answers to polls in flight are cancelled with the pending requests.
+    m_poll_scheduler.restart();
+
+    // Requests the device did not answer, and those that never reached
+    // it, are cancelled.
+    std::vector<ResultCallback> cancelled;
+    for (auto& [key, requests] : pending) {
+        auto& batch = requests.batch;
+        if (batch && !batch->done) {
+            batch->done = true;
+            batch->handle.cancel();
+            for (auto& request : batch->requests) {
+                cancelled.push_back(std::move(request.callback));
+            }
+        }
+        for (auto& request : requests.requests) {
+            cancelled.push_back(std::move(request.callback));
+        }
+    }
+    for (auto& [key, waiting] : discovery) {
+        for (auto& request : waiting.waiting) {
+            cancelled.push_back(std::move(request.callback));
+        }
+    }
+    for (const auto& request_callback : cancelled) {
+        request_callback(neon::CMD_CANCELLED, {});
+    }
+    arm_poll_timer();
+
+    auto callback = std::move(m_disconnect_callback);
+    m_disconnect_callback = nullptr;
+    callback();
+}
+
+void Obd::get_PID(unsigned int ecu, unsigned char service, unsigned char pid,
+                  ResultCallback callback) {
+    if (!m_connected) {
+        throw neon::InvalidState("OBD device is not connected.");
+    }
+    if (service != SERVICE_1 && service != SERVICE_2) {
+        throw std::invalid_argument("PIDs are only defined for services 1/2.");
+    }
+
+    const BatchKey key{ecu, service};
+    auto& discovery = m_discovery[key];
+    if (!discovery.done) {
+        discovery.waiting.push_back({pid, std::move(callback)});
+        if (!discovery.running) {
+            // Ask for as many maps as fit in one request; ECUs only answer
+            // the ones they support.
+            const std::size_t count =
+                std::min<std::size_t>(max_batch_PIDs(key),
+                                      PID_COUNT / PIDS_PER_MAP);
+            std::vector<unsigned char> pids;
+            for (std::size_t map = 0; map < count; ++map) {
+                pids.push_back(static_cast<unsigned char>(map * PIDS_PER_MAP));
+            }
+            discover(key, pids);
+        }
+        return;
+    }
+    if (!discovery.pids.test(pid)) {
+        callback(neon::CMD_NO_DATA, {});
+        return;
+    }
+
+    const auto cached = m_cache.find({ecu, service, pid});
+    if (cached != m_cache.end()) {
+        if (cached->second.expires > std::chrono::steady_clock::now()) {
+            callback(neon::CMD_OK, cached->second.results);
+            return;
+        }
+        m_cache.erase(cached);
+    }
+    queue_PID(key, pid, std::move(callback));
 }
 
-void Obd::command_complete(
-    const std::unordered_map<unsigned int, std::vector<unsigned char>>&
-        result) {
-    auto& callback = m_command_queue.front().second;
-    auto& [ecu, data] = *result.begin();
-    auto processed_result = callback(std::span(data));
-    m_command_queue.front().first.emit(processed_result);
-    m_command_queue.pop();
+std::bitset<256> Obd::get_supported_PIDs(unsigned int header,
+                                         unsigned char service) const {
+    const auto found = m_supported.find({header, service});
+    return found != m_supported.end() ? found->second : std::bitset<256>{};
 }
 
-Obd::ResultSignal Obd::get_PID(unsigned char ecu, unsigned char service,
-                               unsigned char pid) {
-    ResultSignal command_complete_signal;
-    auto& callback = pid_request_table[service][pid];
-    m_command_queue.push(std::make_pair(command_complete_signal, [this](auto data){
-        std::invoke(this, callback, data)});
-    m_obdDevice->send_command(ecu, service, {pid});
-    return command_complete_signal;
+void Obd::invalidate_cache() { m_cache.clear(); }
+
+void Obd::set_event_loop(EventLoop* event_loop) {
+    if (m_event_loop != nullptr && m_poll_timer >= 0) {
+        m_event_loop->remove_timer(m_poll_timer);
+        m_poll_timer = -1;
+    }
+    m_event_loop = event_loop;
+    arm_poll_timer();
 }
 
-namespace {
-void process_monitor_statuses(std::vector<Obd::ResultTypes>& fmt_result,
-                              unsigned char supported, unsigned char ready,
-                              int ready_start, int size) {
+PollScheduler::Id Obd::poll_PID(unsigned int ecu, unsigned char service,
+                                unsigned char pid, double rate,
+                                ResultCallback callback) {
+    if (service != SERVICE_1 && service != SERVICE_2) {
+        throw std::invalid_argument("PIDs are only defined for services 1/2.");
+    }
+    const auto id = m_poll_scheduler.add(poll_period(rate));
+    if (id >= m_polls.size()) {
+        m_polls.resize(id + 1);
+    }
+    auto& poll = m_polls[id];
+    poll.ecu = ecu;
+    poll.service = service;
+    poll.pid = pid;
+    poll.callback = std::make_shared<ResultCallback>(std::move(callback));
+    run_polls();
+    return id;
+}
+
+void Obd::stop_polling(PollScheduler::Id id) {
+    auto& poll = m_polls.at(id);
+    ++poll.generation;
+    poll.callback.reset();
+    m_poll_scheduler.remove(id);
+    arm_poll_timer();
+}
+
+void Obd::set_poll_rate(PollScheduler::Id id, double rate) {
+    m_poll_scheduler.set_period(id, poll_period(rate));
+    arm_poll_timer();
+}
+
+const PollScheduler::Stats&
+Obd::get_poll_stats(PollScheduler::Id id) const {
+    return m_poll_scheduler.get_stats(id);
+}
+
+Obd::SubscriptionId Obd::subscribe(unsigned int ecu, unsigned char service,
+                                   unsigned char pid, double rate,
+                                   ResultCallback callback) {
+    if (service != SERVICE_1 && service != SERVICE_2) {
+        throw std::invalid_argument("PIDs are only defined for services 1/2.");
+    }
+    poll_period(rate);
+
+    SubscriptionId id = m_subscriptions.size();
+    if (m_free_subscriptions.empty()) {
+        m_subscriptions.emplace_back();
+    } else {
+        id = m_free_subscriptions.back();
+        m_free_subscriptions.pop_back();
+    }
+
+    // Subscribe before polling, in case the answer comes at once.
+    const auto [feed, added] = m_feeds.try_emplace({ecu, service, pid});
+    m_subscriptions[id] = {feed, feed->second.subscribers.size(), true};
+    feed->second.subscribers.push_back(
+        {id, rate, std::make_shared<ResultCallback>(std::move(callback))});
+
+    if (added) {
+        feed->second.rate = rate;
+        feed->second.poll = poll_PID(
+            ecu, service, pid, rate,
+            [this, feed](CommandStatus status, const EcuResults& results) {
+                feed_answer(feed, status, results);
+            });
+    } else if (rate > feed->second.rate) {
+        feed->second.rate = rate;
+        set_poll_rate(feed->second.poll, rate);
+    }
+    return id;
+}
+
+void Obd::unsubscribe(SubscriptionId id) {
+    auto& subscription = m_subscriptions.at(id);
+    if (!subscription.active) {
+        return;
+    }
+    subscription.active = false;
+    m_free_subscriptions.push_back(id);
+    remove_subscriber(subscription.feed, subscription.index);
+}
+
+const PollScheduler::Stats&
+Obd::get_subscription_stats(SubscriptionId id) const {
+    const auto& subscription = m_subscriptions.at(id);
+    if (!subscription.active) {
+        throw std::invalid_argument("Not subscribed.");
+    }
+    return get_poll_stats(subscription.feed->second.poll);
+}
+
+void Obd::remove_subscriber(std::map<PidKey, Feed>::iterator feed,
+                            std::size_t index) {
+    auto& subscribers = feed->second.subscribers;
+    if (feed->second.dispatching) {
+        subscribers[index].callback.reset();
+        feed->second.compact = true;
+        return;
+    }
+
+    const double rate = subscribers[index].rate;
+    if (index + 1 != subscribers.size()) {
+        subscribers[index] = std::move(subscribers.back());
+        m_subscriptions[subscribers[index].id].index = index;
+    }
+    subscribers.pop_back();
+    if (rate >= feed->second.rate) {
+        feed_changed(feed);
+    }
+}
+
+void Obd::feed_changed(std::map<PidKey, Feed>::iterator feed) {
+    auto& subscribers = feed->second.subscribers;
+    if (subscribers.empty()) {
+        stop_polling(feed->second.poll);
+        m_feeds.erase(feed);
+        return;
+    }
+    const double fastest =
+        std::ranges::max(subscribers, {}, &Subscriber::rate).rate;
+    if (fastest != feed->second.rate) {
+        feed->second.rate = fastest;
+        set_poll_rate(feed->second.poll, fastest);
+    }
+}
+
+void Obd::feed_answer(std::map<PidKey, Feed>::iterator feed,
+                      CommandStatus status, const EcuResults& results) {
+    auto& subscribers = feed->second.subscribers;
+    feed->second.dispatching = true;
+    // Subscribers may be added while this runs, so index each time.
+    for (std::size_t i = 0; i < subscribers.size(); ++i) {
+        const auto callback = subscribers[i].callback;
+        if (callback) {
+            (*callback)(status, results);
+        }
+    }
+    feed->second.dispatching = false;
+
+    if (!feed->second.compact) {
+        return;
+    }
+    feed->second.compact = false;
+    std::erase_if(subscribers, [](const Subscriber& subscriber) {
+        return !subscriber.callback;
+    });
+    for (std::size_t i = 0; i < subscribers.size(); ++i) {
+        m_subscriptions[subscribers[i].id].index = i;
+    }
+    feed_changed(feed);
+}
+
+void Obd::run_polls() {
+    // Answers given at once, e.g. for unsupported PIDs, come back here.
+    if (m_running_polls) {
+        m_run_polls_again = true;
+        return;
+    }
+    m_running_polls = true;
+    do {
+        m_run_polls_again = false;
+        if (!m_connected || disconnecting) {
+            break;
+        }
+        m_poll_scheduler.take_due(MAX_POLLS_IN_FLIGHT, m_due_polls);
+        for (const auto id : m_due_polls) {
+            const auto& poll = m_polls.at(id);
+            get_PID(poll.ecu, poll.service, poll.pid,
+                    [this, id, generation = poll.generation](
+                        CommandStatus status, const EcuResults& results) {
+                        poll_complete(id, generation, status, results);
+                    });
+        }
+    } while (m_run_polls_again);
+    m_running_polls = false;
+    arm_poll_timer();
+}
+
+void Obd::poll_complete(PollScheduler::Id id, unsigned int generation,
+                        CommandStatus status, const EcuResults& results) {
+    const auto& poll = m_polls.at(id);
+    if (poll.generation != generation) {
+        return;
+    }
+    m_poll_scheduler.complete(id, status == neon::CMD_OK);
+    // The callback may stop the poll.
+    const auto callback = poll.callback;
+    (*callback)(status, results);
+    run_polls();
+}
 
-    for (int i = 0; i < size; ++i) {
-        if ((supported >> i) & 1 == 0) {
-            fmt_result.push_back("NOT SUPPORTED");
+void Obd::arm_poll_timer() {
+    if (m_event_loop == nullptr) {
+        return;
+    }
+    const auto next = m_poll_scheduler.next_release();
+    if (!m_connected || !next ||
+        m_poll_scheduler.in_flight() >= MAX_POLLS_IN_FLIGHT) {
+        // Answers to the polls in flight run the next ones.
+        if (m_poll_timer >= 0) {
+            m_event_loop->disarm_timer(m_poll_timer);
+        }
+        return;
+    }
+    // This runs after every answer, so keep one timer and rearm it.
+    // run_polls() always rearms or disarms it, so it never repeats.
+    const auto delay = *next - PollScheduler::Clock::now();
+    if (m_poll_timer >= 0) {
+        m_event_loop->rearm_timer(m_poll_timer, delay);
+    } else {
+        m_poll_timer =
+            m_event_loop->add_timer(delay, [this]() { run_polls(); });
+    }
+}
+
+std::size_t Obd::max_batch_PIDs(const BatchKey& key) const {
+    const auto [ecu, service] = key;
+    if (!m_is_CAN || m_no_batching.contains(ecu)) {
+        return 1;
+    }
+    return service == SERVICE_2 ? MAX_SERVICE_2_PIDS : MAX_SERVICE_1_PIDS;
+}
+
+void Obd::queue_PID(const BatchKey& key, unsigned char pid,
+                    ResultCallback callback) {
+    const auto* definition = find_pid(pid);
+    if (definition != nullptr && definition->ttl.count() > 0) {
+        callback = [this, cache_key = PidKey{key.first, key.second, pid},
+                    callback = std::move(callback)](
+                       CommandStatus status, const EcuResults& results) {
+            if (status == neon::CMD_OK) {
+                cache_results(cache_key, results);
+            }
+            callback(status, results);
+        };
+    }
+    const BatchKey routed{route(key.first, key.second, pid), key.second};
+    m_pending[routed].requests.push_back({pid, std::move(callback)});
+    send_next_batch(routed);
+}
+
+void Obd::cache_results(const PidKey& key, const EcuResults& results) {
+    const auto ttl = find_pid(std::get<2>(key))->ttl;
+    const auto now = std::chrono::steady_clock::now();
+    // Do not overflow the time point for answers kept until invalidated.
+    const auto expires =
+        ttl >= std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::time_point::max() - now)
+            ? std::chrono::steady_clock::time_point::max()
+            : now + ttl;
+    m_cache.insert_or_assign(key, CachedResults{results, expires});
+}
+
+void Obd::discover(const BatchKey& key,
+                   const std::vector<unsigned char>& pids) {
+    auto& discovery = m_discovery[key];
+    discovery.running = true;
+    discovery.outstanding = pids.size();
+    for (const unsigned char pid : pids) {
+        discovery.requested.set(pid);
+        m_pending[key].requests.push_back(
+            {pid, [this, key, pid](CommandStatus status,
+                                   const EcuResults& results) {
+                 map_received(key, pid, status, results);
+             }});
+    }
+    send_next_batch(key);
+}
+
+void Obd::map_received(const BatchKey& key, unsigned char map_pid,
+                       CommandStatus status, const EcuResults& results) {
+    const auto found = m_discovery.find(key);
+    if (found == m_discovery.end() || !found->second.running) {
+        // Cancelled on disconnect.
+        return;
+    }
+    auto& discovery = found->second;
+    if (status != neon::CMD_OK && status != neon::CMD_NO_DATA) {
+        discovery.status = status;
+    }
+    if (status == neon::CMD_OK && !results.empty()) {
+        cache_results({key.first, key.second, map_pid}, results);
+    }
+    for (const auto& [header, values] : results) {
+        if (values.empty()) {
             continue;
         }
-        if((ready >> (i+ready_start)) & 1 == 1 {
-            fmt_result.push_back("READY");
-        } else {
-            fmt_result.push_back("NOT READY");
+        const auto map = static_cast<std::uint32_t>(values[0]);
+        auto& supported = m_supported[{header, key.second}];
+        supported.set(map_pid);
+        for (unsigned int bit = 0; bit < PIDS_PER_MAP; ++bit) {
+            const unsigned int pid = map_pid + bit + 1;
+            if (pid < PID_COUNT && ((map >> (PIDS_PER_MAP - 1 - bit)) & 1U)) {
+                supported.set(pid);
+            }
+        }
+        discovery.headers.insert(header);
+    }
+    if (--discovery.outstanding > 0) {
+        return;
+    }
+
+    // Read the maps that an ECU says are supported and were not asked for.
+    std::vector<unsigned char> next;
+    for (unsigned int pid = PIDS_PER_MAP; pid < PID_COUNT;
+         pid += PIDS_PER_MAP) {
+        const bool wanted = std::ranges::any_of(
+            discovery.headers, [this, &key, pid](unsigned int header) {
+                return m_supported[{header, key.second}].test(pid);
+            });
+        if (wanted && !discovery.requested.test(pid) &&
+            next.size() < max_batch_PIDs(key)) {
+            next.push_back(static_cast<unsigned char>(pid));
         }
     }
+    if (!next.empty()) {
+        discover(key, next);
+    } else {
+        discovery_complete(key);
+    }
 }
 
-bool check_response(std::span<unsigned char>& data, int expected_size,
-                    unsigned char expected_response) {
-    if (expected_size > data.size() || data[0] != expected_response) {
-        data = data.subspan(data.size());
-        return false;
+void Obd::discovery_complete(const BatchKey& key) {
+    auto& discovery = m_discovery[key];
+    discovery.running = false;
+    auto waiting = std::move(discovery.waiting);
+    discovery.waiting.clear();
+
+    if (discovery.headers.empty()) {
+        // Nothing answered; try again with the next request.
+        const CommandStatus status = discovery.status == neon::CMD_OK
+                                         ? neon::CMD_NO_DATA
+                                         : discovery.status;
+        Logger::info << "No supported PIDs found at " << std::hex
+                     << key.first << std::dec << ".\n";
+        m_discovery.erase(key);
+        for (auto& request : waiting) {
+            request.callback(status, {});
+        }
+        return;
+    }
+
+    discovery.done = true;
+    for (const unsigned int header : discovery.headers) {
+        discovery.pids |= m_supported[{header, key.second}];
+    }
+
+    // The router need not learn which ECUs answer each PID.
+    if (is_functional(key.first)) {
+        for (unsigned int pid = 0; pid < PID_COUNT; ++pid) {
+            if (!discovery.pids.test(pid)) {
+                continue;
+            }
+            auto& headers =
+                m_pid_routes[{key.first, key.second,
+                              static_cast<unsigned char>(pid)}]
+                    .headers;
+            headers.clear();
+            for (const unsigned int header : discovery.headers) {
+                if (m_supported[{header, key.second}].test(pid)) {
+                    headers.insert(header);
+                }
+            }
+        }
+    }
+
+    for (auto& request : waiting) {
+        get_PID(key.first, key.second, request.pid,
+                std::move(request.callback));
     }
-    return true;
 }
 
-} // namespace
+// Whether the ECU answering from header supports the PID, or may do as
+// its supported PIDs are not known.
+bool Obd::may_support(unsigned int header, unsigned char service,
+                      unsigned char pid) const {
+    const auto found = m_supported.find({header, service});
+    return found == m_supported.end() || found->second.test(pid);
+}
+
+// Whether the PID may be sent to ecu in a multi-PID request, i.e. no ECU
+// there that rejects such requests may support it.
+bool Obd::batchable(unsigned int ecu, unsigned char service,
+                    unsigned char pid) const {
+    const auto found = m_rejecting.find(ecu);
+    return found == m_rejecting.end() ||
+           std::ranges::none_of(found->second,
+                                [this, service, pid](unsigned int header) {
+                                    return may_support(header, service, pid);
+                                });
+}
+
+unsigned int Obd::route(unsigned int ecu, unsigned char service,
+                        unsigned char pid) {
+    if (!m_is_CAN || !is_functional(ecu)) {
+        return ecu;
+    }
+    const auto found = m_pid_routes.find({ecu, service, pid});
+    if (found == m_pid_routes.end()) {
+        return ecu;
+    }
+    auto& pid_route = found->second;
+    if (pid_route.headers.size() != 1 ||
+        ++pid_route.requests % RELEARN_INTERVAL == 0) {
+        return ecu;
+    }
+    const unsigned int physical =
+        physical_address(*pid_route.headers.begin());
+    return physical != 0 ? physical : ecu;
+}
+
+void Obd::learn_routes(const Batch& batch, const PidData& pid_data) {
+    const auto [ecu, service] = batch.key;
+    for (const auto& request : batch.requests) {
+        auto& headers = m_pid_routes[{ecu, service, request.pid}].headers;
+        headers.clear();
+        const auto found = pid_data.find(request.pid);
+        if (found != pid_data.end()) {
+            for (const auto& response : found->second) {
+                headers.insert(response.first);
+            }
+        }
+    }
+}
+
+void Obd::send_next_batch(const BatchKey& key) {
+    auto& pending = m_pending[key];
+    if (pending.in_flight || pending.requests.empty()) {
+        return;
+    }
+
+    const auto [ecu, service] = key;
+    std::size_t max_pids = max_batch_PIDs(key);
+
+    // Requests for a PID that is already in the batch share its data.
+    auto batch = std::make_shared<Batch>();
+    batch->key = key;
+    std::vector<unsigned char> data;
+    std::size_t pid_count = 0;
+    while (!pending.requests.empty()) {
+        const unsigned char pid = pending.requests.front().pid;
+        const bool new_pid = std::ranges::none_of(
+            batch->requests,
+            [pid](const auto& request) { return request.pid == pid; });
+        if (new_pid) {
+            if (pid_count == max_pids) {
+                break;
+            }
+            if (!batchable(ecu, service, pid)) {
+                if (pid_count > 0) {
+                    break;
+                }
+                max_pids = 1;
+            }
+            ++pid_count;
+            data.push_back(pid);
+            if (service == SERVICE_2) {
+                data.push_back(0);
+            }
+        }
+        batch->requests.push_back(std::move(pending.requests.front()));
+        pending.requests.pop_front();
+    }
+
+    auto& responders = m_responders[ecu];
+    ++responders.requests;
+    const bool relearn = responders.requests > LEARN_REQUESTS &&
+                         responders.requests % RELEARN_INTERVAL == 0;
+    ObdDevice::CommandOptions options;
+    if (!responders.headers.empty() &&
+        responders.requests > LEARN_REQUESTS && !relearn) {
+        options.frame_callback = [this, batch](
+                                     unsigned int header,
+                                     std::span<const unsigned char> frame) {
+            batch_frame(batch, header, frame);
+        };
+    }
+
+    pending.in_flight = true;
+    pending.batch = batch;
+    batch->handle = m_obdDevice->send_command(
+        ecu, service, data,
+        [this, batch, relearn](CommandStatus status,
+                               ObdDevice::CommandResult result) {
+            if (batch->done) {
+                return;
+            }
+            // Check the responses in header order so that results do not
+            // depend on the order the ECUs responded in.
+            std::map<unsigned int, std::span<const unsigned char>> responses;
+            auto& headers = m_responders[batch->key.first].headers;
+            for (const auto& frame : result) {
+                responses.emplace(frame.header, frame.data);
+                headers.insert(frame.header);
+            }
+            if (relearn && status == neon::CMD_OK) {
+                std::erase_if(headers, [this, &batch,
+                                        &responses](unsigned int header) {
+                    return !responses.contains(header) &&
+                           std::ranges::any_of(
+                               batch->requests,
+                               [this, &batch, header](const auto& request) {
+                                   return may_support(header,
+                                                      batch->key.second,
+                                                      request.pid);
+                               });
+                });
+            }
+            batch_complete(*batch, status, responses);
+        },
+        std::move(options));
+}
+
+void Obd::batch_frame(const std::shared_ptr<Batch>& batch, unsigned int header,
+                      std::span<const unsigned char> data) {
+    if (batch->done) {
+        return;
+    }
+    batch->responses[header].assign(data.begin(), data.end());
+
+    const auto& known = m_responders[batch->key.first].headers;
+    if (!std::ranges::all_of(known, [&batch](unsigned int ecu) {
+            return batch->responses.contains(ecu);
+        })) {
+        return;
+    }
+
+    // Every ECU has answered, so the device need not wait for more.
+    batch->handle.cancel();
+    std::map<unsigned int, std::span<const unsigned char>> responses;
+    for (const auto& [ecu, response] : batch->responses) {
+        responses.emplace(ecu, response);
+    }
+    batch_complete(*batch, neon::CMD_OK, responses);
+}
+
+void Obd::batch_complete(
+    Batch& batch, CommandStatus status,
+    const std::map<unsigned int, std::span<const unsigned char>>& responses) {
+    batch.done = true;
+    const auto [ecu, service] = batch.key;
+    auto& requests = batch.requests;
+
+    PidData pid_data;
+    // ECUs that rejected the request, or whose response was malformed.
+    std::vector<unsigned int> rejected;
+    for (const auto& [header, response] : responses) {
+        std::map<unsigned char, std::span<const unsigned char>> ecu_data;
+        if (!response.empty() && response[0] == NEGATIVE_RESPONSE) {
+            rejected.push_back(header);
+        } else if (!split_response(service, response, ecu_data)) {
+            Logger::debug << "Unable to split response from ECU " << std::hex
+                          << header << std::dec << ".\n";
+            rejected.push_back(header);
+        }
+        for (const auto& [pid, data] : ecu_data) {
+            pid_data[pid].emplace(header, data);
+        }
+    }
+
+    const bool multi_pid = std::ranges::any_of(
+        requests, [&requests](const auto& request) {
+            return request.pid != requests.front().pid;
+        });
+    const auto known = m_rejecting.find(ecu);
+    if (multi_pid && known != m_rejecting.end()) {
+        // Known to reject it, and sent none of the PIDs they support.
+        std::erase_if(rejected, [&known](unsigned int header) {
+            return known->second.contains(header);
+        });
+    }
+
+    // An ECU that rejects a multi-PID request, or answers none of its
+    // PIDs, may not support them; it is asked for each PID on its own from
+    // now on.  When other ECUs at a functional address did answer, only
+    // the ECUs that rejected it are asked again, at their physical
+    // addresses, for the PIDs they may support, and their answers are
+    // added to the others'.  An ECU that answers some of the PIDs simply
+    // does not support the rest.  A request that failed tells us nothing.
+    std::vector<PidRequest> retry;
+    std::vector<unsigned int> retry_ecus;
+    const bool answered =
+        status == neon::CMD_OK || status == neon::CMD_NO_DATA;
+    const bool fall_back =
+        multi_pid && answered &&
+        (pid_data.empty() || (!rejected.empty() && !is_functional(ecu)));
+    if (fall_back) {
+        Logger::info << "ECU " << std::hex << ecu << std::dec
+                     << " rejected multi-PID request; using single PIDs.\n";
+        m_no_batching.insert(ecu);
+    } else if (multi_pid && answered) {
+        for (const unsigned int header : rejected) {
+            const unsigned int physical = physical_address(header);
+            if (physical == 0) {
+                continue;
+            }
+            Logger::info << "ECU " << std::hex << header << std::dec
+                         << " rejected multi-PID request; using single "
+                            "PIDs.\n";
+            m_no_batching.insert(physical);
+            m_rejecting[ecu].insert(header);
+            retry_ecus.push_back(header);
+        }
+    }
+    if (is_functional(ecu) && answered && !fall_back && rejected.empty()) {
+        // Every ECU had its chance to answer.
+        learn_routes(batch, pid_data);
+    }
+
+    for (auto& request : requests) {
+        const auto found = pid_data.find(request.pid);
+        EcuResults results;
+        if (found != pid_data.end()) {
+            for (const auto& [header, data] : found->second) {
+                results.emplace(header, decode_PID(request.pid, data));
+            }
+        }
+        std::vector<unsigned int> asked;
+        for (const unsigned int header : retry_ecus) {
+            if (may_support(header, service, request.pid)) {
+                asked.push_back(physical_address(header));
+            }
+        }
+        if (!asked.empty()) {
+            auto merged = std::make_shared<MergedRequest>();
+            merged->results = std::move(results);
+            merged->status = found != pid_data.end() ? neon::CMD_OK
+                                                     : neon::CMD_NO_DATA;
+            merged->outstanding = asked.size();
+            merged->callback = std::move(request.callback);
+            for (const unsigned int physical : asked) {
+                m_pending[{physical, service}].requests.push_back(
+                    {request.pid, [merged](CommandStatus ecu_status,
+                                           const EcuResults& ecu_results) {
+                         if (ecu_status == neon::CMD_OK) {
+                             merged->results.insert(ecu_results.begin(),
+                                                    ecu_results.end());
+                             merged->status = neon::CMD_OK;
+                         }
+                         if (--merged->outstanding == 0) {
+                             merged->callback(merged->status,
+                                              merged->results);
+                         }
+                     }});
+            }
+        } else if (found != pid_data.end()) {
+            request.callback(neon::CMD_OK, results);
+        } else if (fall_back) {
+            retry.push_back(std::move(request));
+        } else {
+            request.callback(status == neon::CMD_OK ? neon::CMD_NO_DATA
+                                                    : status,
+                             {});
+        }
+    }
+    for (const unsigned int header : retry_ecus) {
+        send_next_batch({physical_address(header), service});
+    }
+
+    // Keep the request marked in flight until here so that requests made
+    // from the callbacks queue behind the retries.
+    auto& pending = m_pending[batch.key];
+    pending.requests.insert(pending.requests.begin(),
+                            std::make_move_iterator(retry.begin()),
+                            std::make_move_iterator(retry.end()));
+    pending.in_flight = false;
+    pending.batch.reset();
+    send_next_batch(batch.key);
+}
 
-std::vector<Obd::ResultTypes>
-Obd::get_MIL_status_complete(std::span<unsigned char>& data) {
-    constexpr unsigned char GET_MIL_POSITIVE_RESPONSE = 0x41;
-    constexpr int DATA_SIZE = 5;
-    if (!check_response(data, DATA_SIZE, GET_MIL_POSITIVE_RESPONSE)) {
-        return {"ERROR"};
-    }
-    constexpr unsigned char MIL_MASK = 0x80;
-    std::vector<ResultTypes> fmt_result;
-    // MIL Status and DTC Count (Byte A)
-    fmt_result.push_back((data[1] & MIL_MASK) == MIL_MASK);
-    fmt_result.push_back(data[1] & ~MIL_MASK);
-    // Continuous Monitor Statuses (Misfire, Fuel System, Comprehensive)
-    process_monitor_statuses(fmt_result, data[2], data[2], 4, 3);
-    // Once-per-trip Monitor Statuses (Bytes C/D)
-    process_monitor_statuses(fmt_result, data[3], data[4], 0, 8);
-    data = data.subspan(DATA_SIZE);
-    return processedResult;
+Obd::Results Obd::decode_PID(unsigned char pid,
+                             std::span<const unsigned char> data) {
+    Results results;
+    results.count = decode_pid(pid, data, results.values);
+    return results;
 }
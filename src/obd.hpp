@@ -1,5 +1,5 @@
 /* This file is part of neonobd - OBD diagnostic software.
- * Copyright (C) 2024  Brian LePage
+ * Copyright (C) 2024-2026  Brian LePage
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -17,50 +17,401 @@
 
 #pragma once
 
-#include "connection.hpp"
+#include "event-loop.hpp"
+#include "hardware-interface.hpp"
 #include "obd-device.hpp"
+#include "obd-pids.hpp"
+#include "poll-scheduler.hpp"
+#include "profile-store.hpp"
+#include <bitset>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
-#include <queue>
-#include <sigc++/signal.h>
+#include <set>
 #include <span>
-#include <variant>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 class Obd {
   public:
-    sigc::signal<void(bool)>
-    init(const std::shared_ptr<ObdDevice>& obd_device,
-         const std::shared_ptr<HardwareInterface>& hwif);
-    sigc::signal<void()> disconnect();
+    // Values of the PID's fields, in PID_TABLE order.
+    using Results = PidValues;
+    // Decoded values from each ECU that answered, by response header.
+    using EcuResults = std::map<unsigned int, Results>;
+    using ResultCallback =
+        std::function<void(CommandStatus, const EcuResults&)>;
+
+    Obd() = default;
+    Obd(const Obd&) = delete;
+    Obd& operator=(const Obd&) = delete;
+    ~Obd();
+
+    void init(const std::shared_ptr<ObdDevice>& obd_device,
+              const std::shared_ptr<HardwareInterface>& hwif,
+              std::function<void(bool)> callback);
+    void disconnect(std::function<void()> callback);
+
+    // ECUs known to answer functional requests, and the PIDs each one
+    // supports, from an earlier connection.  Set before calling init().
+    void apply_profile(const VehicleProfile& profile);
+
+    // Add the service $01 PIDs found to be supported by each ECU.
+    void update_profile(VehicleProfile& profile) const;
+
+    // Keep what is learned about the adapter and each vehicle in store,
+    // which should already be loaded.  On init(), the profile last used
+    // with the adapter is applied here and to the device, and once the
+    // device is connected the VIN is read from vin_address, e.g. the
+    // functional address 7DF.  If it is another vehicle's VIN, that
+    // vehicle's profile is used instead, or if it has none, its ECUs
+    // and PIDs are discovered again.  Once disconnect completes, the
+    // profile is updated and the store saved.  Set before calling init().
+    void set_profile_store(ProfileStore* store, std::string adapter_id,
+                           unsigned int vin_address);
+
+    // VIN read when connecting, or empty if there is no profile store or
+    // the vehicle did not report it.
+    [[nodiscard]] const std::string& get_VIN() const { return m_profile.vin; }
+
+    // Request a PID from service $01 or $02 (freeze frame 0).  On CAN,
+    // requests that are waiting for the same ECU and service are sent
+    // together as one multi-PID request.  The callback gets the answer
+    // from every ECU, as soon as all the ECUs known to answer requests
+    // to ecu have done so.  On CAN, a functional request for a PID that
+    // only one ECU supports goes to that ECU's physical address instead,
+    // so no other ECU has to be waited for.
+    //
+    // The first request to an address and service first asks for the
+    // supported PID maps (PIDs 00, 20, 40, ...).  A PID that no ECU at
+    // the address supports is answered at once with CMD_NO_DATA.
+    //
+    // Answers to PIDs with a ttl in PID_TABLE are kept for that long,
+    // and later requests for them are answered at once from the cache.
+    void get_PID(unsigned int ecu, unsigned char service, unsigned char pid,
+                 ResultCallback callback);
+
+    // Answer to a PID awaited with read_PID().  The results are only
+    // valid until the awaiting coroutine next awaits.
+    struct PidReply {
+        CommandStatus status;
+        const EcuResults& results;
+    };
+
+    // Requests the PID when awaited, and resumes the coroutine from the
+    // request's callback.  Answers given at once, e.g. from the cache,
+    // do not outlive the callback, so they are copied to
+    // m_awaited_results, which only the next such answer replaces.  The
+    // callback reaches the awaiter through a pointer that the awaiter
+    // clears when it is destroyed, so the answer to a task destroyed
+    // while it awaits is dropped.
+    class PidAwaiter {
+      public:
+        PidAwaiter(Obd& obd, unsigned int ecu, unsigned char service,
+                   unsigned char pid)
+            : m_obd{obd}, m_ecu{ecu}, m_service{service}, m_pid{pid} {}
+        PidAwaiter(const PidAwaiter&) = delete;
+        PidAwaiter& operator=(const PidAwaiter&) = delete;
+        ~PidAwaiter() {
+            if (m_self) {
+                *m_self = nullptr;
+            }
+        }
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            m_handle = handle;
+            m_self = std::make_shared<PidAwaiter*>(this);
+            m_obd.get_PID(m_ecu, m_service, m_pid,
+                          [self = m_self](CommandStatus status,
+                                          const EcuResults& results) {
+                              if (*self != nullptr) {
+                                  (*self)->complete(status, results);
+                              }
+                          });
+            m_suspended = !m_done;
+            return m_suspended;
+        }
+        [[nodiscard]] PidReply await_resume() const {
+            return {m_status, *m_results};
+        }
+
+      private:
+        Obd& m_obd;
+        unsigned int m_ecu;
+        unsigned char m_service;
+        unsigned char m_pid;
+        std::coroutine_handle<> m_handle;
+        // Cleared when the awaiter is destroyed.
+        std::shared_ptr<PidAwaiter*> m_self;
+        bool m_suspended = false;
+        bool m_done = false;
+        CommandStatus m_status = neon::CMD_OK;
+        const EcuResults* m_results = nullptr;
+
+        void complete(CommandStatus status, const EcuResults& results) {
+            m_done = true;
+            m_status = status;
+            if (m_suspended) {
+                m_results = &results;
+                m_handle.resume();
+                return;
+            }
+            m_obd.m_awaited_results = results;
+            m_results = &m_obd.m_awaited_results;
+        }
+    };
+
+    // Request a PID from a coroutine (see Task), as get_PID() does:
+    //     auto [status, results] = co_await obd.read_PID(...);
+    PidAwaiter read_PID(unsigned int ecu, unsigned char service,
+                        unsigned char pid) {
+        return {*this, ecu, service, pid};
+    }
+
+    // PIDs the ECU answering from header supports for the service, or
+    // none if they are not known.
+    std::bitset<256> get_supported_PIDs(unsigned int header,
+                                        unsigned char service) const;
+
+    // Forget cached answers, e.g. after an ignition cycle.  Done on every
+    // connect and disconnect.
+    void invalidate_cache();
+
+    // Loop that runs the polling timers.  It must be the loop that
+    // dispatches the device's events.  Set before polling.
+    void set_event_loop(EventLoop* event_loop);
+
+    // Request a PID rate times a second, passing each answer to the
+    // callback, until stop_polling() is called.  Polls run while
+    // connected, scheduled as described for PollScheduler, with at most
+    // MAX_POLLS_IN_FLIGHT requested at a time.
+    static constexpr std::size_t MAX_POLLS_IN_FLIGHT = 6;
+    PollScheduler::Id poll_PID(unsigned int ecu, unsigned char service,
+                               unsigned char pid, double rate,
+                               ResultCallback callback);
+    void stop_polling(PollScheduler::Id id);
+    void set_poll_rate(PollScheduler::Id id, double rate);
+    const PollScheduler::Stats& get_poll_stats(PollScheduler::Id id) const;
+
+    // Receive a PID's answers at least rate times a second.  All the
+    // subscriptions to a PID share one poll, run at the highest rate any
+    // of them asks for, and each answer is passed to every subscriber.
+    // Unsubscribing is constant time, unless it is the fastest
+    // subscriber, and may be done from a subscriber's callback.
+    using SubscriptionId = std::size_t;
+    SubscriptionId subscribe(unsigned int ecu, unsigned char service,
+                             unsigned char pid, double rate,
+                             ResultCallback callback);
+    void unsubscribe(SubscriptionId id);
+    // Statistics of the poll shared by the subscription.
+    const PollScheduler::Stats&
+    get_subscription_stats(SubscriptionId id) const;
 
   private:
     std::shared_ptr<ObdDevice> m_obdDevice;
     std::shared_ptr<HardwareInterface> m_hwif;
     bool m_connected = false;
     bool m_connecting = false;
-    sigc::signal<void(bool)> m_init_signal;
-    Connection m_init_connection;
+    std::function<void(bool)> m_init_callback;
     bool m_is_CAN = false;
-    sigc::signal<void()> m_disconnect_signal;
-    Connection m_disconnect_connection;
+    std::function<void()> m_disconnect_callback;
     bool disconnecting = false;
 
-    using CommandResult =
-        const std::unordered_map<unsigned int, std::vector<unsigned char>>&;
-    using ResultTypes = std::variant<std::string, int, bool>;
-    using CommandCompleteFunction =
-        std::function<std::vector<ResultTypes>(std::span<unsigned char>&)>;
-    using ResultSignal = sigc::signal<void(std::vector<ResultTypes>&)>;
+    ProfileStore* m_profile_store = nullptr;
+    std::string m_adapter_id;
+    unsigned int m_vin_address = 0;
+    // Profile of the vehicle connected to, when there is a store.
+    VehicleProfile m_profile;
+
+    struct PidRequest {
+        unsigned char pid;
+        ResultCallback callback;
+    };
+
+    // Requests are queued per (ECU, service), with one request at a time
+    // in flight for each.
+    using BatchKey = std::pair<unsigned int, unsigned char>;
+    struct Batch;
+    struct PendingRequests {
+        std::deque<PidRequest> requests;
+        bool in_flight = false;
+        // The request in flight, so it can be cancelled on disconnect.
+        std::shared_ptr<Batch> batch;
+    };
+    std::map<BatchKey, PendingRequests> m_pending;
+
+    // ECUs that did not answer a multi-PID request.
+    std::set<unsigned int> m_no_batching;
+
+    // ECUs that rejected a multi-PID request to each functional address,
+    // by response header.  The PIDs they may support are requested on
+    // their own there, so they answer them too, and their rejections of
+    // multi-PID requests for other PIDs are ignored.
+    std::map<unsigned int, std::set<unsigned int>> m_rejecting;
+
+    // ECUs seen answering requests to each address.  Once all of them
+    // have answered, a request completes without waiting for the device
+    // to time out.  Every RELEARN_INTERVAL requests wait anyway, so that
+    // newly seen ECUs are added, and ECUs that did not answer a PID they
+    // support, e.g. because they are asleep, are dropped.
+    static constexpr unsigned int RELEARN_INTERVAL = 32;
+    struct Responders {
+        std::set<unsigned int> headers;
+        unsigned int requests = 0;
+    };
+    std::map<unsigned int, Responders> m_responders;
+
+    // ECUs that answered each PID at a functional address, by address,
+    // service and PID.  Every RELEARN_INTERVAL requests for a PID go to
+    // the functional address again.
+    using PidKey = std::tuple<unsigned int, unsigned char, unsigned char>;
+    struct PidRoute {
+        std::set<unsigned int> headers;
+        unsigned int requests = 0;
+    };
+    std::map<PidKey, PidRoute> m_pid_routes;
+
+    // PIDs supported by each ECU, by response header and service.  A
+    // supported PID map's own PID is set if the ECU answered it.
+    std::map<std::pair<unsigned int, unsigned char>, std::bitset<256>>
+        m_supported;
+
+    // Discovery of the PIDs supported at each address, by address and
+    // service.  Requests wait in it until the maps have been read.
+    struct Discovery {
+        bool done = false;
+        bool running = false;
+        // ECUs that answered, and the PIDs any of them supports.
+        std::set<unsigned int> headers;
+        std::bitset<256> pids;
+        std::bitset<256> requested;
+        std::size_t outstanding = 0;
+        CommandStatus status = neon::CMD_OK;
+        std::vector<PidRequest> waiting;
+    };
+    std::map<BatchKey, Discovery> m_discovery;
+
+    // Answers to PIDs with a ttl, by address, service and PID.
+    struct CachedResults {
+        EcuResults results;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::map<PidKey, CachedResults> m_cache;
+
+    // Answer given to a PidAwaiter before its coroutine suspended.
+    EcuResults m_awaited_results;
+
+    // Polls, by id.  The generation changes when a poll is stopped, so
+    // answers to the old poll are dropped.
+    struct Poll {
+        unsigned int ecu = 0;
+        unsigned char service = 0;
+        unsigned char pid = 0;
+        unsigned int generation = 0;
+        std::shared_ptr<ResultCallback> callback;
+    };
+    EventLoop* m_event_loop = nullptr;
+    PollScheduler m_poll_scheduler;
+    std::vector<Poll> m_polls;
+    std::vector<PollScheduler::Id> m_due_polls;
+    int m_poll_timer = -1;
+    bool m_running_polls = false;
+    bool m_run_polls_again = false;
+
+    // Subscriptions to each PID, by address, service and PID.  Each
+    // subscription knows its position in its feed, so it can be
+    // removed by moving the last subscriber into its place.  While the
+    // feed is passing on an answer, removed subscribers are only
+    // cleared, and are removed once it is done.
+    struct Subscriber {
+        SubscriptionId id;
+        double rate;
+        std::shared_ptr<ResultCallback> callback;
+    };
+    struct Feed {
+        PollScheduler::Id poll = 0;
+        double rate = 0;
+        std::vector<Subscriber> subscribers;
+        bool dispatching = false;
+        bool compact = false;
+    };
+    std::map<PidKey, Feed> m_feeds;
+    struct Subscription {
+        std::map<PidKey, Feed>::iterator feed;
+        std::size_t index = 0;
+        bool active = false;
+    };
+    std::vector<Subscription> m_subscriptions;
+    std::vector<SubscriptionId> m_free_subscriptions;
+
+    // Request answered by some ECUs at a functional address, waiting for
+    // the ECUs that rejected a multi-PID request to answer it on its own.
+    struct MergedRequest {
+        EcuResults results;
+        CommandStatus status = neon::CMD_OK;
+        std::size_t outstanding = 0;
+        ResultCallback callback;
+    };
 
-    std::queue<std::pair<ResultSignal, CommandCompleteFunction>>
-        m_command_queue;
+    // Data for each PID from each ECU that answered it.
+    using PidData =
+        std::map<unsigned char,
+                 std::map<unsigned int, std::span<const unsigned char>>>;
 
-    Connection m_command_connection;
+    // Multi-PID request sent to the device.
+    struct Batch {
+        BatchKey key;
+        std::vector<PidRequest> requests;
+        // Responses so far, if the batch may complete early.
+        std::map<unsigned int, std::vector<unsigned char>> responses;
+        CommandHandle handle;
+        bool done = false;
+    };
 
     void initComplete(bool success);
+    void read_VIN();
+    void vin_received(CommandStatus status, ObdDevice::CommandResult result);
+    void finish_init(bool success);
+    void use_profile(const VehicleProfile& profile);
+    void save_profile();
     void disconnectComplete();
-    void command_complete(CommandResult);
-    ResultSignal get_PID(unsigned char ecu, unsigned char service,
-                         unsigned char pid);
-    std::vector<ResultTypes>
-    get_MIL_status_complete(std::span<unsigned char>& data);
+    std::size_t max_batch_PIDs(const BatchKey& key) const;
+    void queue_PID(const BatchKey& key, unsigned char pid,
+                   ResultCallback callback);
+    void cache_results(const PidKey& key, const EcuResults& results);
+    void discover(const BatchKey& key, const std::vector<unsigned char>& pids);
+    void map_received(const BatchKey& key, unsigned char map_pid,
+                      CommandStatus status, const EcuResults& results);
+    void discovery_complete(const BatchKey& key);
+    void run_polls();
+    void poll_complete(PollScheduler::Id id, unsigned int generation,
+                       CommandStatus status, const EcuResults& results);
+    void arm_poll_timer();
+    void feed_answer(std::map<PidKey, Feed>::iterator feed,
+                     CommandStatus status, const EcuResults& results);
+    void remove_subscriber(std::map<PidKey, Feed>::iterator feed,
+                           std::size_t index);
+    void feed_changed(std::map<PidKey, Feed>::iterator feed);
+    bool may_support(unsigned int header, unsigned char service,
+                     unsigned char pid) const;
+    bool batchable(unsigned int ecu, unsigned char service,
+                   unsigned char pid) const;
+    unsigned int route(unsigned int ecu, unsigned char service,
+                       unsigned char pid);
+    void learn_routes(const Batch& batch, const PidData& pid_data);
+    void send_next_batch(const BatchKey& key);
+    void batch_frame(const std::shared_ptr<Batch>& batch, unsigned int header,
+                     std::span<const unsigned char> data);
+    void batch_complete(
+        Batch& batch, CommandStatus status,
+        const std::map<unsigned int, std::span<const unsigned char>>&
+            responses);
+    static Results decode_PID(unsigned char pid,
+                              std::span<const unsigned char> data);
 };
@@ -0,0 +1,181 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "poll-scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+namespace {
+// Weight of the newest interval in the smoothed interval.
+constexpr double INTERVAL_WEIGHT = 0.125;
+
+double rate(std::chrono::duration<double> interval) {
+    return interval.count() > 0 ? 1 / interval.count() : 0;
+}
+} // namespace
+
+PollScheduler::Id PollScheduler::add(Clock::duration period,
+                                     Clock::time_point now) {
+    if (period <= Clock::duration::zero()) {
+        throw std::invalid_argument("Poll period must be positive.");
+    }
+
+    Id id = m_polls.size();
+    if (m_free.empty()) {
+        m_polls.emplace_back();
+    } else {
+        id = m_free.back();
+        m_free.pop_back();
+    }
+
+    auto& poll = m_polls.at(id);
+    poll = Poll{};
+    poll.active = true;
+    poll.period = period;
+    poll.release = now;
+    poll.stats.requested_rate = rate(period);
+    ++m_size;
+    return id;
+}
+
+void PollScheduler::remove(Id id) {
+    auto& poll = m_polls.at(id);
+    if (!poll.active) {
+        return;
+    }
+    if (poll.in_flight) {
+        --m_in_flight;
+    }
+    poll = Poll{};
+    m_free.push_back(id);
+    --m_size;
+}
+
+void PollScheduler::set_period(Id id, Clock::duration period) {
+    if (period <= Clock::duration::zero()) {
+        throw std::invalid_argument("Poll period must be positive.");
+    }
+    auto& poll = m_polls.at(id);
+    // Keep the phase, but do not wait longer than the new period.
+    poll.release = std::min(poll.release, poll.release - poll.period + period);
+    poll.period = period;
+    poll.stats.requested_rate = rate(period);
+}
+
+void PollScheduler::take_due(std::size_t max_in_flight, std::vector<Id>& due,
+                             Clock::time_point now) {
+    due.clear();
+    if (m_in_flight >= max_in_flight) {
+        return;
+    }
+    for (Id id = 0; id < m_polls.size(); ++id) {
+        const auto& poll = m_polls[id];
+        if (poll.active && !poll.in_flight && poll.release <= now) {
+            due.push_back(id);
+        }
+    }
+
+    // Starved polls first, by how long they have waited, then the rest
+    // by period.
+    auto priority = [this, now](Id id) {
+        const auto& poll = m_polls[id];
+        const bool starved =
+            now - poll.release >= STARVED_PERIODS * poll.period;
+        return std::make_tuple(!starved,
+                               starved ? Clock::duration::zero() : poll.period,
+                               poll.release);
+    };
+    std::ranges::sort(due, [&priority](Id first, Id second) {
+        return priority(first) < priority(second);
+    });
+
+    due.resize(std::min(due.size(), max_in_flight - m_in_flight));
+    for (const Id id : due) {
+        m_polls[id].in_flight = true;
+    }
+    m_in_flight += due.size();
+}
+
+void PollScheduler::complete(Id id, bool success, Clock::time_point now) {
+    auto& poll = m_polls.at(id);
+    if (!poll.active || !poll.in_flight) {
+        return;
+    }
+    poll.in_flight = false;
+    --m_in_flight;
+
+    auto& stats = poll.stats;
+    if (!success) {
+        ++stats.failures;
+    } else {
+        if (stats.samples > 0) {
+            const auto interval = now - poll.last_sample;
+            stats.jitter.record(
+                std::chrono::abs(std::chrono::duration_cast<
+                                 LatencyHistogram::Duration>(interval -
+                                                             poll.period)));
+            const double seconds =
+                std::chrono::duration<double>(interval).count();
+            poll.interval = stats.samples == 1
+                                ? seconds
+                                : poll.interval +
+                                      INTERVAL_WEIGHT *
+                                          (seconds - poll.interval);
+            stats.achieved_rate =
+                rate(std::chrono::duration<double>(poll.interval));
+        }
+        ++stats.samples;
+        poll.last_sample = now;
+    }
+
+    // Skip whole periods that have passed, keeping the phase.
+    poll.release += poll.period;
+    if (poll.release < now) {
+        const auto missed = (now - poll.release) / poll.period;
+        stats.missed += static_cast<std::uint64_t>(missed);
+        poll.release += missed * poll.period;
+    }
+}
+
+std::optional<PollScheduler::Clock::time_point>
+PollScheduler::next_release() const {
+    std::optional<Clock::time_point> next;
+    for (const auto& poll : m_polls) {
+        if (poll.active && !poll.in_flight &&
+            (!next || poll.release < *next)) {
+            next = poll.release;
+        }
+    }
+    return next;
+}
+
+void PollScheduler::restart(Clock::time_point now) {
+    for (auto& poll : m_polls) {
+        poll.in_flight = false;
+        poll.release = now;
+    }
+    m_in_flight = 0;
+}
+
+const PollScheduler::Stats& PollScheduler::get_stats(Id id) const {
+    return m_polls.at(id).stats;
+}
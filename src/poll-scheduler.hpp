@@ -0,0 +1,95 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "latency-histogram.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Rate-monotonic scheduling of periodic polls over a link that carries
+// a limited number of requests at a time.  Each poll is released once
+// per period.  Of the released polls, the one with the shortest period
+// is sent first, so that when the link is saturated the slowest polls
+// lose rate first.  A poll that has waited STARVED_PERIODS periods past
+// its release goes ahead of all others, so that none stops altogether.
+// Releases missed while a poll was waiting are dropped rather than made
+// up.
+// Not thread safe; the owner provides locking.
+class PollScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Id = std::size_t;
+
+    static constexpr unsigned int STARVED_PERIODS = 4;
+
+    struct Stats {
+        // Polls per second asked for, and achieved (smoothed).
+        double requested_rate = 0;
+        double achieved_rate = 0;
+        std::uint64_t samples = 0;
+        std::uint64_t failures = 0;
+        // Releases dropped because the poll was still waiting.
+        std::uint64_t missed = 0;
+        // Difference between each interval between samples and the
+        // period.
+        LatencyHistogram jitter;
+    };
+
+    // The first release is now.  Ids of removed polls are reused.
+    Id add(Clock::duration period, Clock::time_point now = Clock::now());
+    void remove(Id id);
+    void set_period(Id id, Clock::duration period);
+
+    // Mark up to max_in_flight polls, less those still in flight, as
+    // sent and store their ids in due, highest priority first.
+    void take_due(std::size_t max_in_flight, std::vector<Id>& due,
+                  Clock::time_point now = Clock::now());
+
+    // A poll taken by take_due() has been answered (or failed).
+    void complete(Id id, bool success, Clock::time_point now = Clock::now());
+
+    // Release time of the next poll not in flight, if there is one.
+    [[nodiscard]] std::optional<Clock::time_point> next_release() const;
+
+    // Forget polls in flight, e.g. after a reconnect, and release every
+    // poll now.
+    void restart(Clock::time_point now = Clock::now());
+
+    [[nodiscard]] const Stats& get_stats(Id id) const;
+    [[nodiscard]] std::size_t in_flight() const { return m_in_flight; }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+
+  private:
+    struct Poll {
+        bool active = false;
+        bool in_flight = false;
+        Clock::duration period{};
+        Clock::time_point release;
+        Clock::time_point last_sample;
+        // Smoothed interval between samples.
+        double interval = 0;
+        Stats stats;
+    };
+
+    std::vector<Poll> m_polls;
+    std::vector<Id> m_free;
+    std::size_t m_in_flight = 0;
+    std::size_t m_size = 0;
+};
@@ -0,0 +1,328 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "profile-store.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// File format, all integers little endian:
+//   "NOBP", version (1 byte), profile count (2 bytes)
+//   per profile:
+//     adapter id, VIN, firmware, ST firmware (1 byte length + text each)
+//     extensions (4 bytes), protocol (1 byte), last used (8 bytes)
+//     ECU count (1 byte)
+//     per ECU: header (4 bytes), response time in us (4 bytes),
+//              supported PIDs (32 bytes, PID n is bit n % 8 of byte n / 8)
+
+namespace {
+constexpr std::string_view MAGIC = "NOBP";
+constexpr unsigned char VERSION = 1;
+constexpr unsigned int BITS_PER_BYTE = 8;
+constexpr std::size_t PID_BYTES = 256 / BITS_PER_BYTE;
+
+class Writer {
+  public:
+    template <typename T> void put(T value, std::size_t size) {
+        const auto bits = static_cast<std::uint64_t>(value);
+        for (std::size_t i = 0; i < size; ++i) {
+            m_data.push_back(static_cast<char>(bits >> (BITS_PER_BYTE * i)));
+        }
+    }
+
+    void put(std::string_view text) {
+        const auto size = std::min<std::size_t>(
+            text.size(), std::numeric_limits<unsigned char>::max());
+        put(size, 1);
+        m_data.append(text.substr(0, size));
+    }
+
+    [[nodiscard]] const std::string& data() const { return m_data; }
+
+  private:
+    std::string m_data;
+};
+
+class Reader {
+  public:
+    explicit Reader(std::string_view data) : m_data{data} {}
+
+    template <typename T> bool get(T& value, std::size_t size) {
+        if (m_data.size() < size) {
+            return false;
+        }
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            bits |= std::uint64_t{static_cast<unsigned char>(m_data[i])}
+                    << (BITS_PER_BYTE * i);
+        }
+        m_data.remove_prefix(size);
+        value = static_cast<T>(bits);
+        return true;
+    }
+
+    bool get(std::string& text) {
+        std::size_t size = 0;
+        if (!get(size, 1) || m_data.size() < size) {
+            return false;
+        }
+        text = m_data.substr(0, size);
+        m_data.remove_prefix(size);
+        return true;
+    }
+
+  private:
+    std::string_view m_data;
+};
+
+void write_profile(Writer& writer, const VehicleProfile& profile) {
+    writer.put(profile.adapter_id);
+    writer.put(profile.vin);
+    writer.put(profile.firmware);
+    writer.put(profile.st_firmware);
+    writer.put(profile.extensions, 4);
+    writer.put(profile.protocol, 1);
+    writer.put(profile.last_used, 8);
+
+    const auto ecu_count = std::min<std::size_t>(
+        profile.ecus.size(), std::numeric_limits<unsigned char>::max());
+    writer.put(ecu_count, 1);
+    for (std::size_t i = 0; i < ecu_count; ++i) {
+        const auto& ecu = profile.ecus[i];
+        writer.put(ecu.header, 4);
+        writer.put(std::min<std::chrono::microseconds::rep>(
+                       ecu.response_time.count(),
+                       std::numeric_limits<std::uint32_t>::max()),
+                   4);
+        for (std::size_t byte = 0; byte < PID_BYTES; ++byte) {
+            unsigned int bits = 0;
+            for (unsigned int bit = 0; bit < BITS_PER_BYTE; ++bit) {
+                bits |= (ecu.supported_pids[byte * BITS_PER_BYTE + bit] ? 1U
+                                                                       : 0U)
+                        << bit;
+            }
+            writer.put(bits, 1);
+        }
+    }
+}
+
+bool read_profile(Reader& reader, VehicleProfile& profile) {
+    std::size_t ecu_count = 0;
+    if (!reader.get(profile.adapter_id) || !reader.get(profile.vin) ||
+        !reader.get(profile.firmware) || !reader.get(profile.st_firmware) ||
+        !reader.get(profile.extensions, 4) || !reader.get(profile.protocol, 1) ||
+        !reader.get(profile.last_used, 8) || !reader.get(ecu_count, 1)) {
+        return false;
+    }
+
+    profile.ecus.resize(ecu_count);
+    for (auto& ecu : profile.ecus) {
+        std::uint32_t response_time = 0;
+        if (!reader.get(ecu.header, 4) || !reader.get(response_time, 4)) {
+            return false;
+        }
+        ecu.response_time = std::chrono::microseconds(response_time);
+        for (std::size_t byte = 0; byte < PID_BYTES; ++byte) {
+            unsigned int bits = 0;
+            if (!reader.get(bits, 1)) {
+                return false;
+            }
+            for (unsigned int bit = 0; bit < BITS_PER_BYTE; ++bit) {
+                ecu.supported_pids[byte * BITS_PER_BYTE + bit] =
+                    ((bits >> bit) & 1U) != 0;
+            }
+        }
+    }
+    return true;
+}
+std::string errno_message() {
+    return std::error_code(errno, std::generic_category()).message();
+}
+
+// Write data to a new file at path, and wait for it to reach the disk.
+bool write_synced(const std::filesystem::path& path, std::string_view data) {
+    static constexpr mode_t FILE_MODE = 0644;
+    const int fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+               FILE_MODE);
+    if (fd < 0) {
+        Logger::error << "Failed to open " << path.string() << ": "
+                      << errno_message() << "\n";
+        return false;
+    }
+
+    bool written = true;
+    while (!data.empty()) {
+        const auto count = ::write(fd, data.data(), data.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            written = false;
+            break;
+        }
+        data.remove_prefix(static_cast<std::size_t>(count));
+    }
+    written = written && ::fsync(fd) == 0;
+    if (!written) {
+        Logger::error << "Failed to write " << path.string() << ": "
+                      << errno_message() << "\n";
+    }
+    ::close(fd);
+    return written;
+}
+} // namespace
+
+ProfileStore::ProfileStore(std::filesystem::path path)
+    : m_path{std::move(path)} {}
+
+bool ProfileStore::load() {
+    m_profiles.clear();
+
+    std::ifstream file(m_path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    const std::string data{std::istreambuf_iterator<char>(file),
+                           std::istreambuf_iterator<char>()};
+
+    Reader reader(data);
+    std::string magic(MAGIC.size(), '\0');
+    for (auto& character : magic) {
+        reader.get(character, 1);
+    }
+    unsigned int version = 0;
+    std::size_t count = 0;
+    if (magic != MAGIC || !reader.get(version, 1) || version != VERSION ||
+        !reader.get(count, 2)) {
+        Logger::error << "Invalid profile store " << m_path.string() << ".\n";
+        return false;
+    }
+
+    std::vector<VehicleProfile> profiles(count);
+    for (auto& profile : profiles) {
+        if (!read_profile(reader, profile)) {
+            Logger::error << "Profile store " << m_path.string()
+                          << " is truncated.\n";
+            return false;
+        }
+    }
+    m_profiles = std::move(profiles);
+    return true;
+}
+
+bool ProfileStore::save() const {
+    Writer writer;
+    for (const auto character : MAGIC) {
+        writer.put(character, 1);
+    }
+    writer.put(VERSION, 1);
+    writer.put(m_profiles.size(), 2);
+    for (const auto& profile : m_profiles) {
+        write_profile(writer, profile);
+    }
+
+    // The new file is on the disk before it replaces the old one, and the
+    // directory is synced so the rename is too; a crash leaves one or
+    // the other.
+    auto temp_path = m_path;
+    temp_path += ".tmp";
+    if (!write_synced(temp_path, writer.data())) {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, m_path, error);
+    if (error) {
+        Logger::error << "Failed to replace " << m_path.string() << ": "
+                      << error.message() << "\n";
+        return false;
+    }
+
+    const auto directory =
+        m_path.has_parent_path() ? m_path.parent_path() : ".";
+    const int dir_fd =
+        ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0 || ::fsync(dir_fd) < 0) {
+        Logger::error << "Failed to sync " << directory.string() << ": "
+                      << errno_message() << "\n";
+        if (dir_fd >= 0) {
+            ::close(dir_fd);
+        }
+        return false;
+    }
+    ::close(dir_fd);
+    return true;
+}
+
+const VehicleProfile* ProfileStore::find(const std::string& adapter_id) const {
+    const VehicleProfile* latest = nullptr;
+    for (const auto& profile : m_profiles) {
+        if (profile.adapter_id == adapter_id &&
+            (latest == nullptr || profile.last_used > latest->last_used)) {
+            latest = &profile;
+        }
+    }
+    return latest;
+}
+
+const VehicleProfile* ProfileStore::find(const std::string& adapter_id,
+                                         const std::string& vin) const {
+    const auto profile =
+        std::ranges::find_if(m_profiles, [&](const auto& entry) {
+            return entry.adapter_id == adapter_id && entry.vin == vin;
+        });
+    return profile == m_profiles.end() ? nullptr : &*profile;
+}
+
+void ProfileStore::update(VehicleProfile profile) {
+    profile.last_used = std::chrono::duration_cast<std::chrono::seconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+
+    const auto existing =
+        std::ranges::find_if(m_profiles, [&profile](const auto& entry) {
+            return entry.adapter_id == profile.adapter_id &&
+                   entry.vin == profile.vin;
+        });
+    if (existing != m_profiles.end()) {
+        *existing = std::move(profile);
+        return;
+    }
+
+    if (m_profiles.size() >= MAX_PROFILES) {
+        const auto oldest = std::ranges::min_element(
+            m_profiles, {}, [](const auto& entry) { return entry.last_used; });
+        m_profiles.erase(oldest);
+    }
+    m_profiles.push_back(std::move(profile));
+}
@@ -0,0 +1,96 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <bitset>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Adapter features found when identifying the adapter.
+enum AdapterExtension : std::uint32_t {
+    // Response count suffix on OBD commands (ELM327 v1.3 and later).
+    EXTENSION_RESPONSE_COUNT = 1U << 0,
+    // STN chip ST commands.
+    EXTENSION_ST_COMMANDS = 1U << 1,
+};
+
+struct EcuProfile {
+    unsigned int header = 0;
+    // Slowest (99th percentile) response time seen.
+    std::chrono::microseconds response_time{0};
+    // Service $01 PIDs supported by the ECU.
+    std::bitset<256> supported_pids;
+
+    bool operator==(const EcuProfile&) const = default;
+};
+
+// What was learned about a vehicle, and the adapter used to connect to
+// it, so that later connections can skip discovery.
+struct VehicleProfile {
+    // Identifies the adapter, e.g. its Bluetooth address or device path.
+    std::string adapter_id;
+    std::string vin;
+    // Response to ATI, and to STI on STN chips.
+    std::string firmware;
+    std::string st_firmware;
+    std::uint32_t extensions = 0;
+    // Protocol number, as reported by ATDPN.
+    int protocol = 0;
+    std::vector<EcuProfile> ecus;
+    // Seconds since the epoch.
+    std::int64_t last_used = 0;
+
+    bool operator==(const VehicleProfile&) const = default;
+};
+
+// Vehicle profiles, kept in a compact binary file.  The least recently
+// used profiles are dropped once MAX_PROFILES is reached.
+class ProfileStore {
+  public:
+    static constexpr std::size_t MAX_PROFILES = 64;
+
+    explicit ProfileStore(std::filesystem::path path);
+
+    // Returns false if the file is missing or not valid; the store is
+    // then empty.
+    bool load();
+
+    // The file is replaced atomically, and is on the disk once save()
+    // returns true.
+    bool save() const;
+
+    // Most recently used profile for the adapter, e.g. to connect before
+    // the VIN is known.
+    const VehicleProfile* find(const std::string& adapter_id) const;
+
+    const VehicleProfile* find(const std::string& adapter_id,
+                               const std::string& vin) const;
+
+    // Add the profile, or replace the one for the same adapter and VIN.
+    // last_used is set to the current time.
+    void update(VehicleProfile profile);
+
+    [[nodiscard]] std::size_t size() const { return m_profiles.size(); }
+
+  private:
+    std::filesystem::path m_path;
+    std::vector<VehicleProfile> m_profiles;
+};
@@ -203,9 +203,10 @@ bool SerialPort::connect(const std::string& device_name,
 }
 
 void SerialPort::set_timeout(std::chrono::milliseconds timeout) {
+    // VTIME counts whole deciseconds, and zero makes reads return at once,
+    // so round up.
     const std::chrono::duration<int64_t, std::deci> deciseconds =
-        std::chrono::duration_cast<std::chrono::duration<int64_t, std::deci>>(
-            timeout);
+        std::chrono::ceil<std::chrono::duration<int64_t, std::deci>>(timeout);
 
     m_timeout = (deciseconds.count() > UCHAR_MAX)
                     ? UCHAR_MAX
@@ -0,0 +1,838 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "socket-can-device.hpp"
+#include "frame-set.hpp"
+#include "hardware-interface.hpp"
+#include "latency-histogram.hpp"
+#include "logger.hpp"
+#include "neonobd_exceptions.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <linux/can.h>
+#include <linux/can/isotp.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <memory>
+#include <mutex>
+#include <net/if.h>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+// ISO 15765-4 diagnostic CAN identifiers.
+constexpr unsigned int FUNCTIONAL_11BIT = 0x7DF;
+constexpr unsigned int PHYSICAL_11BIT = 0x7E0;
+constexpr unsigned int RESPONSE_11BIT = 0x7E8;
+constexpr unsigned int ECU_COUNT_11BIT = 8;
+constexpr unsigned int FUNCTIONAL_29BIT = 0x18DB33F1;
+// Target address in bits 8-15.
+constexpr unsigned int PHYSICAL_29BIT = 0x18DA00F1;
+// Source address in bits 0-7.
+constexpr unsigned int RESPONSE_29BIT = 0x18DAF100;
+constexpr unsigned int BITS_PER_BYTE = 8;
+constexpr unsigned int ADDRESS_MASK = 0xFF;
+constexpr unsigned int BLOCK_11BIT_MASK = 0x7F8;
+constexpr unsigned int PHYSICAL_29BIT_MASK = 0x1FFF00FF;
+constexpr unsigned int RESPONSE_29BIT_MASK = 0x1FFFFF00;
+
+// Only diagnostic requests and responses are received.  Requests are
+// needed to see our own, which carry the time they were sent.
+// Matching the flags keeps 11 and 29 bit filters apart, and drops
+// remote frames.
+constexpr canid_t FLAGS_MASK = CAN_EFF_FLAG | CAN_RTR_FLAG;
+const std::array<can_filter, 6> FILTERS{{
+    {RESPONSE_11BIT, BLOCK_11BIT_MASK | FLAGS_MASK},
+    {PHYSICAL_11BIT, BLOCK_11BIT_MASK | FLAGS_MASK},
+    {FUNCTIONAL_11BIT, CAN_SFF_MASK | FLAGS_MASK},
+    {RESPONSE_29BIT | CAN_EFF_FLAG, RESPONSE_29BIT_MASK | FLAGS_MASK},
+    {FUNCTIONAL_29BIT | CAN_EFF_FLAG, CAN_EFF_MASK | FLAGS_MASK},
+    {PHYSICAL_29BIT | CAN_EFF_FLAG, PHYSICAL_29BIT_MASK | FLAGS_MASK},
+}};
+
+// ISO 15765-2 protocol control information (upper nibble of first byte)
+constexpr unsigned char SINGLE_FRAME = 0;
+constexpr unsigned char FIRST_FRAME = 1;
+constexpr std::size_t MAX_SINGLE_FRAME_DATA = CAN_MAX_DLEN - 1;
+constexpr unsigned int BITS_PER_NIBBLE = 4;
+constexpr unsigned char NIBBLE_MASK = 0x0F;
+
+constexpr unsigned char NEGATIVE_RESPONSE = 0x7F;
+constexpr unsigned char RESPONSE_PENDING = 0x78;
+
+bool is_functional(unsigned int request) {
+    return request == FUNCTIONAL_11BIT || request == FUNCTIONAL_29BIT;
+}
+
+bool is_response(unsigned int request, unsigned int header) {
+    if (request == FUNCTIONAL_11BIT) {
+        return header >= RESPONSE_11BIT &&
+               header < RESPONSE_11BIT + ECU_COUNT_11BIT;
+    }
+    if (request >= PHYSICAL_11BIT &&
+        request < PHYSICAL_11BIT + ECU_COUNT_11BIT) {
+        return header == request + (RESPONSE_11BIT - PHYSICAL_11BIT);
+    }
+    if (request == FUNCTIONAL_29BIT) {
+        return (header & RESPONSE_29BIT_MASK) == RESPONSE_29BIT;
+    }
+    if ((request & PHYSICAL_29BIT_MASK) == PHYSICAL_29BIT) {
+        return header ==
+               (RESPONSE_29BIT | ((request >> BITS_PER_BYTE) & ADDRESS_MASK));
+    }
+    return false;
+}
+
+bool is_physical(unsigned int request) {
+    return (request >= PHYSICAL_11BIT &&
+            request < PHYSICAL_11BIT + ECU_COUNT_11BIT) ||
+           (request & PHYSICAL_29BIT_MASK) == PHYSICAL_29BIT;
+}
+
+// The physical request ID of the ECU that answers from response.
+unsigned int request_for(unsigned int response) {
+    if (response >= RESPONSE_11BIT &&
+        response < RESPONSE_11BIT + ECU_COUNT_11BIT) {
+        return response - (RESPONSE_11BIT - PHYSICAL_11BIT);
+    }
+    return PHYSICAL_29BIT | ((response & ADDRESS_MASK) << BITS_PER_BYTE);
+}
+
+// The response ID of the ECU a physical request goes to.
+unsigned int response_for(unsigned int request) {
+    if (request < PHYSICAL_11BIT + ECU_COUNT_11BIT) {
+        return request + (RESPONSE_11BIT - PHYSICAL_11BIT);
+    }
+    return RESPONSE_29BIT | ((request >> BITS_PER_BYTE) & ADDRESS_MASK);
+}
+
+canid_t can_id(unsigned int header) {
+    return header > CAN_SFF_MASK ? header | CAN_EFF_FLAG : header;
+}
+
+unsigned int frame_header(const can_frame& frame) {
+    return (frame.can_id & CAN_EFF_FLAG) != 0 ? frame.can_id & CAN_EFF_MASK
+                                               : frame.can_id & CAN_SFF_MASK;
+}
+
+std::chrono::nanoseconds to_duration(const timespec& time) {
+    return std::chrono::seconds(time.tv_sec) +
+           std::chrono::nanoseconds(time.tv_nsec);
+}
+} // namespace
+
+SocketCanDevice::SocketCanDevice(std::string interface_name)
+    : m_interface_name{std::move(interface_name)} {}
+
+SocketCanDevice::~SocketCanDevice() {
+    if (m_command_thread) {
+        m_disconnect_in_progress = true;
+        m_cmd_semaphore.release();
+        m_command_thread->join();
+    }
+    close_socket();
+}
+
+void SocketCanDevice::init(HardwareInterface* /*hwif*/,
+                           std::function<void(bool)> callback) {
+    if (m_init_complete || m_init_callback || m_command_thread) {
+        throw neon::InvalidState("Invalid state to issue init request.");
+    }
+
+    m_init_callback = std::move(callback);
+    if (open_socket()) {
+        m_init_complete = true;
+        m_command_thread =
+            std::make_unique<std::thread>([this]() { command_thread(); });
+    }
+    signal_event("InitDone");
+}
+
+bool SocketCanDevice::open_socket() {
+    try {
+        m_socket = ::socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+        if (m_socket < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to create CAN socket");
+        }
+
+        const unsigned int index = if_nametoindex(m_interface_name.c_str());
+        m_interface_index = static_cast<int>(index);
+        if (index == 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Unknown CAN interface " +
+                                        m_interface_name);
+        }
+
+        // Our own requests are received back, timestamped when they went
+        // out on the bus.
+        const int enable = 1;
+        if (setsockopt(m_socket, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &enable,
+                       sizeof(enable)) < 0 ||
+            setsockopt(m_socket, SOL_CAN_RAW, CAN_RAW_FILTER, FILTERS.data(),
+                       sizeof(FILTERS)) < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to configure CAN socket");
+        }
+
+        // Not every controller has hardware timestamps, and turning them
+        // on needs CAP_NET_ADMIN; the kernel's are used otherwise.
+        hwtstamp_config hw_config{};
+        hw_config.tx_type = HWTSTAMP_TX_OFF;
+        hw_config.rx_filter = HWTSTAMP_FILTER_ALL;
+        ifreq request{};
+        m_interface_name.copy(request.ifr_name, IFNAMSIZ - 1);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        request.ifr_data = reinterpret_cast<char*>(&hw_config);
+        if (ioctl(m_socket, SIOCSHWTSTAMP, &request) < 0) {
+            Logger::debug << "No hardware timestamps on " << m_interface_name
+                          << ".\n";
+        }
+        const unsigned int timestamping =
+            SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+            SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (setsockopt(m_socket, SOL_SOCKET, SO_TIMESTAMPING, &timestamping,
+                       sizeof(timestamping)) < 0) {
+            Logger::info << "CAN timestamps unavailable on "
+                         << m_interface_name << ".\n";
+        }
+
+        sockaddr_can address{};
+        address.can_family = AF_CAN;
+        address.can_ifindex = m_interface_index;
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        if (bind(m_socket, reinterpret_cast<sockaddr*>(&address),
+                 sizeof(address)) < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to bind CAN socket to " +
+                                        m_interface_name);
+        }
+
+        // All 11 bit ECUs can answer a functional request with a
+        // multi-frame response, so their channels must be ready before
+        // it is sent.  29 bit ECUs get theirs once they are seen.
+        for (unsigned int i = 0; i < ECU_COUNT_11BIT; ++i) {
+            get_iso_tp_channel(RESPONSE_11BIT + i);
+        }
+    } catch (const std::system_error& e) {
+        Logger::error << e.what() << "\n";
+        m_error_string = e.what();
+        close_socket();
+        return false;
+    }
+    return true;
+}
+
+void SocketCanDevice::close_socket() {
+    close_iso_tp_channels();
+    if (m_socket >= 0) {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
+
+SocketCanDevice::IsoTpChannel*
+SocketCanDevice::get_iso_tp_channel(unsigned int response) {
+    const auto found =
+        std::ranges::find(m_iso_tp_channels, response, &IsoTpChannel::response);
+    if (found != m_iso_tp_channels.end()) {
+        return found->socket >= 0 ? &*found : nullptr;
+    }
+
+    const unsigned int request = request_for(response);
+    int channel = ::socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC, CAN_ISOTP);
+
+    // ISO 15765-4 wants every frame padded to 8 bytes.
+    can_isotp_options options{};
+    options.flags = CAN_ISOTP_TX_PADDING;
+    const can_isotp_fc_options flow_control{.bs = m_iso_tp_options.block_size,
+                                            .stmin = m_iso_tp_options.st_min,
+                                            .wftmax = 0};
+    sockaddr_can address{};
+    address.can_family = AF_CAN;
+    address.can_ifindex = m_interface_index;
+    address.can_addr.tp.tx_id = can_id(request);
+    address.can_addr.tp.rx_id = can_id(response);
+
+    if (channel < 0 ||
+        setsockopt(channel, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &options,
+                   sizeof(options)) < 0 ||
+        setsockopt(channel, SOL_CAN_ISOTP, CAN_ISOTP_RECV_FC, &flow_control,
+                   sizeof(flow_control)) < 0 ||
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        bind(channel, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) < 0) {
+        Logger::info << "No ISO-TP socket for " << std::hex << response
+                     << std::dec << ": " << std::strerror(errno) << "\n";
+        if (channel >= 0) {
+            close(channel);
+        }
+        channel = -1;
+    }
+
+    m_iso_tp_channels.push_back({request, response, channel, false});
+    return channel >= 0 ? &m_iso_tp_channels.back() : nullptr;
+}
+
+void SocketCanDevice::close_iso_tp_channels() {
+    for (const auto& channel : m_iso_tp_channels) {
+        if (channel.socket >= 0) {
+            close(channel.socket);
+        }
+    }
+    m_iso_tp_channels.clear();
+    m_receiving = 0;
+}
+
+void SocketCanDevice::set_iso_tp_options(IsoTpOptions options) {
+    if (m_init_complete || m_init_callback || m_command_thread) {
+        throw neon::InvalidState("Invalid state to change ISO-TP options.");
+    }
+    m_iso_tp_options = options;
+}
+
+std::string SocketCanDevice::get_error_string() const {
+    return m_error_string;
+}
+
+void SocketCanDevice::process_event(std::string_view event) {
+    if (event == "CommandComplete") {
+        command_complete();
+    } else if (event == "CommandFrame") {
+        frame_complete();
+    } else if (event == "InitDone") {
+        init_done();
+    } else if (event == "CommandThreadExit") {
+        command_thread_exit();
+    }
+}
+
+void SocketCanDevice::init_done() {
+    auto callback = std::move(m_init_callback);
+    m_init_callback = nullptr;
+    callback(m_init_complete);
+}
+
+CommandHandle SocketCanDevice::send_command(
+    unsigned int obd_address, unsigned char obd_service,
+    std::span<const unsigned char> obd_data, CommandCallback callback,
+    CommandOptions options) {
+
+    if (!m_init_complete || m_disconnect_in_progress) {
+        if (callback) {
+            callback(neon::CMD_CANCELLED, {});
+        }
+        return {};
+    }
+
+    const auto timeout =
+        options.timeout.count() > 0 ? options.timeout : RESPONSE_TIMEOUT;
+    Command command{obd_address,
+                    obd_service,
+                    {},
+                    std::move(callback),
+                    std::move(options.frame_callback),
+                    timeout,
+                    std::make_shared<std::atomic<bool>>(false)};
+    command.obd_data.assign(obd_data);
+    auto cancelled = command.cancelled;
+
+    const std::scoped_lock lock(m_cmd_queue_lock);
+    m_cmd_queue.push(obd_address, std::move(command), options.priority,
+                     options.deadline);
+    m_cmd_semaphore.release();
+    return CommandHandle(std::move(cancelled));
+}
+
+bool SocketCanDevice::is_connecting() const {
+    return m_init_callback != nullptr;
+}
+
+bool SocketCanDevice::is_connected() const { return m_init_complete; }
+
+void SocketCanDevice::disconnect(std::function<void()> callback) {
+    if (m_disconnect_in_progress || !m_init_complete || m_disconnect_callback) {
+        throw neon::InvalidState("Invalid state to issue disconnect request.");
+    }
+
+    m_disconnect_in_progress = true;
+    m_cmd_semaphore.release();
+    m_init_complete = false;
+    m_disconnect_callback = std::move(callback);
+}
+
+LatencyHistogram SocketCanDevice::get_response_times() const {
+    const std::scoped_lock lock(m_stats_lock);
+    return m_response_times;
+}
+
+void SocketCanDevice::send_completion(Completion&& completion) {
+    const std::lock_guard lock(m_completion_queue_lock);
+    m_completion_queue.push_back(std::move(completion));
+}
+
+std::optional<SocketCanDevice::Command> SocketCanDevice::get_next_cmd() {
+    const std::lock_guard lock(m_cmd_queue_lock);
+    const auto now = std::chrono::steady_clock::now();
+    while (auto expired = m_cmd_queue.take_expired(now)) {
+        send_completion(Completion{neon::CMD_EXPIRED,
+                                   {},
+                                   std::move(expired->callback),
+                                   std::move(expired->cancelled)});
+        signal_event("CommandComplete");
+    }
+    // There is no header to switch, so commands simply go in priority
+    // and deadline order.
+    return m_cmd_queue.pop(0, now);
+}
+
+FrameSet SocketCanDevice::get_frame_set() {
+    const std::lock_guard lock(m_pool_lock);
+    if (m_frame_set_pool.empty()) {
+        return {};
+    }
+    auto frames = std::move(m_frame_set_pool.back());
+    m_frame_set_pool.pop_back();
+    return frames;
+}
+
+void SocketCanDevice::command_thread() {
+    while (!m_disconnect_in_progress) {
+        m_cmd_semaphore.acquire();
+        while (!m_disconnect_in_progress) {
+            auto next = get_next_cmd();
+            if (!next) {
+                break;
+            }
+            auto& command = *next;
+            if (*command.cancelled) {
+                send_completion(Completion{neon::CMD_CANCELLED,
+                                           {},
+                                           std::move(command.callback),
+                                           std::move(command.cancelled)});
+                signal_event("CommandComplete");
+                continue;
+            }
+
+            m_current_completion = Completion{};
+            m_current_completion.frames = get_frame_set();
+            send_can_command(command);
+            m_current_completion.callback = std::move(command.callback);
+            m_current_completion.cancelled = std::move(command.cancelled);
+            send_completion(std::move(m_current_completion));
+            signal_event("CommandComplete");
+        }
+    }
+    signal_event("CommandThreadExit");
+}
+
+void SocketCanDevice::send_can_command(const Command& command) {
+    drain();
+
+    m_request_time = {};
+    m_current_completion.status = neon::CMD_OK;
+    if (command.obd_data.size() + 1 > MAX_SINGLE_FRAME_DATA) {
+        if (!send_iso_tp_command(command)) {
+            return;
+        }
+    } else {
+        can_frame frame{};
+        frame.can_id = can_id(command.obd_address);
+        frame.len = CAN_MAX_DLEN;
+        const auto payload = std::span(frame.data);
+        payload[0] = static_cast<unsigned char>(command.obd_data.size() + 1);
+        payload[1] = command.obd_service;
+        std::ranges::copy(command.obd_data, payload.subspan(2).begin());
+
+        if (::write(m_socket, &frame, sizeof(frame)) !=
+            static_cast<ssize_t>(sizeof(frame))) {
+            // The transmit queue fills up while the bus is busy.
+            m_current_completion.status =
+                errno == ENOBUFS ? neon::CMD_BUS_BUSY : neon::CMD_BUS_ERROR;
+            Logger::error << "CAN write failed: " << std::strerror(errno)
+                          << "\n";
+            return;
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + command.timeout;
+    m_transfer_deadline = deadline;
+    bool answered = false;
+    // A cancelled command, e.g. one whose caller already has every
+    // answer it expects, stops waiting.
+    while (!answered && !m_disconnect_in_progress && !*command.cancelled) {
+        const auto now = std::chrono::steady_clock::now();
+        // Multi-frame responses that have started may finish late.
+        const auto end =
+            m_receiving > 0 ? std::max(deadline, m_transfer_deadline)
+                            : deadline;
+        if (now >= end) {
+            break;
+        }
+        if (!wait_for_frames(
+                std::min<std::chrono::nanoseconds>(end - now, POLL_INTERVAL))) {
+            continue;
+        }
+        answered = receive_iso_tp(command);
+        const auto count = receive_batch();
+        for (std::size_t i = 0; i < count && !answered; ++i) {
+            answered = process_frame(command, i, deadline);
+        }
+    }
+
+    if (m_receiving > 0) {
+        Logger::error << "Multi-frame response did not complete.\n";
+        m_current_completion.status = neon::CMD_RX_ERROR;
+        for (auto& channel : m_iso_tp_channels) {
+            channel.receiving = false;
+        }
+        m_receiving = 0;
+    }
+    if (m_current_completion.status == neon::CMD_OK &&
+        m_current_completion.frames.empty()) {
+        m_current_completion.status = neon::CMD_NO_DATA;
+    }
+}
+
+bool SocketCanDevice::send_iso_tp_command(const Command& command) {
+    // ISO 15765-4 only allows single frame functional requests.
+    auto* channel = is_physical(command.obd_address)
+                        ? get_iso_tp_channel(response_for(command.obd_address))
+                        : nullptr;
+    const auto size = command.obd_data.size() + 1;
+    if (channel == nullptr || size > ISO_TP_MAX_DATA) {
+        Logger::error << "Cannot send a multi-frame request to " << std::hex
+                      << command.obd_address << std::dec << ".\n";
+        m_current_completion.status = neon::CMD_ERROR;
+        return false;
+    }
+
+    m_iso_tp_buffer[0] = command.obd_service;
+    std::ranges::copy(command.obd_data, m_iso_tp_buffer.begin() + 1);
+    // The kernel sends the first frame, then the rest as the ECU's flow
+    // control allows.
+    if (::write(channel->socket, m_iso_tp_buffer.data(), size) !=
+        static_cast<ssize_t>(size)) {
+        m_current_completion.status =
+            errno == ENOBUFS ? neon::CMD_BUS_BUSY : neon::CMD_BUS_ERROR;
+        Logger::error << "ISO-TP write failed: " << std::strerror(errno)
+                      << "\n";
+        return false;
+    }
+    return true;
+}
+
+void SocketCanDevice::drain() {
+    // Late responses to an earlier request are not mistaken for answers.
+    while (receive_batch() > 0) {
+    }
+
+    // The channels also receive every single frame response, which has
+    // already been handled from the raw socket.
+    if (!wait_for_frames(std::chrono::nanoseconds(0), true)) {
+        return;
+    }
+    for (std::size_t i = 1; i < m_poll_fds.size(); ++i) {
+        if (m_poll_fds[i].revents == 0) {
+            continue;
+        }
+        for (std::size_t count = 0; count < RECEIVE_BATCH; ++count) {
+            if (recv(m_poll_fds[i].fd, m_iso_tp_buffer.data(),
+                     m_iso_tp_buffer.size(), MSG_DONTWAIT) < 0 &&
+                errno == EAGAIN) {
+                break;
+            }
+        }
+    }
+}
+
+bool SocketCanDevice::wait_for_frames(std::chrono::nanoseconds timeout,
+                                      bool all_channels) {
+    m_poll_fds.clear();
+    m_poll_channels.clear();
+    m_poll_fds.push_back({.fd = m_socket, .events = POLLIN, .revents = 0});
+    for (std::size_t i = 0; i < m_iso_tp_channels.size(); ++i) {
+        const auto& channel = m_iso_tp_channels[i];
+        if (channel.socket >= 0 && (all_channels || channel.receiving)) {
+            m_poll_fds.push_back(
+                {.fd = channel.socket, .events = POLLIN, .revents = 0});
+            m_poll_channels.push_back(i);
+        }
+    }
+
+    const auto seconds = std::chrono::floor<std::chrono::seconds>(timeout);
+    const timespec wait{.tv_sec = seconds.count(),
+                        .tv_nsec = (timeout - seconds).count()};
+    return ppoll(m_poll_fds.data(), m_poll_fds.size(), &wait, nullptr) > 0;
+}
+
+std::size_t SocketCanDevice::receive_batch() {
+    for (std::size_t i = 0; i < RECEIVE_BATCH; ++i) {
+        auto& iov = m_receive.iov.at(i);
+        iov.iov_base = &m_receive.frames.at(i);
+        iov.iov_len = sizeof(can_frame);
+        auto& header = m_receive.messages.at(i).msg_hdr;
+        header = {};
+        header.msg_iov = &iov;
+        header.msg_iovlen = 1;
+        header.msg_control = m_receive.control.at(i).data();
+        header.msg_controllen = ReceiveBuffers::CONTROL_SIZE;
+    }
+
+    const int count = recvmmsg(m_socket, m_receive.messages.data(),
+                               RECEIVE_BATCH, MSG_DONTWAIT, nullptr);
+    return count > 0 ? static_cast<std::size_t>(count) : 0;
+}
+
+bool SocketCanDevice::receive_iso_tp(const Command& command) {
+    bool answered = false;
+    for (std::size_t i = 1; i < m_poll_fds.size(); ++i) {
+        if (m_poll_fds[i].revents == 0) {
+            continue;
+        }
+        auto& channel = m_iso_tp_channels[m_poll_channels[i - 1]];
+
+        // Skip single frames from this ECU, such as "response pending",
+        // that came before its multi-frame response.
+        ssize_t size = 0;
+        do {
+            size = recv(channel.socket, m_iso_tp_buffer.data(),
+                        m_iso_tp_buffer.size(), MSG_DONTWAIT);
+        } while (size >= 0 &&
+                 static_cast<std::size_t>(size) <= MAX_SINGLE_FRAME_DATA);
+        if (size < 0 && errno == EAGAIN) {
+            continue;
+        }
+
+        channel.receiving = false;
+        --m_receiving;
+        if (size < 0) {
+            Logger::error << "Multi-frame response from " << std::hex
+                          << channel.response << std::dec
+                          << " failed: " << std::strerror(errno) << "\n";
+            m_current_completion.status = neon::CMD_RX_ERROR;
+            continue;
+        }
+        answered |= add_response(
+            command, channel.response,
+            std::span(m_iso_tp_buffer).first(static_cast<std::size_t>(size)));
+    }
+    return answered;
+}
+
+SocketCanDevice::FrameTime SocketCanDevice::frame_time(msghdr& message) {
+    FrameTime time;
+    for (auto* control = CMSG_FIRSTHDR(&message); control != nullptr;
+         control = CMSG_NXTHDR(&message, control)) {
+        if (control->cmsg_level == SOL_SOCKET &&
+            control->cmsg_type == SCM_TIMESTAMPING) {
+            scm_timestamping stamps{};
+            std::memcpy(&stamps, CMSG_DATA(control), sizeof(stamps));
+            // Software stamp first, then the raw hardware stamp.
+            time.software = to_duration(stamps.ts[0]);
+            time.hardware = to_duration(stamps.ts[2]);
+        }
+    }
+    return time;
+}
+
+bool SocketCanDevice::process_frame(
+    const Command& command, std::size_t index,
+    std::chrono::steady_clock::time_point& deadline) {
+    auto& message = m_receive.messages.at(index);
+    const auto& frame = m_receive.frames.at(index);
+    if (message.msg_len != sizeof(can_frame)) {
+        return false;
+    }
+    const auto time = frame_time(message.msg_hdr);
+    const unsigned int header = frame_header(frame);
+
+    if ((static_cast<unsigned int>(message.msg_hdr.msg_flags) &
+         static_cast<unsigned int>(MSG_CONFIRM)) != 0) {
+        if (header == command.obd_address) {
+            m_request_time = time;
+        }
+        return false;
+    }
+
+    if (!is_response(command.obd_address, header) || frame.len == 0) {
+        return false;
+    }
+
+    const auto bytes = std::span(frame.data).first(frame.len);
+    const auto pci = static_cast<unsigned char>(bytes[0] >> BITS_PER_NIBBLE);
+    if (pci == FIRST_FRAME) {
+        record_response_time(time);
+        first_frame(header);
+        return false;
+    }
+    // Consecutive frames and flow control are left to the kernel.
+    if (pci != SINGLE_FRAME) {
+        return false;
+    }
+    const auto length = static_cast<std::size_t>(bytes[0] & NIBBLE_MASK);
+    if (length == 0 || length >= bytes.size()) {
+        m_current_completion.status = neon::CMD_ERROR;
+        return false;
+    }
+
+    record_response_time(time);
+    // Opens a channel for a newly seen 29 bit ECU, ready for its
+    // multi-frame responses.
+    get_iso_tp_channel(header);
+    const auto data = bytes.subspan(1, length);
+    // The ECU needs more time, and will answer later.
+    static constexpr std::size_t NRC_INDEX = 2;
+    if (data.size() > NRC_INDEX && data[0] == NEGATIVE_RESPONSE &&
+        data[NRC_INDEX] == RESPONSE_PENDING) {
+        deadline = std::chrono::steady_clock::now() + PENDING_TIMEOUT;
+        return false;
+    }
+
+    return add_response(command, header, data);
+}
+
+void SocketCanDevice::first_frame(unsigned int header) {
+    auto* channel = get_iso_tp_channel(header);
+    if (channel == nullptr) {
+        Logger::error << "Cannot receive multi-frame response from "
+                      << std::hex << header << std::dec << ".\n";
+        m_current_completion.status = neon::CMD_ERROR;
+        return;
+    }
+    if (!channel->receiving) {
+        channel->receiving = true;
+        ++m_receiving;
+    }
+    m_transfer_deadline =
+        std::max(m_transfer_deadline,
+                 std::chrono::steady_clock::now() + TRANSFER_TIMEOUT);
+}
+
+bool SocketCanDevice::add_response(const Command& command,
+                                   unsigned int header,
+                                   std::span<const unsigned char> data) {
+    m_current_completion.frames.append(header, data);
+    if (command.frame_callback && !*command.cancelled) {
+        FrameCompletion frame_completion{
+            header, {}, command.frame_callback, command.cancelled};
+        frame_completion.data.assign(data);
+        {
+            const std::lock_guard lock(m_completion_queue_lock);
+            m_frame_queue.push_back(std::move(frame_completion));
+        }
+        signal_event("CommandFrame");
+    }
+
+    // Only the addressed ECU answers a physical request.
+    return !is_functional(command.obd_address);
+}
+
+void SocketCanDevice::record_response_time(const FrameTime& response) {
+    std::chrono::nanoseconds elapsed{0};
+    if (m_request_time.hardware.count() > 0 && response.hardware.count() > 0) {
+        elapsed = response.hardware - m_request_time.hardware;
+    } else if (m_request_time.software.count() > 0 &&
+               response.software.count() > 0) {
+        elapsed = response.software - m_request_time.software;
+    } else {
+        return;
+    }
+    const std::scoped_lock lock(m_stats_lock);
+    m_response_times.record(elapsed);
+}
+
+namespace {
+template <typename T> T get_next(std::vector<T>& queue, std::mutex& mutex) {
+    const std::lock_guard lock(mutex);
+    auto result = std::move(queue.front());
+    queue.erase(queue.begin());
+    return result;
+}
+} // namespace
+
+void SocketCanDevice::command_complete() {
+    auto cpl = get_next(m_completion_queue, m_completion_queue_lock);
+    if (cpl.callback) {
+        if (*cpl.cancelled) {
+            cpl.callback(neon::CMD_CANCELLED, {});
+        } else {
+            cpl.callback(cpl.status, cpl.frames.frames());
+        }
+    }
+
+    cpl.frames.clear();
+    const std::lock_guard lock(m_pool_lock);
+    m_frame_set_pool.push_back(std::move(cpl.frames));
+}
+
+void SocketCanDevice::frame_complete() {
+    auto frame = get_next(m_frame_queue, m_completion_queue_lock);
+    if (!*frame.cancelled) {
+        frame.callback(frame.header, frame.data);
+    }
+}
+
+void SocketCanDevice::command_thread_exit() {
+    m_command_thread->join();
+    m_command_thread.reset();
+    close_socket();
+    m_disconnect_in_progress = false;
+    cancel_queued_commands();
+    auto callback = std::move(m_disconnect_callback);
+    m_disconnect_callback = nullptr;
+    callback();
+}
+
+void SocketCanDevice::cancel_queued_commands() {
+    // Every command gets its callback, even if the device goes away
+    // before sending it.  Commands sent from these callbacks are
+    // cancelled at once.
+    std::vector<CommandCallback> callbacks;
+    for (auto& completion : m_completion_queue) {
+        callbacks.push_back(std::move(completion.callback));
+    }
+    while (auto command = m_cmd_queue.pop(0)) {
+        callbacks.push_back(std::move(command->callback));
+    }
+    m_completion_queue.clear();
+    m_frame_queue.clear();
+    for (const auto& callback : callbacks) {
+        if (callback) {
+            callback(neon::CMD_CANCELLED, {});
+        }
+    }
+}
@@ -0,0 +1,224 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "command-scheduler.hpp"
+#include "frame-set.hpp"
+#include "hardware-interface.hpp"
+#include "latency-histogram.hpp"
+#include "obd-device.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <linux/can.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <semaphore>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+// OBD device on a SocketCAN interface, e.g. a native CAN controller or
+// vcan for testing.  Addressing follows ISO 15765-4: 11 bit requests to
+// 7DF (functional) or 7E0-7E7 (physical) are answered from 7E8-7EF, and
+// 29 bit requests to 18DB33F1 or 18DAxxF1 are answered from 18DAF1xx.
+// Multi-frame messages go through the kernel's ISO-TP sockets, which
+// send and receive flow control without waking us for every frame;
+// functional requests must fit in a single frame.
+class SocketCanDevice : public ObdDevice {
+  public:
+    explicit SocketCanDevice(std::string interface_name);
+    SocketCanDevice(const SocketCanDevice&) = delete;
+    SocketCanDevice& operator=(const SocketCanDevice&) = delete;
+    ~SocketCanDevice() override;
+
+    // hwif is not used; the device owns its socket.
+    void init(HardwareInterface* hwif,
+              std::function<void(bool)> callback) override;
+
+    std::string get_error_string() const override;
+
+    CommandHandle send_command(unsigned int obd_address,
+                               unsigned char obd_service,
+                               std::span<const unsigned char> obd_data,
+                               CommandCallback callback,
+                               CommandOptions options) override;
+
+    bool is_CAN() const override { return true; }
+
+    bool is_connecting() const override;
+
+    bool is_connected() const override;
+
+    void disconnect(std::function<void()> callback) override;
+
+    // Time from each request going out on the bus until each response
+    // arrived.  Uses the controller's hardware timestamps when the
+    // driver provides them, and the kernel's otherwise.
+    LatencyHistogram get_response_times() const;
+
+    // Flow control we send while receiving a multi-frame response:
+    // frames per block (0 for no limit), and separation time between
+    // frames, encoded as in ISO 15765-2.
+    struct IsoTpOptions {
+        unsigned char block_size = 0;
+        unsigned char st_min = 0;
+    };
+
+    // Only while disconnected; used from the next connection.
+    void set_iso_tp_options(IsoTpOptions options);
+    IsoTpOptions get_iso_tp_options() const { return m_iso_tp_options; }
+
+  private:
+    using CancelFlag = std::shared_ptr<std::atomic<bool>>;
+
+    static constexpr std::size_t INLINE_DATA = 8;
+    // ISO 15765-4 P2CAN, and P2*CAN once an ECU asks for more time.
+    static constexpr std::chrono::milliseconds RESPONSE_TIMEOUT{50};
+    static constexpr std::chrono::milliseconds PENDING_TIMEOUT{5000};
+    // Receives wake up at least this often, to check for disconnect.
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{50};
+    // Frames read with one recvmmsg() call.
+    static constexpr std::size_t RECEIVE_BATCH = 16;
+    // Longest wait for the rest of a multi-frame response once its first
+    // frame has arrived; the kernel gives up on a stalled one sooner.
+    static constexpr std::chrono::milliseconds TRANSFER_TIMEOUT{2000};
+    static constexpr std::size_t ISO_TP_MAX_DATA = 4095;
+
+    struct Command {
+        unsigned int obd_address;
+        unsigned char obd_service;
+        SmallBuffer<unsigned char, INLINE_DATA> obd_data;
+        CommandCallback callback;
+        FrameCallback frame_callback;
+        std::chrono::milliseconds timeout;
+        CancelFlag cancelled;
+    };
+
+    struct Completion {
+        CommandStatus status = neon::CMD_OK;
+        FrameSet frames;
+        CommandCallback callback;
+        CancelFlag cancelled;
+    };
+
+    struct FrameCompletion {
+        unsigned int header;
+        SmallBuffer<unsigned char, FrameSet::INLINE_BYTES> data;
+        FrameCallback callback;
+        CancelFlag cancelled;
+    };
+
+    // Kernel timestamps of a frame.  Zero if not provided.
+    struct FrameTime {
+        std::chrono::nanoseconds software{0};
+        std::chrono::nanoseconds hardware{0};
+    };
+
+    // recvmmsg() buffers, with room for a timestamp per frame.
+    struct ReceiveBuffers {
+        static constexpr std::size_t CONTROL_SIZE = 64;
+
+        std::array<can_frame, RECEIVE_BATCH> frames{};
+        std::array<iovec, RECEIVE_BATCH> iov{};
+        std::array<mmsghdr, RECEIVE_BATCH> messages{};
+        alignas(cmsghdr) std::array<std::array<char, CONTROL_SIZE>,
+                                    RECEIVE_BATCH> control{};
+    };
+
+    // Kernel ISO-TP socket for one ECU's request and response IDs.  The
+    // socket is -1 if it could not be opened.
+    struct IsoTpChannel {
+        unsigned int request;
+        unsigned int response;
+        int socket;
+        bool receiving;
+    };
+
+    void process_event(std::string_view event) override;
+
+    std::string m_interface_name;
+    int m_interface_index = 0;
+    int m_socket = -1;
+    volatile bool m_disconnect_in_progress = false;
+    std::function<void()> m_disconnect_callback = nullptr;
+    std::function<void(bool)> m_init_callback = nullptr;
+    bool m_init_complete = false;
+    std::string m_error_string;
+    std::mutex m_cmd_queue_lock;
+    std::binary_semaphore m_cmd_semaphore{0};
+    CommandScheduler<Command> m_cmd_queue;
+    std::unique_ptr<std::thread> m_command_thread;
+    std::mutex m_completion_queue_lock;
+    std::vector<Completion> m_completion_queue;
+    std::vector<FrameCompletion> m_frame_queue;
+    std::mutex m_pool_lock;
+    std::vector<FrameSet> m_frame_set_pool;
+    mutable std::mutex m_stats_lock;
+    LatencyHistogram m_response_times;
+    IsoTpOptions m_iso_tp_options;
+
+    // Only used by the command thread
+    ReceiveBuffers m_receive;
+    Completion m_current_completion;
+    FrameTime m_request_time;
+    std::vector<IsoTpChannel> m_iso_tp_channels;
+    // Raw socket first, then the channels in m_poll_channels.
+    std::vector<pollfd> m_poll_fds;
+    std::vector<std::size_t> m_poll_channels;
+    std::size_t m_receiving = 0;
+    std::chrono::steady_clock::time_point m_transfer_deadline;
+    std::array<unsigned char, ISO_TP_MAX_DATA> m_iso_tp_buffer{};
+
+    bool open_socket();
+    void close_socket();
+    IsoTpChannel* get_iso_tp_channel(unsigned int response);
+    void close_iso_tp_channels();
+    void init_done();
+    void send_completion(Completion&& completion);
+    std::optional<Command> get_next_cmd();
+    FrameSet get_frame_set();
+    void command_thread();
+    void send_can_command(const Command& command);
+    bool send_iso_tp_command(const Command& command);
+    bool wait_for_frames(std::chrono::nanoseconds timeout,
+                         bool all_channels = false);
+    std::size_t receive_batch();
+    bool receive_iso_tp(const Command& command);
+    void drain();
+    // Kernel timestamps of a received frame, from its control messages.
+    static FrameTime frame_time(msghdr& message);
+    bool process_frame(const Command& command, std::size_t index,
+                       std::chrono::steady_clock::time_point& deadline);
+    void first_frame(unsigned int header);
+    bool add_response(const Command& command, unsigned int header,
+                      std::span<const unsigned char> data);
+    void record_response_time(const FrameTime& response);
+    void command_complete();
+    void frame_complete();
+    void command_thread_exit();
+    void cancel_queued_commands();
+};
@@ -0,0 +1,86 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "task.hpp"
+#include "logger.hpp"
+#include <cstddef>
+#include <exception>
+#include <new>
+
+namespace {
+// Index of the size class that holds frames of size bytes.
+std::size_t size_class(std::size_t size) {
+    return (size + FramePool::SIZE_STEP - 1) / FramePool::SIZE_STEP;
+}
+} // namespace
+
+FramePool::~FramePool() {
+    for (auto& list : m_free) {
+        while (list.head != nullptr) {
+            auto* frame = list.head;
+            list.head = frame->next;
+            ::operator delete(frame);
+        }
+    }
+}
+
+FramePool& FramePool::local() {
+    thread_local FramePool pool;
+    return pool;
+}
+
+void* FramePool::allocate(std::size_t size) {
+    const std::size_t index = size_class(size);
+    if (index < SIZE_CLASSES && m_free.at(index).head != nullptr) {
+        auto& list = m_free.at(index);
+        auto* frame = list.head;
+        list.head = frame->next;
+        --list.count;
+        return frame;
+    }
+    ++m_allocations;
+    // Allocate the whole size class, so the frame can be reused by any
+    // coroutine of that class.
+    return ::operator new(index < SIZE_CLASSES ? index * SIZE_STEP : size);
+}
+
+void FramePool::deallocate(void* frame, std::size_t size) noexcept {
+    const std::size_t index = size_class(size);
+    if (index >= SIZE_CLASSES || m_free.at(index).count >= MAX_FREE_FRAMES) {
+        ::operator delete(frame);
+        return;
+    }
+    auto& list = m_free.at(index);
+    list.head = new (frame) FreeFrame{list.head};
+    ++list.count;
+}
+
+void task_detail::PromiseBase::unhandled_exception() {
+    if (!detached) {
+        exception = std::current_exception();
+        return;
+    }
+    try {
+        throw;
+    } catch (const std::exception& error) {
+        Logger::error << "Unhandled exception in task: " << error.what()
+                      << "\n";
+    } catch (...) {
+        Logger::error << "Unhandled exception in task.\n";
+    }
+    std::terminate();
+}
@@ -0,0 +1,200 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Free lists of coroutine frames, by size in steps of SIZE_STEP bytes.
+// A freed frame is kept for the next coroutine of its size, so a
+// sequence that runs again and again stops allocating.  Up to
+// MAX_FREE_FRAMES frames of each size are kept; larger frames are not
+// pooled.  There is one pool per thread, and a frame must be freed on
+// the thread that allocated it.
+class FramePool {
+  public:
+    static constexpr std::size_t SIZE_STEP = 64;
+    static constexpr std::size_t SIZE_CLASSES = 32;
+    static constexpr std::size_t MAX_FREE_FRAMES = 64;
+
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    ~FramePool();
+
+    static FramePool& local();
+
+    void* allocate(std::size_t size);
+    void deallocate(void* frame, std::size_t size) noexcept;
+
+    // Frames allocated from the system, for measuring reuse.
+    [[nodiscard]] std::size_t allocations() const { return m_allocations; }
+
+  private:
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+    struct FreeList {
+        FreeFrame* head = nullptr;
+        std::size_t count = 0;
+    };
+    std::array<FreeList, SIZE_CLASSES> m_free{};
+    std::size_t m_allocations = 0;
+};
+
+template <typename T = void> class Task;
+
+namespace task_detail {
+struct PromiseBase {
+    // Resumed when the task completes, if it is awaited.
+    std::coroutine_handle<> continuation;
+    // A started task frees its own frame when it completes.
+    bool detached = false;
+    std::exception_ptr exception;
+
+    static void* operator new(std::size_t size) {
+        return FramePool::local().allocate(size);
+    }
+    static void operator delete(void* frame, std::size_t size) noexcept {
+        FramePool::local().deallocate(frame, size);
+    }
+
+    struct FinalAwaiter {
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto& promise = handle.promise();
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            if (promise.detached) {
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception();
+};
+
+template <typename T> struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    template <typename U> void return_value(U&& result) {
+        value.emplace(std::forward<U>(result));
+    }
+    T result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template <> struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() const {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+} // namespace task_detail
+
+// Coroutine that runs a multi-step sequence, e.g. of OBD commands,
+// written as straight-line code.  A task does not run until it is
+// awaited, which runs it to completion and gives its result (or
+// rethrows its exception), or until start() runs it on its own.
+//
+// Commands are awaited with ObdDevice::command() and Obd::read_PID(),
+// which resume the task from the command's callback, i.e. on the event
+// loop's thread.  Commands dropped on disconnect complete with
+// CMD_CANCELLED, so every awaiting task is resumed.  A task may be
+// destroyed while it awaits a command, on the event loop's thread: the
+// command is cancelled and its answer dropped.  A started task has no
+// owner, so it always runs to completion.
+template <typename T> class Task {
+  public:
+    using promise_type = task_detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : m_handle{handle} {}
+    Task(Task&& other) noexcept
+        : m_handle{std::exchange(other.m_handle, nullptr)} {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { destroy(); }
+
+    // Run the task until its first suspension, and leave it to free
+    // itself when it completes.  An exception that escapes a started task
+    // is logged and terminates the program, as with std::thread.
+    void start() && {
+        auto handle = std::exchange(m_handle, nullptr);
+        handle.promise().detached = true;
+        handle.resume();
+    }
+
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().result(); }
+    };
+    Awaiter operator co_await() && { return Awaiter{m_handle}; }
+
+  private:
+    std::coroutine_handle<promise_type> m_handle;
+
+    void destroy() {
+        if (m_handle) {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+};
+
+namespace task_detail {
+template <typename T> Task<T> Promise<T>::get_return_object() {
+    return Task<T>{std::coroutine_handle<Promise<T>>::from_promise(*this)};
+}
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>{
+        std::coroutine_handle<Promise<void>>::from_promise(*this)};
+}
+} // namespace task_detail
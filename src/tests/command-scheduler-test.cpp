@@ -0,0 +1,127 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "command-scheduler.hpp"
+#include "logger.hpp"
+#include "neonobd_types.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+using Scheduler = CommandScheduler<int>;
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+// Pop everything, tracking the header like Elm327 does.
+static std::vector<int> drain(Scheduler& scheduler, unsigned int header,
+                              Scheduler::Clock::time_point now) {
+    std::vector<int> order;
+    while (auto command = scheduler.pop(header, now)) {
+        order.push_back(*command);
+        // Commands are numbered header * 10 + n.
+        header = static_cast<unsigned int>(*command / 10);
+    }
+    return order;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    const auto now = Scheduler::Clock::now();
+    Scheduler scheduler;
+    bool passed = true;
+
+    passed &= check("Empty", !scheduler.pop(1, now));
+
+    // Interleaved traffic for two headers is grouped.
+    for (const int command : {11, 21, 12, 22, 13, 23}) {
+        scheduler.push(static_cast<unsigned int>(command / 10), command);
+    }
+    passed &= check("Grouping", drain(scheduler, 1, now) ==
+                                    std::vector<int>{11, 12, 13, 21, 22, 23});
+
+    // Commands beyond the window are not considered.
+    for (int i = 0; i < static_cast<int>(Scheduler::WINDOW); ++i) {
+        scheduler.push(2, 20 + i);
+    }
+    scheduler.push(1, 11);
+    passed &= check("Window", scheduler.pop(1, now) == 20);
+    scheduler.clear();
+
+    // A command is passed over a limited number of times.
+    scheduler.push(2, 21);
+    for (int i = 0; i <= static_cast<int>(Scheduler::MAX_BYPASS); ++i) {
+        scheduler.push(1, 11 + i);
+    }
+    std::vector<int> order;
+    for (unsigned int i = 0; i <= Scheduler::MAX_BYPASS; ++i) {
+        order.push_back(scheduler.pop(1, now).value_or(0));
+    }
+    passed &= check("Bypass limit", order.back() == 21);
+    scheduler.clear();
+
+    // A command with a near deadline is not passed over.
+    scheduler.push(2, 21, neon::PRIORITY_NORMAL, now + 10ms);
+    scheduler.push(1, 11);
+    passed &= check("Deadline", scheduler.pop(1, now) == 21);
+
+    scheduler.clear();
+    scheduler.push(2, 21, neon::PRIORITY_NORMAL, now + 1s);
+    scheduler.push(1, 11);
+    passed &= check("Distant deadline", scheduler.pop(1, now) == 11);
+    scheduler.clear();
+
+    // Higher priorities go first, whatever the header.
+    scheduler.push(1, 11, neon::PRIORITY_LOW);
+    scheduler.push(1, 12);
+    scheduler.push(2, 21, neon::PRIORITY_HIGH);
+    passed &= check("Priority",
+                    drain(scheduler, 1, now) == std::vector<int>{21, 12, 11});
+
+    // Earliest deadline first within a priority, FIFO without deadlines.
+    scheduler.push(1, 11);
+    scheduler.push(1, 12, neon::PRIORITY_NORMAL, now + 2s);
+    scheduler.push(1, 13, neon::PRIORITY_NORMAL, now + 1s);
+    scheduler.push(1, 14);
+    passed &= check("Earliest deadline first",
+                    drain(scheduler, 1, now) ==
+                        std::vector<int>{13, 12, 11, 14});
+
+    // Expired commands are removed before anything is sent.
+    scheduler.push(1, 11, neon::PRIORITY_LOW, now - 1ms);
+    scheduler.push(1, 12, neon::PRIORITY_HIGH, now + 1s);
+    scheduler.push(1, 13, neon::PRIORITY_HIGH, now - 2ms);
+    passed &= check("Expired", scheduler.take_expired(now) == 13 &&
+                                   scheduler.take_expired(now) == 11 &&
+                                   !scheduler.take_expired(now) &&
+                                   scheduler.size() == 1);
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "elm327.hpp"
+#include "event-loop.hpp"
+#include "frame-set.hpp"
+#include "hardware-interface.hpp"
+#include "logger.hpp"
+#include "neonobd_types.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+// Allocations made by any thread while counting is on.
+static std::atomic<bool> counting{false};
+static std::atomic<std::size_t> allocations{0};
+
+// NOLINTBEGIN(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+void* operator new(std::size_t size) {
+    if (counting) {
+        ++allocations;
+    }
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t /*size*/) noexcept {
+    std::free(memory);
+}
+// NOLINTEND(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+
+// Emulates an ELM327 answering every OBD command with an engine speed
+// response from two ECUs, without allocating.
+class QuietAdapter : public HardwareInterface {
+  public:
+    bool connect(const std::string& /*device_name*/,
+                 std::function<void(bool)> callback) override {
+        callback(true);
+        return true;
+    }
+    void respond_from_user(const ResponseVariant& /*response*/,
+                           void* /*handle*/) override {}
+
+  protected:
+    size_t read(char* buf, std::size_t size) override {
+        const std::scoped_lock lock(m_lock);
+        const auto count = std::min(size, m_output.size());
+        std::copy_n(m_output.begin(), count, buf);
+        m_output.remove_prefix(count);
+        return count;
+    }
+
+    size_t write(const char* buf, std::size_t size) override {
+        const std::scoped_lock lock(m_lock);
+        const std::string_view command(buf, size);
+        if (command.starts_with("ATZ") || command.starts_with("ATI")) {
+            m_output = "\r\rELM327 v1.5\r\r>";
+        } else if (command.starts_with("ATDPN")) {
+            m_output = "A6\r\r>";
+        } else if (command.starts_with("AT")) {
+            m_output = "OK\r\r>";
+        } else if (command.starts_with("ST")) {
+            m_output = "?\r\r>";
+        } else {
+            m_output = "7E8 04 41 0C 1A F8 \r7E9 04 41 0C 1A F8 \r\r>";
+        }
+        return size;
+    }
+
+  private:
+    std::mutex m_lock;
+    std::string_view m_output;
+};
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+static bool wait(EventLoop& loop, const bool& done) {
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (!done) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            Logger::error << "Timeout waiting for ELM327.\n";
+            return false;
+        }
+        loop.run_once(1s);
+    }
+    return true;
+}
+
+static bool frame_set_test() {
+    bool passed = true;
+
+    FrameSet frames;
+    const std::array<unsigned char, 3> first{0x41, 0x0C, 0x1A};
+    const std::array<unsigned char, 2> second{0x41, 0x0D};
+    const std::array<unsigned char, 1> rest{0xF8};
+
+    allocations = 0;
+    counting = true;
+    frames.append(0x7E8, first);
+    frames.append(0x7E9, second);
+    frames.append(0x7E8, rest);
+    const auto result = frames.frames();
+    counting = false;
+
+    const std::array<unsigned char, 4> merged{0x41, 0x0C, 0x1A, 0xF8};
+    passed &= check("Inline frames", allocations == 0);
+    passed &= check("Frame order", result.size() == 2 &&
+                                       result[0].header == 0x7E8 &&
+                                       result[1].header == 0x7E9);
+    passed &= check("Merged frame",
+                    result.size() == 2 &&
+                        std::ranges::equal(result[0].data, merged) &&
+                        std::ranges::equal(result[1].data, second));
+
+    // A large response spills to the heap, which is kept for reuse.
+    const std::vector<unsigned char> vin(FrameSet::INLINE_BYTES * 2, 0x31);
+    frames.clear();
+    frames.append(0x7E8, vin);
+    frames.clear();
+    allocations = 0;
+    counting = true;
+    frames.append(0x7E8, vin);
+    const auto spilled = frames.frames();
+    counting = false;
+    passed &= check("Reused heap storage", allocations == 0);
+    passed &= check("Spilled frame", spilled.size() == 1 &&
+                                         std::ranges::equal(spilled[0].data,
+                                                            vin));
+    return passed;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    bool passed = frame_set_test();
+
+    QuietAdapter adapter;
+    Elm327 elm;
+    EventLoop loop;
+    loop.add_event_handler(elm);
+
+    bool done = false;
+    bool connected = false;
+    elm.init(&adapter, [&done, &connected](bool success) {
+        done = true;
+        connected = success;
+    });
+    if (!check("Init", wait(loop, done) && connected)) {
+        return 1;
+    }
+
+    // One poll: request engine speed and wait for both ECUs.
+    static constexpr std::array<unsigned char, 1> RPM{0x0C};
+    std::size_t frame_count = 0;
+    CommandStatus status = neon::CMD_ERROR;
+    auto poll = [&]() {
+        done = false;
+        elm.send_command(
+            0x7DF, 1, RPM,
+            [&done, &frame_count](CommandStatus result,
+                                  ObdDevice::CommandResult frames) {
+                done = result == neon::CMD_OK;
+                frame_count = frames.size();
+            },
+            {});
+        status = wait(loop, done) ? neon::CMD_OK : neon::CMD_ERROR;
+    };
+
+    // Let the response count, timing, pools and queues settle.
+    static constexpr int WARMUP_POLLS = 50;
+    for (int i = 0; i < WARMUP_POLLS; ++i) {
+        poll();
+    }
+
+    static constexpr int POLLS = 200;
+    allocations = 0;
+    counting = true;
+    for (int i = 0; i < POLLS && status == neon::CMD_OK; ++i) {
+        poll();
+    }
+    counting = false;
+
+    passed &= check("Polls", status == neon::CMD_OK && frame_count == 2);
+    Logger::info << allocations.load() << " allocations in " << POLLS
+                 << " polls.\n";
+    passed &= check("No allocations", allocations == 0);
+
+    done = false;
+    elm.disconnect([&done]() { done = true; });
+    passed &= check("Disconnect", wait(loop, done));
+    loop.remove_event_handler(elm);
+
+    return passed ? 0 : 1;
+}
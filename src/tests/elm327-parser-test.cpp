@@ -0,0 +1,198 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "elm327-parser.hpp"
+#include "logger.hpp"
+#include "neonobd_types.hpp"
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+using Frame = std::pair<unsigned int, std::vector<unsigned char>>;
+using Frames = std::vector<Frame>;
+
+class ParserTest {
+  public:
+    ParserTest()
+        : m_parser{[this](unsigned int header,
+                          std::span<const unsigned char> data) {
+              m_frames.emplace_back(
+                  header, std::vector<unsigned char>(data.begin(), data.end()));
+          }} {}
+
+    // Feed the response in chunks of chunk_size bytes.
+    bool run(int protocol, std::string_view command, std::string_view response,
+             std::size_t chunk_size = 0) {
+        m_frames.clear();
+        m_parser.set_protocol(protocol);
+        m_parser.begin(command);
+
+        if (chunk_size == 0) {
+            chunk_size = response.size();
+        }
+
+        bool prompt = false;
+        for (std::size_t pos = 0; pos < response.size(); pos += chunk_size) {
+            prompt = m_parser.feed(response.substr(pos, chunk_size));
+        }
+        return prompt;
+    }
+
+    [[nodiscard]] const Frames& frames() const { return m_frames; }
+    Elm327Parser& parser() { return m_parser; }
+
+  private:
+    Frames m_frames;
+    Elm327Parser m_parser;
+};
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+static const Frames SUPPORTED_PIDS = {
+    {0x7E8, {0x41, 0x00, 0xBE, 0x3F, 0xA8, 0x13}},
+    {0x7E9, {0x41, 0x00, 0x98, 0x18, 0x80, 0x01}}};
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    static constexpr int CAN_11BIT = 6;
+    static constexpr int CAN_29BIT = 7;
+    static constexpr int ISO_9141 = 3;
+
+    ParserTest test;
+    bool passed = true;
+
+    static constexpr std::string_view SPACES =
+        "7E8 06 41 00 BE 3F A8 13 \r7E9 06 41 00 98 18 80 01 \r\r>";
+    passed &= check("Spaces", test.run(CAN_11BIT, "0100", SPACES) &&
+                                  test.frames() == SUPPORTED_PIDS &&
+                                  test.parser().get_status() == neon::CMD_OK);
+
+    passed &= check("No spaces",
+                    test.run(CAN_11BIT, "0100",
+                             "7E8064100BE3FA813\r7E9064100981880"
+                             "01\r\r>") &&
+                        test.frames() == SUPPORTED_PIDS);
+
+    passed &= check("Echo", test.run(CAN_11BIT, "0100",
+                                     "0100\r" + std::string(SPACES)) &&
+                                test.frames() == SUPPORTED_PIDS);
+
+    for (std::size_t chunk = 1; chunk < SPACES.size(); ++chunk) {
+        passed &= check("Chunk size " + std::to_string(chunk),
+                        test.run(CAN_11BIT, "0100", SPACES, chunk) &&
+                            test.frames() == SUPPORTED_PIDS);
+    }
+
+    test.run(CAN_11BIT, "0100", SPACES.substr(0, SPACES.find('\r') + 1));
+    passed &= check("Frame before prompt",
+                    test.frames().size() == 1 &&
+                        test.frames().front() == SUPPORTED_PIDS.front());
+
+    passed &= check("Searching",
+                    test.run(CAN_11BIT, "010D",
+                             "SEARCHING...\r7E8 03 41 0D 32 \r\r>") &&
+                        test.frames() == Frames{{0x7E8, {0x41, 0x0D, 0x32}}});
+
+    passed &= check("No data",
+                    test.run(CAN_11BIT, "0160", "NO DATA\r\r>") &&
+                        test.frames().empty() &&
+                        test.parser().get_status() == neon::CMD_NO_DATA);
+
+    passed &= check("Error token",
+                    test.run(CAN_11BIT, "010D", "CAN ERROR\r\r>") &&
+                        test.parser().get_status() == neon::CMD_BUS_ERROR &&
+                        test.parser().get_error() == "CAN ERROR");
+
+    passed &= check("Unknown command",
+                    test.run(CAN_11BIT, "01", "?\r\r>") &&
+                        test.parser().get_status() == neon::CMD_REJECTED &&
+                        test.parser().get_error() == "?");
+
+    const std::vector<std::pair<std::string, CommandStatus>> messages{
+        {"BUS BUSY\r\r>", neon::CMD_BUS_BUSY},
+        {"BUFFER FULL\r\r>", neon::CMD_BUFFER_FULL},
+        {"STOPPED\r\r>", neon::CMD_STOPPED},
+        {"UNABLE TO CONNECT\r\r>", neon::CMD_UNABLE_TO_CONNECT},
+        {"BUS INIT: ...ERROR\r\r>", neon::CMD_BUS_ERROR},
+        {"7E8 03 41 0D <RX ERROR\r\r>", neon::CMD_RX_ERROR},
+        {"LV RESET\r\r>", neon::CMD_ERROR}};
+    for (const auto& [response, status] : messages) {
+        passed &= check("Message " + response.substr(0, response.find('\r')),
+                        test.run(CAN_11BIT, "010D", response) &&
+                            test.parser().get_status() == status);
+    }
+
+    passed &= check(
+        "Multi-frame",
+        test.run(CAN_11BIT, "0902",
+                 "7E8 10 14 49 02 01 31 44 34 \r"
+                 "7E8 21 47 50 30 30 52 35 35 \r"
+                 "7E8 22 42 31 32 33 34 35 36 \r\r>") &&
+            test.frames() ==
+                Frames{{0x7E8, {0x49, 0x02, 0x01, '1', 'D', '4', 'G', 'P', '0',
+                                '0', 'R', '5', '5', 'B', '1', '2', '3', '4',
+                                '5', '6'}}});
+
+    // ATCAF0: frames are padded to 8 bytes, and responses from several
+    // ECUs are interleaved.
+    passed &= check(
+        "Raw CAN",
+        test.run(CAN_11BIT, "020902",
+                 "7E8 10 13 49 02 01 31 44 34 \r"
+                 "7E9 03 7F 09 12 AA AA AA AA \r"
+                 "7E8 21 47 50 30 30 52 35 35 \r"
+                 "7E8 22 42 31 32 33 34 35 AA \r\r>") &&
+            test.frames() ==
+                Frames{{0x7E9, {0x7F, 0x09, 0x12}},
+                       {0x7E8, {0x49, 0x02, 0x01, '1', 'D', '4', 'G', 'P', '0',
+                                '0', 'R', '5', '5', 'B', '1', '2', '3', '4',
+                                '5'}}});
+
+    passed &= check("Incomplete multi-frame",
+                    test.run(CAN_11BIT, "0902",
+                             "7E8 10 14 49 02 01 31 44 34 \r\r>") &&
+                        test.frames().empty() &&
+                        test.parser().get_status() == neon::CMD_ERROR);
+
+    passed &= check("29 bit CAN",
+                    test.run(CAN_29BIT, "010D",
+                             "18 DA F1 10 03 41 0D 32 \r\r>") &&
+                        test.frames() ==
+                            Frames{{0x18DAF110, {0x41, 0x0D, 0x32}}});
+
+    passed &= check("ISO 9141",
+                    test.run(ISO_9141, "010D", "48 6B 10 41 0D 32 AB \r\r>") &&
+                        test.frames() ==
+                            Frames{{0x486B10, {0x41, 0x0D, 0x32}}});
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,506 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "elm327.hpp"
+#include "event-loop.hpp"
+#include "hardware-interface.hpp"
+#include "logger.hpp"
+#include "neonobd_types.hpp"
+#include "profile-store.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+// Emulates an ELM327 connected to a vehicle.  AT commands are accepted,
+// and OBD commands are answered from a table set by the test.
+class FakeAdapter : public HardwareInterface {
+  public:
+    bool connect(const std::string& /*device_name*/,
+                 std::function<void(bool)> callback) override {
+        callback(true);
+        return true;
+    }
+    void respond_from_user(const ResponseVariant& /*response*/,
+                           void* /*handle*/) override {}
+
+    enum Mode {
+        // Answer every command.
+        RESPOND,
+        // OBD commands never finish until aborted by another character.
+        HANG,
+        // Only a warm start (ATWS) gets an answer.
+        DEAD
+    };
+
+    void set_mode(Mode mode) {
+        const std::scoped_lock lock(m_lock);
+        m_mode = mode;
+    }
+
+    // Response to an OBD command, without the response count suffix.
+    void set_response(const std::string& command, const std::string& lines) {
+        const std::scoped_lock lock(m_lock);
+        m_responses[command] = lines;
+    }
+
+    std::vector<std::string> get_commands() {
+        const std::scoped_lock lock(m_lock);
+        return m_commands;
+    }
+
+    void clear_commands() {
+        const std::scoped_lock lock(m_lock);
+        m_commands.clear();
+    }
+
+  protected:
+    size_t read(char* buf, std::size_t size) override {
+        const std::scoped_lock lock(m_lock);
+        const auto count = std::min(size, m_output.size());
+        std::copy_n(m_output.begin(), count, buf);
+        m_output.erase(0, count);
+        return count;
+    }
+
+    size_t write(const char* buf, std::size_t size) override {
+        const std::scoped_lock lock(m_lock);
+        std::string command(buf, size);
+        if (!command.empty() && command.back() == '\r') {
+            command.pop_back();
+        }
+        m_commands.push_back(command);
+        m_output += respond(command);
+        return size;
+    }
+
+  private:
+    std::mutex m_lock;
+    std::map<std::string, std::string> m_responses;
+    std::vector<std::string> m_commands;
+    std::string m_output;
+    Mode m_mode = RESPOND;
+    std::string m_protocol = "0";
+    std::string m_last_command;
+    bool m_hanging = false;
+
+    std::string respond(const std::string& command) {
+        if (m_mode == DEAD) {
+            if (command != "ATWS") {
+                return "";
+            }
+            m_mode = RESPOND;
+        }
+        if (command == "ATZ" || command == "ATWS" || command == "ATI") {
+            return "\r\rELM327 v1.5\r\r>";
+        }
+        if (command == "ATDPN") {
+            return "A6\r\r>";
+        }
+        // The emulated vehicle uses protocol 6 (11 bit CAN, 500 kbps).
+        if (command.starts_with("ATSP")) {
+            m_protocol = command.substr(4);
+            return "OK\r\r>";
+        }
+        if (command.starts_with("AT")) {
+            return "OK\r\r>";
+        }
+        if (command.starts_with("ST")) {
+            return "?\r\r>";
+        }
+        // A space stops a command in progress, and is ignored at the
+        // prompt.  A bare carriage return repeats the last command.
+        if (command == " ") {
+            return std::exchange(m_hanging, false) ? "STOPPED\r\r>" : "";
+        }
+        if (command.empty()) {
+            return m_last_command.empty() ? "" : respond(m_last_command);
+        }
+        m_last_command = command;
+        if (m_mode == HANG) {
+            m_hanging = true;
+            return "";
+        }
+        if (m_protocol != "0" && m_protocol != "6") {
+            return "UNABLE TO CONNECT\r\r>";
+        }
+
+        // Drop the response count suffix.
+        const auto response =
+            m_responses.find(command.substr(0, command.size() & ~1U));
+        if (response == m_responses.end()) {
+            return "NO DATA\r\r>";
+        }
+        return response->second + "\r>";
+    }
+};
+
+class Elm327Test {
+  public:
+    Elm327Test() { m_loop.add_event_handler(m_elm); }
+    ~Elm327Test() { m_loop.remove_event_handler(m_elm); }
+    Elm327Test(const Elm327Test&) = delete;
+    Elm327Test& operator=(const Elm327Test&) = delete;
+
+    bool init() {
+        bool done = false;
+        bool success = false;
+        m_elm.init(&m_adapter, [&done, &success](bool result) {
+            done = true;
+            success = result;
+        });
+        return wait(done) && success;
+    }
+
+    bool disconnect() {
+        bool done = false;
+        m_elm.disconnect([&done]() { done = true; });
+        return wait(done);
+    }
+
+    // Send a command and wait for its result.
+    bool send(unsigned char service, const std::vector<unsigned char>& data,
+              CommandStatus& status, ObdDevice::CommandOptions options = {},
+              bool cancel = false) {
+        bool done = false;
+        m_frames.clear();
+        auto handle = m_elm.send_command(
+            m_address, service, data,
+            [this, &done, &status](CommandStatus result,
+                                   ObdDevice::CommandResult frames) {
+                done = true;
+                status = result;
+                for (const auto& frame : frames) {
+                    m_frames[frame.header].assign(frame.data.begin(),
+                                                  frame.data.end());
+                }
+            },
+            std::move(options));
+        if (cancel) {
+            handle.cancel();
+        }
+        return wait(done);
+    }
+
+    FakeAdapter& adapter() { return m_adapter; }
+    Elm327& elm() { return m_elm; }
+
+    // Header for the commands sent.
+    void set_address(unsigned int address) { m_address = address; }
+
+    // Responses to the last command sent, by header.
+    const std::map<unsigned int, std::vector<unsigned char>>& frames() const {
+        return m_frames;
+    }
+
+  private:
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+
+    unsigned int m_address = FUNCTIONAL;
+    std::map<unsigned int, std::vector<unsigned char>> m_frames;
+    FakeAdapter m_adapter;
+    Elm327 m_elm;
+    EventLoop m_loop;
+
+    // Adapter recovery can take a few seconds.
+    bool wait(const bool& done) {
+        const auto deadline = std::chrono::steady_clock::now() + 10s;
+        while (!done) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                Logger::error << "Timeout waiting for ELM327.\n";
+                return false;
+            }
+            m_loop.run_once(1s);
+        }
+        return true;
+    }
+};
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+static bool sent(const std::vector<std::string>& commands,
+                 const std::string& command) {
+    return std::ranges::find(commands, command) != commands.end();
+}
+
+// Connect with a protocol hint, and return the commands sent.
+static std::vector<std::string> fast_init(int protocol_hint) {
+    Elm327Test test;
+    test.adapter().set_response("0100", "7E8 06 41 00 BE 3F A8 13 \r");
+    test.elm().set_protocol_hint(protocol_hint);
+    if (!test.init() || test.elm().get_protocol() != 6 ||
+        !test.disconnect()) {
+        return {};
+    }
+    return test.adapter().get_commands();
+}
+
+// Learn a profile on one connection, and use it on the next.
+static bool profile_test() {
+    VehicleProfile profile;
+    {
+        Elm327Test test;
+        test.adapter().set_response("0100", "7E8 06 41 00 BE 3F A8 13 \r");
+        CommandStatus status = neon::CMD_ERROR;
+        static constexpr int SAMPLES = 20;
+        bool success = test.init();
+        for (int i = 0; i < SAMPLES && success; ++i) {
+            success = test.send(1, {0x00}, status);
+        }
+        if (!check("Learn profile", success && test.disconnect())) {
+            return false;
+        }
+        test.elm().update_profile(profile);
+    }
+
+    if (!check("Profile contents",
+               profile.firmware == "ELM327 v1.5" &&
+                   profile.st_firmware.empty() &&
+                   profile.extensions == EXTENSION_RESPONSE_COUNT &&
+                   profile.protocol == 6 && profile.ecus.size() == 1 &&
+                   profile.ecus.front().header == 0x7E8 &&
+                   profile.ecus.front().response_time.count() > 0)) {
+        return false;
+    }
+
+    Elm327Test test;
+    test.adapter().set_response("0100", "7E8 06 41 00 BE 3F A8 13 \r");
+    test.elm().apply_profile(profile);
+    if (!check("Init from profile", test.init() && test.disconnect())) {
+        return false;
+    }
+    const auto commands = test.adapter().get_commands();
+    return check("Discovery skipped", !sent(commands, "ATI") &&
+                                          !sent(commands, "ATSP0") &&
+                                          sent(commands, "ATSP6"));
+}
+
+// Requests carry their PCI byte, and flow control follows the header.
+static bool raw_can_test() {
+    Elm327Test test;
+    test.adapter().set_response("020902", "7E8 10 14 49 02 01 31 4E 45 \r"
+                                          "7E8 21 4F 4E 4F 42 44 30 54 \r"
+                                          "7E8 22 45 53 54 30 30 30 31 \r");
+    test.adapter().set_response("0322F190", "7E8 10 14 62 F1 90 31 4E 45 \r"
+                                            "7E8 21 4F 4E 4F 42 44 30 54 \r"
+                                            "7E8 22 45 53 54 30 30 30 31 \r");
+    test.elm().set_raw_can(true);
+    if (!check("Raw CAN init", test.init())) {
+        return false;
+    }
+    auto commands = test.adapter().get_commands();
+    bool passed = check("Raw CAN settings", sent(commands, "ATCAF0") &&
+                                                sent(commands, "ATFCSD300000"));
+
+    const std::string vin = "1NEONOBD0TEST0001";
+    std::vector<unsigned char> expected{0x49, 0x02, 0x01};
+    expected.insert(expected.end(), vin.begin(), vin.end());
+    CommandStatus status = neon::CMD_ERROR;
+    test.adapter().clear_commands();
+    passed &= check("Raw CAN functional",
+                    test.send(9, {0x02}, status) && status == neon::CMD_OK &&
+                        test.frames().at(0x7E8) == expected);
+    commands = test.adapter().get_commands();
+    passed &= check("Functional flow control", sent(commands, "ATFCSM2") &&
+                                                   sent(commands, "020902"));
+
+    expected.at(0) = 0x62;
+    expected.at(1) = 0xF1;
+    expected.at(2) = 0x90;
+    test.set_address(0x7E0);
+    test.adapter().clear_commands();
+    passed &= check("Raw CAN physical", test.send(0x22, {0xF1, 0x90}, status) &&
+                                            status == neon::CMD_OK &&
+                                            test.frames().at(0x7E8) ==
+                                                expected);
+    commands = test.adapter().get_commands();
+    passed &= check("Physical flow control", sent(commands, "ATFCSH7E0") &&
+                                                 sent(commands, "ATFCSM1"));
+
+    test.adapter().clear_commands();
+    const std::vector<unsigned char> identifiers{0xF1, 0x90, 0xF1, 0x8C,
+                                                 0xF1, 0x87, 0xF1};
+    passed &= check("Raw CAN long request",
+                    test.send(0x22, identifiers, status) &&
+                        status == neon::CMD_ERROR &&
+                        test.adapter().get_commands().empty());
+
+    return passed && check("Raw CAN disconnect", test.disconnect());
+}
+
+// Send service $01 PID 0C and return the command written to the adapter.
+static std::string send_rpm(Elm327Test& test, CommandStatus& status) {
+    test.adapter().clear_commands();
+    if (!test.send(1, {0x0C}, status)) {
+        return "";
+    }
+    const auto commands = test.adapter().get_commands();
+    return commands.empty() ? "" : commands.back();
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    bool passed = true;
+
+    // A running adapter is not rebooted, and a good protocol hint skips
+    // the search.
+    auto init_commands = fast_init(6);
+    passed &= check("Fast init", sent(init_commands, "ATD") &&
+                                     !sent(init_commands, "ATZ") &&
+                                     sent(init_commands, "ATSP6") &&
+                                     !sent(init_commands, "ATSP0"));
+
+    init_commands = fast_init(3);
+    passed &= check("Wrong protocol hint", sent(init_commands, "ATSP3") &&
+                                               sent(init_commands, "ATSP0"));
+
+    passed &= profile_test();
+
+    passed &= raw_can_test();
+
+    Elm327Test test;
+    if (!check("Init", test.init())) {
+        return 1;
+    }
+
+    CommandStatus status = neon::CMD_ERROR;
+
+    // The first request waits for the adapter timeout; later ones ask
+    // for the number of responses seen the first time.
+    test.adapter().set_response("010C", "7E8 04 41 0C 1A F8 \r"
+                                        "7E9 04 41 0C 1A F8 \r");
+    passed &= check("First request", send_rpm(test, status) == "010C" &&
+                                         status == neon::CMD_OK);
+    passed &= check("Response count", send_rpm(test, status) == "010C2" &&
+                                          status == neon::CMD_OK);
+
+    // An ECU stops answering: the count is relearned.
+    test.adapter().set_response("010C", "7E8 04 41 0C 1A F8 \r");
+    passed &= check("Fewer responses", send_rpm(test, status) == "010C2");
+    passed &= check("Relearned count", send_rpm(test, status) == "010C1");
+
+    // NO DATA forgets the count.
+    test.adapter().set_response("010C", "NO DATA\r");
+    passed &= check("No data", send_rpm(test, status) == "010C1" &&
+                                   status == neon::CMD_NO_DATA);
+    passed &= check("Forgotten count", send_rpm(test, status) == "010C");
+
+    // Instant responses from the emulator give the shortest timeout.
+    static constexpr int TIMING_SAMPLES = 20;
+    test.adapter().set_response("010D", "7E8 03 41 0D 32 \r");
+    test.adapter().clear_commands();
+    for (int i = 0; i < TIMING_SAMPLES; ++i) {
+        test.send(1, {0x0D}, status);
+    }
+    test.send(1, {0x0D}, status);
+    const auto commands = test.adapter().get_commands();
+    passed &= check("Adaptive timing",
+                    std::ranges::find(commands, "ATAT2") != commands.end() &&
+                        std::ranges::find(commands, "ATST05") !=
+                            commands.end());
+
+    // A command whose deadline has passed is not sent.
+    test.adapter().clear_commands();
+    ObdDevice::CommandOptions expired;
+    expired.deadline = std::chrono::steady_clock::now() - 1ms;
+    passed &= check("Expired", test.send(1, {0x0D}, status, expired) &&
+                                   status == neon::CMD_EXPIRED &&
+                                   test.adapter().get_commands().empty());
+
+    passed &= check("Cancelled",
+                    test.send(1, {0x0D}, status, {}, true) &&
+                        status == neon::CMD_CANCELLED);
+
+    // Errors are retried as set by the policy, with a growing delay.
+    test.adapter().set_response("010F", "BUS BUSY\r");
+    test.elm().set_retry_policy(neon::CMD_BUS_BUSY, {2, 20ms});
+    test.elm().reset_status_counts();
+    test.adapter().clear_commands();
+    const auto retry_start = std::chrono::steady_clock::now();
+    passed &= check("Bus busy", test.send(1, {0x0F}, status) &&
+                                    status == neon::CMD_BUS_BUSY);
+    const auto retry_time = std::chrono::steady_clock::now() - retry_start;
+    passed &= check("Retries",
+                    std::ranges::count(test.adapter().get_commands(),
+                                       "010F") == 3 &&
+                        retry_time >= 60ms);
+    const auto counts = test.elm().get_status_counts();
+    passed &= check("Status counts", counts.at(neon::CMD_BUS_BUSY) == 3 &&
+                                         counts.at(neon::CMD_OK) == 0);
+
+    test.adapter().set_response("010F", "7E8 03 41 0F 48 \r");
+    passed &= check("After retries", test.send(1, {0x0F}, status) &&
+                                         status == neon::CMD_OK &&
+                                         test.elm().get_status_counts().at(
+                                             neon::CMD_OK) == 1);
+
+    // A hung command is aborted, and the next one goes through.
+    ObdDevice::CommandOptions short_timeout;
+    short_timeout.timeout = 100ms;
+    test.adapter().set_mode(FakeAdapter::HANG);
+    test.adapter().clear_commands();
+    passed &= check("Timeout", test.send(1, {0x0D}, status, short_timeout) &&
+                                   status == neon::CMD_TIMEOUT);
+    auto commands_sent = test.adapter().get_commands();
+    passed &= check("Abort", std::ranges::find(commands_sent, " ") !=
+                                 commands_sent.end());
+    test.adapter().set_mode(FakeAdapter::RESPOND);
+    passed &= check("After abort", test.send(1, {0x0D}, status) &&
+                                       status == neon::CMD_OK);
+
+    // An adapter that ignores the abort is warm started.
+    test.adapter().set_mode(FakeAdapter::DEAD);
+    test.adapter().clear_commands();
+    passed &= check("Dead adapter",
+                    test.send(1, {0x0D}, status, short_timeout) &&
+                        status == neon::CMD_TIMEOUT);
+    passed &= check("Warm start", test.send(1, {0x0D}, status) &&
+                                      status == neon::CMD_OK);
+    commands_sent = test.adapter().get_commands();
+    for (const auto* setting : {"ATWS", "ATE0", "ATH1", "ATSP6"}) {
+        passed &= check(std::string("Restore ") + setting,
+                        std::ranges::find(commands_sent, setting) !=
+                            commands_sent.end());
+    }
+
+    passed &= check("Disconnect", test.disconnect());
+    passed &= check("Send after disconnect",
+                    test.send(1, {0x0D}, status) &&
+                        status == neon::CMD_CANCELLED);
+
+    return passed ? 0 : 1;
+}
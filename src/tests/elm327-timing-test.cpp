@@ -0,0 +1,90 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "elm327-timing.hpp"
+#include "logger.hpp"
+#include <chrono>
+#include <optional>
+#include <string>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+static void record(Elm327Timing& timing, unsigned int header,
+                   std::chrono::nanoseconds response_time, int count) {
+    for (int i = 0; i < count; ++i) {
+        timing.record_response(header, response_time);
+        timing.record_result(false);
+    }
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    using Settings = Elm327Timing::Settings;
+    static constexpr int SAMPLES = 20;
+    static constexpr int RECOVERY = 128;
+
+    Elm327Timing timing;
+    bool passed = true;
+
+    passed &= check("Defaults", !timing.update());
+
+    // A few samples are not enough to change anything.
+    record(timing, 0x7E8, 20ms, 2);
+    passed &= check("Too few samples", !timing.update());
+
+    // 20ms * 1.5 + 8ms = 38ms, or 10 units of 4.096ms.
+    record(timing, 0x7E8, 20ms, SAMPLES);
+    passed &= check("Fast ECU", timing.update() == Settings{2, 0x0A});
+    passed &= check("Unchanged", !timing.update());
+
+    // 100ms * 1.5 + 8ms = 158ms, or 39 units.
+    record(timing, 0x7E9, 100ms, SAMPLES);
+    passed &= check("Slow ECU", timing.update() == Settings{1, 0x27});
+
+    timing.record_result(true);
+    passed &= check("Single miss", !timing.update());
+    timing.record_result(true);
+    passed &= check("Backoff", timing.update() == Settings{1, 0x4E});
+
+    record(timing, 0x7E9, 100ms, RECOVERY);
+    passed &= check("Recovery", timing.update() == Settings{1, 0x27});
+
+    // A warm started adapter gets the learned settings again.
+    timing.adapter_reset();
+    passed &= check("Adapter reset", timing.update() == Settings{1, 0x27} &&
+                                         !timing.update());
+
+    timing.reset();
+    record(timing, 0x7E8, 1ms, SAMPLES);
+    passed &= check("Minimum timeout", timing.update() == Settings{2, 0x05});
+
+    return passed ? 0 : 1;
+}
@@ -185,6 +185,16 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
+        if (const auto stats = event_handler.get_event_stats();
+            stats.latency.count() != 1 || stats.queue_depth_high_water != 1) {
+            Logger::error << "Unexpected event stats.  Latency count = "
+                          << stats.latency.count() << ", high water = "
+                          << stats.queue_depth_high_water << "\n";
+            return 1;
+        }
+
+        event_handler.reset_event_stats();
+
         Logger::debug << event_handler.get_event_count()
                       << " events recorded.\n";
         Logger::debug << "Running " << TestEventHandler::SHORT_TEST_SIZE
@@ -201,6 +211,16 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
+        if (const auto stats = event_handler.get_event_stats();
+            stats.latency.count() != TestEventHandler::SHORT_TEST_SIZE ||
+            stats.latency.percentile(50) > stats.latency.max() ||
+            stats.queue_depth_high_water == 0) {
+            Logger::error << "Unexpected event stats after "
+                          << TestEventHandler::SHORT_TEST_SIZE
+                          << " Event test.\n";
+            return 1;
+        }
+
         Logger::debug << event_handler.get_event_count()
                       << " events recorded.\n";
         Logger::debug << "Running Event Interleave Test.\n";
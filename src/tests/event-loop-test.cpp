@@ -0,0 +1,252 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "event-handler.hpp"
+#include "event-loop.hpp"
+#include "logger.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+class TestEventHandler : public EventHandler {
+  public:
+    TestEventHandler() { init_event_handler(); }
+
+    [[nodiscard]] int get_event_count() const { return m_event_count; }
+
+    void send_events(int count) {
+        for (int i = 0; i < count; ++i) {
+            signal_event("Test");
+        }
+    }
+
+  protected:
+    void process_event(std::string_view event) override {
+        if (event == "Test") {
+            ++m_event_count;
+        }
+    }
+
+  private:
+    int m_event_count = 0;
+};
+
+static bool event_handler_test() {
+    EventLoop loop;
+    TestEventHandler event_handler;
+    loop.add_event_handler(event_handler);
+
+    static constexpr int EVENT_COUNT = 50;
+    std::thread evt_thread([&event_handler]() {
+        event_handler.send_events(EVENT_COUNT);
+    });
+
+    while (event_handler.get_event_count() < EVENT_COUNT) {
+        if (loop.run_once(1s) == 0) {
+            Logger::error << "Timeout waiting for handler events.\n";
+            evt_thread.join();
+            return false;
+        }
+    }
+    evt_thread.join();
+
+    loop.remove_event_handler(event_handler);
+    event_handler.send_events(1);
+    if (loop.run_once(10ms) != 0) {
+        Logger::error << "Removed handler was still dispatched.\n";
+        return false;
+    }
+
+    return true;
+}
+
+static bool fd_test() {
+    EventLoop loop;
+    std::array<int, 2> fds = {-1, -1};
+    if (pipe(fds.data()) < 0) {
+        Logger::error << "Could not create pipe.\n";
+        return false;
+    }
+
+    int reads = 0;
+    loop.add_fd(fds[0], EPOLLIN, [&reads, &fds](std::uint32_t events) {
+        if ((events & EPOLLIN) != 0) {
+            char byte = 0;
+            if (::read(fds[0], &byte, 1) == 1) {
+                ++reads;
+            }
+        }
+    });
+
+    static_cast<void>(::write(fds[1], "ab", 2));
+    while (reads < 2) {
+        if (loop.run_once(1s) == 0) {
+            Logger::error << "Timeout waiting for fd events.\n";
+            break;
+        }
+    }
+
+    loop.remove_fd(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    return reads == 2;
+}
+
+static bool timer_test() {
+    EventLoop loop;
+    int oneshot_count = 0;
+    int repeat_count = 0;
+
+    loop.add_timer(
+        5ms, [&oneshot_count]() { ++oneshot_count; }, false);
+    const int repeat_timer =
+        loop.add_timer(2ms, [&repeat_count]() { ++repeat_count; });
+
+    const auto start = std::chrono::steady_clock::now();
+    while (repeat_count < 10 && std::chrono::steady_clock::now() - start < 2s) {
+        loop.run_once(100ms);
+    }
+    loop.remove_timer(repeat_timer);
+
+    if (oneshot_count != 1 || repeat_count < 10) {
+        Logger::error << "Timer test failed: oneshot = " << oneshot_count
+                      << ", repeat = " << repeat_count << "\n";
+        return false;
+    }
+
+    return loop.run_once(20ms) == 0;
+}
+
+// Timer fds are closed with the loop, and a stale timer id never closes
+// a descriptor that has since reused its number.
+static bool timer_fd_test() {
+    int timer_fd = -1;
+    {
+        EventLoop loop;
+        timer_fd = loop.add_timer(1s, [] {});
+    }
+    if (fcntl(timer_fd, F_GETFD) != -1) {
+        Logger::error << "Timer fd leaked by destroyed loop.\n";
+        return false;
+    }
+
+    EventLoop loop;
+    const int stale_id = loop.add_timer(1s, [] {});
+    loop.remove_timer(stale_id);
+    std::array<int, 2> fds = {-1, -1};
+    if (pipe(fds.data()) < 0) {
+        Logger::error << "Could not create pipe.\n";
+        return false;
+    }
+    // The kernel hands out the lowest free number, i.e. the stale id.
+    loop.add_fd(fds[0], EPOLLIN, [](std::uint32_t /*unused*/) {});
+    loop.remove_timer(stale_id);
+    const bool is_open = fcntl(fds[0], F_GETFD) != -1;
+    if (!is_open) {
+        Logger::error << "Stale timer id closed a watched fd.\n";
+    }
+    loop.remove_fd(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    return is_open;
+}
+
+// A rearmed timer fires after its new interval, and a disarmed one
+// stays quiet until it is rearmed.
+static bool rearm_test() {
+    EventLoop loop;
+    int count = 0;
+    const int timer = loop.add_timer(1h, [&count]() { ++count; });
+
+    loop.rearm_timer(timer, 2ms);
+    loop.run_once(100ms);
+    const bool rearmed = count == 1;
+
+    loop.disarm_timer(timer);
+    const bool disarmed = loop.run_once(20ms) == 0 && count == 1;
+
+    loop.rearm_timer(timer, 1ms);
+    loop.run_once(100ms);
+    const bool rearmed_again = count == 2;
+    loop.remove_timer(timer);
+
+    if (!rearmed || !disarmed || !rearmed_again) {
+        Logger::error << "Rearm test failed: count = " << count << "\n";
+        return false;
+    }
+    return true;
+}
+
+static bool stop_test() {
+    EventLoop loop;
+    std::thread stop_thread([&loop]() {
+        std::this_thread::sleep_for(20ms);
+        loop.stop();
+    });
+    loop.run();
+    stop_thread.join();
+    return true;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    Logger::debug << "Running Event Handler Test.\n";
+    if (!event_handler_test()) {
+        return 1;
+    }
+
+    Logger::debug << "Running File Descriptor Test.\n";
+    if (!fd_test()) {
+        return 1;
+    }
+
+    Logger::debug << "Running Timer Test.\n";
+    if (!timer_test()) {
+        return 1;
+    }
+
+    Logger::debug << "Running Timer fd Test.\n";
+    if (!timer_fd_test()) {
+        return 1;
+    }
+
+    Logger::debug << "Running Timer Rearm Test.\n";
+    if (!rearm_test()) {
+        return 1;
+    }
+
+    Logger::debug << "Running Stop Test.\n";
+    if (!stop_test()) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hex-decode.hpp"
+#include "logger.hpp"
+#include <array>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static bool test_kernel(HexDecode::Kernel kernel) {
+    static constexpr std::string_view DIGITS = "0123456789ABCDEFabcdef";
+    static constexpr std::size_t MAX_BYTES = 100;
+
+    std::mt19937 rng(kernel);
+    std::uniform_int_distribution<std::size_t> pick_digit(0,
+                                                          DIGITS.size() - 1);
+
+    for (std::size_t size = 0; size <= MAX_BYTES; ++size) {
+        std::string hex;
+        for (std::size_t i = 0; i < 2 * size; ++i) {
+            hex.push_back(DIGITS.at(pick_digit(rng)));
+        }
+
+        std::vector<unsigned char> expected(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            expected.at(i) = static_cast<unsigned char>(
+                std::stoul(hex.substr(2 * i, 2), nullptr, 16));
+        }
+
+        std::vector<unsigned char> result(size);
+        if (!HexDecode::decode(hex, result) || result != expected) {
+            Logger::error << "Decode of " << hex << " failed.\n";
+            return false;
+        }
+
+        // Every non-hex character must be rejected in every position.
+        for (std::size_t pos = 0; pos < hex.size(); ++pos) {
+            std::string bad = hex;
+            static constexpr int CHAR_COUNT = 256;
+            for (int character = 0; character < CHAR_COUNT; ++character) {
+                bad.at(pos) = static_cast<char>(character);
+                if (HexDecode::digit_value(bad.at(pos)) >= 0) {
+                    continue;
+                }
+                if (HexDecode::decode(bad, result)) {
+                    Logger::error << "Invalid character " << character
+                                  << " at position " << pos
+                                  << " was not detected.\n";
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    const auto best_kernel = HexDecode::get_kernel();
+
+    for (const auto kernel : HexDecode::get_available_kernels()) {
+        Logger::debug << "Testing kernel " << kernel << "\n";
+        if (!HexDecode::set_kernel(kernel) || !test_kernel(kernel)) {
+            Logger::error << "Kernel " << kernel << " failed.\n";
+            return 1;
+        }
+    }
+
+    HexDecode::set_kernel(best_kernel);
+
+    std::array<char, 32> compact{};
+    const auto count = HexDecode::remove_spaces("7E8 06 41 00 BE ", compact);
+    if (std::string_view(compact.data(), count) != "7E8064100BE") {
+        Logger::error << "remove_spaces failed.\n";
+        return 1;
+    }
+
+    static constexpr std::string_view ODD = "123";
+    std::array<unsigned char, 2> result{};
+    if (HexDecode::decode(ODD, result)) {
+        Logger::error << "Odd number of digits was not rejected.\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "logger.hpp"
+#include "obd-pids.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Decoding happens at compile time too.
+static_assert([] {
+    constexpr std::array<unsigned char, 2> RPM{0x1A, 0xF8};
+    std::array<double, MAX_PID_FIELDS> values{};
+    return decode_pid(0x0C, RPM, values) == 1 && values[0] == 1726;
+}());
+static_assert(pid_size(0x0C) == 2 && pid_size(0x81) == 41 &&
+              pid_size(0x95) == 0);
+// Supported PID maps and fuel type are kept, live data is not.
+static_assert(find_pid(0x40)->ttl == PID_TTL_CONSTANT &&
+              find_pid(0x51)->ttl == PID_TTL_CONSTANT &&
+              find_pid(0x01)->ttl == PID_TTL_SLOW &&
+              find_pid(0x0C)->ttl.count() == 0);
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+// Rows are in order, and every field fits in its PID's data.  All zero
+// and all one bits give each field's range.
+static bool table_test() {
+    bool passed = true;
+    unsigned int previous = 0;
+    for (std::size_t row = 0; row < PID_TABLE.size(); ++row) {
+        const auto& definition = PID_TABLE.at(row);
+        const std::string name = "PID " + std::to_string(definition.pid);
+        if (row > 0 && definition.pid <= previous) {
+            passed &= check(name + " order", false);
+        }
+        previous = definition.pid;
+        passed &= check(name + " lookup", find_pid(definition.pid) ==
+                                              &definition);
+
+        const std::vector<unsigned char> zeros(definition.size, 0x00);
+        const std::vector<unsigned char> ones(definition.size, 0xFF);
+        std::array<double, MAX_PID_FIELDS> low{};
+        std::array<double, MAX_PID_FIELDS> high{};
+        passed &= check(name + " field count",
+                        definition.field_count > 0 &&
+                            decode_pid(definition.pid, zeros, low) ==
+                                definition.field_count &&
+                            decode_pid(definition.pid, ones, high) ==
+                                definition.field_count);
+
+        for (std::size_t i = 0; i < definition.field_count; ++i) {
+            const auto& field = definition.fields.at(i);
+            passed &= check(name + " field size",
+                            field.bit_length > 0 &&
+                                field.bit_offset + field.bit_length <=
+                                    definition.size * 8U);
+            // A signed field is -1 with all bits set, and 0 with none.
+            const double expected_low =
+                field.sign_bit == 0 ? field.min : field.offset;
+            const double expected_high =
+                field.sign_bit == 0 ? field.max : field.offset - field.scale;
+            passed &= check(name + " range", low.at(i) == expected_low &&
+                                                 high.at(i) == expected_high &&
+                                                 field.min < field.max);
+        }
+    }
+    return passed;
+}
+
+static bool decode_test() {
+    struct Case {
+        unsigned char pid;
+        std::vector<unsigned char> data;
+        std::vector<double> values;
+    };
+    const std::vector<Case> cases{
+        {0x01, {0x83, 0x07, 0x65, 0x04}, {1, 3, 0x07, 0x65, 0x04}},
+        {0x05, {0x7B}, {83}},
+        {0x06, {0x80}, {0}},
+        {0x0E, {0x00}, {-64}},
+        {0x14, {0xC8, 0x80}, {200 * 0.005, 0}},
+        {0x32, {0xFF, 0xFC}, {-1}},
+        {0x32, {0x80, 0x00}, {-8192}},
+        {0x34, {0x80, 0x00, 0x80, 0x00}, {1, 0}},
+        {0x4F, {0x01, 0x02, 0x03, 0x04}, {1, 2, 3, 40}},
+        {0xA4, {0x03, 0x40, 0x0C, 0xE4}, {3, 4, 3300 * 0.001}},
+        {0xA6, {0x00, 0x01, 0x00, 0x00}, {65536 * 0.1}},
+    };
+
+    bool passed = true;
+    for (const auto& test : cases) {
+        std::array<double, MAX_PID_FIELDS> values{};
+        const auto count = decode_pid(test.pid, test.data, values);
+        passed &= check("Decode PID " + std::to_string(test.pid),
+                        std::vector<double>(values.begin(),
+                                            values.begin() +
+                                                static_cast<long>(count)) ==
+                            test.values);
+    }
+
+    std::array<double, MAX_PID_FIELDS> values{};
+    static constexpr std::array<unsigned char, 1> SHORT{0x1A};
+    passed &= check("Short data", decode_pid(0x0C, SHORT, values) == 0);
+    passed &= check("Unknown PID", decode_pid(0x95, SHORT, values) == 0);
+    return passed;
+}
+
+static void benchmark() {
+    static constexpr std::size_t SAMPLES = 1000000;
+    static constexpr std::array<unsigned char, 2> DATA{0x1A, 0xF8};
+    std::array<double, MAX_PID_FIELDS> values{};
+    double total = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < SAMPLES; ++i) {
+        decode_pid(0x0C, DATA, values);
+        total += values[0];
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    Logger::info << "Decoded " << SAMPLES << " samples in "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(
+                        elapsed)
+                        .count()
+                 << " us (total " << total << ").\n";
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    bool passed = table_test();
+    passed &= decode_test();
+    benchmark();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,1020 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "event-loop.hpp"
+#include "frame-set.hpp"
+#include "hardware-interface.hpp"
+#include "logger.hpp"
+#include "neonobd_types.hpp"
+#include "obd-device.hpp"
+#include "obd.hpp"
+#include "profile-store.hpp"
+#include "task.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <unistd.h>
+#include <vector>
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+// OBD device that records commands so the test can answer them.
+class FakeObdDevice : public ObdDevice {
+  public:
+    struct Command {
+        unsigned int address;
+        unsigned char service;
+        std::vector<unsigned char> data;
+        CommandCallback callback;
+        FrameCallback frame_callback;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    void init(HardwareInterface* /*hwif*/,
+              std::function<void(bool)> callback) override {
+        m_connected = true;
+        callback(true);
+    }
+    std::string get_error_string() const override { return ""; }
+    CommandHandle send_command(unsigned int obd_address,
+                               unsigned char obd_service,
+                               std::span<const unsigned char> obd_data,
+                               CommandCallback callback,
+                               CommandOptions options) override {
+        auto cancelled = std::make_shared<std::atomic<bool>>(false);
+        commands.push_back({obd_address, obd_service,
+                            {obd_data.begin(), obd_data.end()},
+                            std::move(callback),
+                            std::move(options.frame_callback), cancelled});
+        return CommandHandle(cancelled);
+    }
+    bool is_connecting() const override { return false; }
+    bool is_connected() const override { return m_connected; }
+    bool is_CAN() const override { return true; }
+    void disconnect(std::function<void()> callback) override {
+        m_connected = false;
+        callback();
+    }
+    void apply_profile(const VehicleProfile& profile) override {
+        applied = profile;
+    }
+    void update_profile(VehicleProfile& profile) const override {
+        profile.firmware = "ELM327 v2.1";
+    }
+
+    // Deliver one ECU's response to the oldest command, as a device
+    // does before the command completes.
+    void frame(unsigned int header, const std::vector<unsigned char>& data) {
+        const auto& command = commands.front();
+        if (command.frame_callback && !*command.cancelled) {
+            command.frame_callback(header, data);
+        }
+    }
+
+    // Complete the oldest command.
+    void respond(
+        CommandStatus status,
+        const std::map<unsigned int, std::vector<unsigned char>>& responses) {
+        FrameSet frames;
+        for (const auto& [header, data] : responses) {
+            frames.append(header, data);
+        }
+        auto command = std::move(commands.front());
+        commands.pop_front();
+        if (*command.cancelled) {
+            command.callback(neon::CMD_CANCELLED, {});
+        } else {
+            command.callback(status, frames.frames());
+        }
+    }
+
+    std::deque<Command> commands;
+    VehicleProfile applied;
+
+  private:
+    bool m_connected = false;
+};
+
+struct Answer {
+    unsigned char pid;
+    CommandStatus status;
+    Obd::EcuResults results;
+};
+
+static Obd::Results values(std::initializer_list<double> list) {
+    Obd::Results results;
+    for (const double value : list) {
+        results.values.at(results.count++) = value;
+    }
+    return results;
+}
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+// Both ECUs from the profile answer, so the request completes without
+// waiting for the device.
+static bool early_completion_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+    static constexpr unsigned int TCM = 0x7E9;
+
+    VehicleProfile profile;
+    profile.ecus.resize(2);
+    profile.ecus.at(0).header = ECM;
+    profile.ecus.at(1).header = TCM;
+    // Coolant temperature is only supported by the ECM.
+    profile.ecus.at(0).supported_pids.set(0x05);
+    profile.ecus.at(0).supported_pids.set(0x0C);
+    profile.ecus.at(0).supported_pids.set(0x0D);
+    profile.ecus.at(1).supported_pids.set(0x0C);
+    profile.ecus.at(1).supported_pids.set(0x0D);
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.apply_profile(profile);
+    bool connected = false;
+    obd.init(device, nullptr, [&connected](bool success) {
+        connected = success;
+    });
+
+    std::vector<Answer> answers;
+    static constexpr std::array<unsigned char, 2> PIDS{0x0C, 0x0D};
+    for (const unsigned char pid : PIDS) {
+        obd.get_PID(FUNCTIONAL, 1, pid,
+                    [&answers, pid](CommandStatus status,
+                                    const Obd::EcuResults& results) {
+                        answers.push_back({pid, status, results});
+                    });
+    }
+
+    bool passed = check("Early init", connected);
+    device->frame(ECM, {0x41, 0x0C, 0x1A, 0xF8});
+    passed &= check("Waiting for TCM", answers.empty());
+    device->frame(TCM, {0x41, 0x0C, 0x0F, 0xA0});
+    passed &= check("Early completion",
+                    answers.size() == 1 &&
+                        answers.front().status == neon::CMD_OK &&
+                        answers.front().results ==
+                            Obd::EcuResults{{ECM, values({1726})},
+                                            {TCM, values({1000})}});
+    passed &= check("Command cancelled",
+                    device->commands.size() == 2 &&
+                        *device->commands.front().cancelled &&
+                        device->commands.back().data ==
+                            std::vector<unsigned char>{0x0D});
+
+    // The device's own completion of the cancelled command is ignored.
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Late completion", answers.size() == 1);
+
+    // Only one ECU answers, so the request waits for the device.
+    device->frame(ECM, {0x41, 0x0D, 0x32});
+    passed &= check("Missing ECU", answers.size() == 1);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0D, 0x32}}});
+    passed &= check("Device completion",
+                    answers.size() == 2 &&
+                        answers.back().results ==
+                            Obd::EcuResults{{ECM, values({50})}});
+
+    obd.get_PID(FUNCTIONAL, 1, 0x05,
+                [](CommandStatus /*status*/,
+                   const Obd::EcuResults& /*results*/) {});
+    passed &= check("Profile route", device->commands.size() == 1 &&
+                                         device->commands.front().address ==
+                                             0x7E0);
+    return passed;
+}
+
+// An ECU that stops answering, e.g. because it has gone to sleep, is
+// dropped when the ECUs are learned again, so requests keep completing
+// early.
+static bool relearn_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+    static constexpr unsigned int TCM = 0x7E9;
+
+    VehicleProfile profile;
+    profile.ecus.resize(2);
+    profile.ecus.at(0).header = ECM;
+    profile.ecus.at(1).header = TCM;
+    for (auto& ecu : profile.ecus) {
+        ecu.supported_pids.set(0x0C);
+        ecu.supported_pids.set(0x0D);
+    }
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.apply_profile(profile);
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::size_t answers = 0;
+    auto request = [&obd, &answers](unsigned char pid) {
+        obd.get_PID(FUNCTIONAL, 1, pid,
+                    [&answers](CommandStatus /*status*/,
+                               const Obd::EcuResults& /*results*/) {
+                        ++answers;
+                    });
+    };
+    const std::vector<unsigned char> rpm{0x41, 0x0C, 0x1A, 0xF8};
+
+    // Run up to the request that learns the ECUs again.
+    bool passed = true;
+    while (true) {
+        request(0x0C);
+        if (!device->commands.front().frame_callback) {
+            break;
+        }
+        device->frame(ECM, rpm);
+        device->frame(TCM, rpm);
+        device->respond(neon::CMD_OK, {});
+        passed &= check("Early completion before sleep",
+                        answers > 0 && device->commands.empty());
+        answers = 0;
+    }
+
+    // The TCM has gone to sleep.  PID 0C is now only routed to the ECM,
+    // so check with PID 0D, which still goes to both.
+    device->respond(neon::CMD_OK, {{ECM, rpm}});
+    request(0x0D);
+    device->frame(ECM, {0x41, 0x0D, 0x32});
+    passed &= check("Sleeping ECU dropped",
+                    answers == 2 && *device->commands.front().cancelled);
+    return passed;
+}
+
+// A batch with PIDs from the A1-C0 range is split by the sizes in
+// PID_TABLE, so the ECU keeps getting multi-PID requests.
+static bool gear_batch_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+
+    VehicleProfile profile;
+    profile.ecus.resize(1);
+    profile.ecus.at(0).header = ECM;
+    for (const unsigned int pid : {0x0C, 0x0D, 0xA4, 0xA6}) {
+        profile.ecus.at(0).supported_pids.set(pid);
+    }
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.apply_profile(profile);
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::vector<Answer> answers;
+    auto request = [&obd, &answers](unsigned char pid) {
+        obd.get_PID(FUNCTIONAL, 1, pid,
+                    [&answers, pid](CommandStatus status,
+                                    const Obd::EcuResults& results) {
+                        answers.push_back({pid, status, results});
+                    });
+    };
+
+    request(0x0D);
+    request(0xA4);
+    request(0xA6);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0D, 0x32}}});
+    bool passed = check("Gear batch",
+                        device->commands.size() == 1 &&
+                            device->commands.front().data ==
+                                std::vector<unsigned char>{0xA4, 0xA6});
+    device->respond(neon::CMD_OK, {{ECM,
+                                    {0x41, 0xA4, 0x03, 0x40, 0x0C, 0xE4, 0xA6,
+                                     0x00, 0x01, 0x00, 0x00}}});
+    passed &= check(
+        "Gear batch decode",
+        answers.size() == 3 && answers.at(1).pid == 0xA4 &&
+            answers.at(1).results ==
+                Obd::EcuResults{{ECM, values({3, 4, 3300 * 0.001})}} &&
+            answers.at(2).results ==
+                Obd::EcuResults{{ECM, values({65536 * 0.1})}});
+
+    request(0x0C);
+    request(0x0D);
+    request(0xA4);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Batching kept after gear",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x0D, 0xA4});
+    return passed;
+}
+
+// The maps are read in as few requests as possible, following the
+// "next map supported" bits.
+static bool discovery_test() {
+    static constexpr unsigned int ECM_REQUEST = 0x7E0;
+    static constexpr unsigned int ECM = 0x7E8;
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::vector<Answer> answers;
+    auto request = [&obd, &answers](unsigned char pid) {
+        obd.get_PID(ECM_REQUEST, 1, pid,
+                    [&answers, pid](CommandStatus status,
+                                    const Obd::EcuResults& results) {
+                        answers.push_back({pid, status, results});
+                    });
+    };
+
+    // A failed discovery fails the waiting requests, and is tried again.
+    request(0xA6);
+    device->respond(neon::CMD_TIMEOUT, {});
+    bool passed = check("Discovery failure",
+                        answers.size() == 1 &&
+                            answers.front().status == neon::CMD_TIMEOUT &&
+                            device->commands.empty());
+
+    // Each map says the next one is supported; the A0 map also has the
+    // odometer (PID A6).
+    request(0xA6);
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20, 0x00,
+                            0x00, 0x00, 0x01, 0x40, 0x00, 0x00, 0x00, 0x01,
+                            0x60, 0x00, 0x00, 0x00, 0x01, 0x80, 0x00, 0x00,
+                            0x00, 0x01, 0xA0, 0x04, 0x00, 0x00, 0x01}}});
+    passed &= check("Next map",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0xC0});
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0xC0, 0x00, 0x00, 0x00, 0x00}}});
+    passed &= check("Supported request",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0xA6});
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0xA6, 0x00, 0x00, 0x03, 0xE8}}});
+    passed &= check("Supported result",
+                    answers.size() == 2 &&
+                        answers.back().results ==
+                            Obd::EcuResults{{ECM, values({1000 * 0.1})}});
+
+    const auto supported = obd.get_supported_PIDs(ECM, 1);
+    passed &= check("Supported PIDs", supported.count() == 8 &&
+                                          supported.test(0xA6) &&
+                                          supported.test(0xC0) &&
+                                          !supported.test(0x0C));
+
+    request(0x0C);
+    passed &= check("Unsupported request",
+                    answers.size() == 3 &&
+                        answers.back().status == neon::CMD_NO_DATA &&
+                        device->commands.empty());
+
+    VehicleProfile profile;
+    obd.update_profile(profile);
+    passed &= check("Profile update",
+                    profile.ecus.size() == 1 &&
+                        profile.ecus.front().header == ECM &&
+                        profile.ecus.front().supported_pids == supported);
+    return passed;
+}
+
+// Polls run on the event loop's timers, fastest first.
+static bool polling_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+    static constexpr int SAMPLES = 5;
+
+    VehicleProfile profile;
+    profile.ecus.resize(1);
+    profile.ecus.front().header = ECM;
+    profile.ecus.front().supported_pids.set(0x05);
+    profile.ecus.front().supported_pids.set(0x0C);
+
+    EventLoop loop;
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.set_event_loop(&loop);
+    obd.apply_profile(profile);
+
+    int coolant = 0;
+    int rpm = 0;
+    obd.poll_PID(FUNCTIONAL, 1, 0x05, 1,
+                 [&coolant](CommandStatus /*status*/,
+                            const Obd::EcuResults& /*results*/) {
+                     ++coolant;
+                 });
+    const auto rpm_poll =
+        obd.poll_PID(FUNCTIONAL, 1, 0x0C, 100,
+                     [&rpm](CommandStatus status,
+                            const Obd::EcuResults& /*results*/) {
+                         rpm += status == neon::CMD_OK ? 1 : 0;
+                     });
+    bool passed = check("Not polled before init", device->commands.empty());
+
+    obd.init(device, nullptr, [](bool /*success*/) {});
+    passed &= check("Rate monotonic",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x0C});
+
+    for (int sample = 0; sample < SAMPLES; ++sample) {
+        for (int i = 0; i < SAMPLES && device->commands.empty(); ++i) {
+            loop.run_once(std::chrono::milliseconds(100));
+        }
+        if (device->commands.empty()) {
+            break;
+        }
+        if (device->commands.front().data.front() == 0x0C) {
+            device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x10, 0x00}}});
+        } else {
+            device->respond(neon::CMD_OK, {{ECM, {0x41, 0x05, 0x50}}});
+        }
+    }
+    passed &= check("Polled", coolant == 1 && rpm == SAMPLES - 1);
+    const auto& stats = obd.get_poll_stats(rpm_poll);
+    passed &= check("Poll stats", stats.samples == SAMPLES - 1 &&
+                                      stats.requested_rate == 100 &&
+                                      stats.achieved_rate > 0);
+
+    obd.stop_polling(rpm_poll);
+    for (int i = 0; i < SAMPLES && device->commands.empty(); ++i) {
+        loop.run_once(std::chrono::milliseconds(10));
+    }
+    passed &= check("Stopped", device->commands.empty() &&
+                                   rpm == SAMPLES - 1);
+    return passed;
+}
+
+// Subscribers to the same PID share one poll at the fastest rate.
+static bool subscription_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+
+    VehicleProfile profile;
+    profile.ecus.resize(1);
+    profile.ecus.front().header = ECM;
+    profile.ecus.front().supported_pids.set(0x0C);
+
+    EventLoop loop;
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.set_event_loop(&loop);
+    obd.apply_profile(profile);
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::array<int, 3> counts{};
+    std::array<Obd::SubscriptionId, 3> ids{};
+    ids.at(0) = obd.subscribe(FUNCTIONAL, 1, 0x0C, 10,
+                              [&counts](CommandStatus /*status*/,
+                                        const Obd::EcuResults& /*results*/) {
+                                  ++counts.at(0);
+                              });
+    ids.at(1) = obd.subscribe(FUNCTIONAL, 1, 0x0C, 100,
+                              [&counts](CommandStatus /*status*/,
+                                        const Obd::EcuResults& /*results*/) {
+                                  ++counts.at(1);
+                              });
+    // The third leaves from its own callback.
+    ids.at(2) = obd.subscribe(
+        FUNCTIONAL, 1, 0x0C, 50,
+        [&obd, &counts, &ids](CommandStatus /*status*/,
+                              const Obd::EcuResults& /*results*/) {
+            ++counts.at(2);
+            obd.unsubscribe(ids.at(2));
+        });
+
+    bool passed = check("One request", device->commands.size() == 1);
+    passed &= check("Fastest rate",
+                    obd.get_subscription_stats(ids.at(0)).requested_rate ==
+                        100);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Fan out", counts == std::array<int, 3>{1, 1, 1});
+
+    // The fastest subscriber leaves, so the poll slows down.
+    obd.unsubscribe(ids.at(1));
+    passed &= check("Slower rate",
+                    obd.get_subscription_stats(ids.at(0)).requested_rate ==
+                        10);
+    for (int i = 0; i < 3 && device->commands.empty(); ++i) {
+        loop.run_once(std::chrono::milliseconds(200));
+    }
+    if (!device->commands.empty()) {
+        device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    }
+    passed &= check("Unsubscribed", counts == std::array<int, 3>{2, 1, 1});
+
+    // The last subscriber leaving stops the poll.
+    obd.unsubscribe(ids.at(0));
+    loop.run_once(std::chrono::milliseconds(200));
+    passed &= check("Poll stopped", device->commands.empty());
+    return passed;
+}
+// Answers to PIDs with a ttl are served from the cache until it is
+// invalidated.
+static bool cache_test() {
+    static constexpr unsigned int ECM_REQUEST = 0x7E0;
+    static constexpr unsigned int ECM = 0x7E8;
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::vector<Answer> answers;
+    auto request = [&obd, &answers](unsigned char pid) {
+        obd.get_PID(ECM_REQUEST, 1, pid,
+                    [&answers, pid](CommandStatus status,
+                                    const Obd::EcuResults& results) {
+                        answers.push_back({pid, status, results});
+                    });
+    };
+
+    // The ECM supports RPM (PID 0C) and the OBD standard (PID 1C).
+    request(0x1C);
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x10, 0x00, 0x10}}});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x1C, 0x06}}});
+    request(0x1C);
+    bool passed = check("Cached result",
+                        answers.size() == 2 && device->commands.empty() &&
+                            answers.back().status == neon::CMD_OK &&
+                            answers.back().results ==
+                                Obd::EcuResults{{ECM, values({6})}});
+
+    request(0x00);
+    passed &= check("Cached map", answers.size() == 3 &&
+                                      device->commands.empty() &&
+                                      answers.back().status == neon::CMD_OK);
+
+    request(0x0C);
+    passed &= check("Live data not cached", device->commands.size() == 1);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+
+    obd.invalidate_cache();
+    request(0x1C);
+    passed &= check("Invalidated", device->commands.size() == 1 &&
+                                       answers.size() == 4);
+    return passed;
+}
+// A diagnostic sequence written as a coroutine: a raw command to the
+// device, then PIDs through Obd, one after another.
+static Task<> read_sequence(FakeObdDevice& device, Obd& obd,
+                            std::vector<Answer>& answers) {
+    static constexpr std::array<unsigned char, 1> MAP{0x00};
+    static constexpr std::array<unsigned char, 3> PIDS{0x1C, 0x1C, 0x0C};
+    const auto [status, frames] = co_await device.command(0x7E0, 1, MAP);
+    answers.push_back({0x00, status,
+                       {{frames.front().header,
+                         values({static_cast<double>(frames.size())})}}});
+    for (const unsigned char pid : PIDS) {
+        const auto [pid_status, results] =
+            co_await obd.read_PID(0x7E0, 1, pid);
+        answers.push_back({pid, pid_status, results});
+    }
+}
+
+static bool coroutine_test() {
+    static constexpr unsigned int ECM = 0x7E8;
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::vector<Answer> answers;
+    read_sequence(*device, obd, answers).start();
+    bool passed = check("Command sent", device->commands.size() == 1 &&
+                                            answers.empty());
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x10, 0x00, 0x10}}});
+    passed &= check("Command result",
+                    answers.size() == 1 &&
+                        answers.back().results ==
+                            Obd::EcuResults{{ECM, values({1})}});
+
+    // Discovery, then PID 1C.  The second request for it is answered
+    // from the cache without suspending.
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x10, 0x00, 0x10}}});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x1C, 0x06}}});
+    passed &= check("Cached PID",
+                    answers.size() == 3 && device->commands.size() == 1 &&
+                        answers.back().results ==
+                            Obd::EcuResults{{ECM, values({6})}});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Sequence complete",
+                    answers.size() == 4 && device->commands.empty() &&
+                        answers.back().results ==
+                            Obd::EcuResults{{ECM, values({1726})}});
+
+    // An awaiter destroyed while its task is suspended, as when the task
+    // is destroyed, cancels its command and the answer is dropped.
+    static constexpr std::array<unsigned char, 1> MAP{0x00};
+    {
+        auto awaiter = device->command(0x7E0, 1, MAP);
+        static_cast<void>(awaiter.await_suspend(std::noop_coroutine()));
+    }
+    passed &= check("Destroyed command awaiter",
+                    device->commands.size() == 1 &&
+                        *device->commands.front().cancelled);
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x10, 0x00, 0x10}}});
+    obd.invalidate_cache();
+    {
+        auto awaiter = obd.read_PID(0x7E0, 1, 0x0C);
+        static_cast<void>(awaiter.await_suspend(std::noop_coroutine()));
+    }
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Destroyed PID awaiter",
+                    answers.size() == 4 && device->commands.empty());
+    return passed;
+}
+
+// An ECU that rejects a functional multi-PID request is asked for each
+// PID at its physical address.  From then on, the PIDs it supports are
+// requested on their own at the functional address, while the others
+// are still requested together.
+static bool partial_rejection_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+    static constexpr unsigned int TCM = 0x7E9;
+    static constexpr unsigned int ABS = 0x7EA;
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    std::vector<Answer> answers;
+    auto request = [&obd, &answers](unsigned char pid) {
+        obd.get_PID(FUNCTIONAL, 1, pid,
+                    [&answers, pid](CommandStatus status,
+                                    const Obd::EcuResults& results) {
+                        answers.push_back({pid, status, results});
+                    });
+    };
+
+    // The ECM and TCM support PIDs 0C-0E, and the ECM and ABS 0F-10.
+    request(0x0C);
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x1F, 0x00, 0x00}},
+                     {TCM, {0x41, 0x00, 0x00, 0x1C, 0x00, 0x00}},
+                     {ABS, {0x41, 0x00, 0x00, 0x03, 0x00, 0x00}}});
+    request(0x0D);
+    request(0x0E);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}},
+                                   {TCM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0D, 0x32, 0x0E, 0x80}},
+                                   {TCM, {0x7F, 0x01, 0x12}}});
+    bool passed = check("Rejecting ECU asked alone",
+                        answers.size() == 1 && device->commands.size() == 1 &&
+                            device->commands.front().address == 0x7E1 &&
+                            device->commands.front().data ==
+                                std::vector<unsigned char>{0x0D});
+    device->respond(neon::CMD_OK, {{TCM, {0x41, 0x0D, 0x33}}});
+    device->respond(neon::CMD_NO_DATA, {});
+    passed &= check(
+        "Merged results",
+        answers.size() == 3 &&
+            answers.at(1).results ==
+                Obd::EcuResults{{ECM, values({50})}, {TCM, values({51})}} &&
+            answers.at(2).status == neon::CMD_OK &&
+            answers.at(2).results == Obd::EcuResults{{ECM, values({0})}});
+
+    request(0x0E);
+    request(0x0D);
+    request(0x0F);
+    request(0x10);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0E, 0x80}},
+                                   {TCM, {0x41, 0x0E, 0x81}}});
+    passed &= check("Supported PID alone",
+                    device->commands.size() == 1 &&
+                        device->commands.front().address == FUNCTIONAL &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x0D});
+    answers.clear();
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0D, 0x32}},
+                                   {TCM, {0x41, 0x0D, 0x33}}});
+    passed &= check("Functional batching kept",
+                    answers.size() == 1 && device->commands.size() == 1 &&
+                        device->commands.front().address == FUNCTIONAL &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x0F, 0x10});
+
+    // The TCM's rejection of PIDs it does not support is not retried.
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x0F, 0x50, 0x10, 0x01, 0x2C}},
+                     {TCM, {0x7F, 0x01, 0x12}},
+                     {ABS, {0x41, 0x0F, 0x51, 0x10, 0x00, 0x00}}});
+    passed &= check("Known rejection ignored",
+                    answers.size() == 3 && device->commands.empty() &&
+                        answers.at(1).results ==
+                            Obd::EcuResults{{ECM, values({40})},
+                                            {ABS, values({41})}} &&
+                        answers.at(2).results ==
+                            Obd::EcuResults{{ECM, values({3})},
+                                            {ABS, values({0})}});
+    return passed;
+}
+
+static Task<> read_once(Obd& obd, unsigned char pid,
+                        std::vector<CommandStatus>& statuses) {
+    const auto reply = co_await obd.read_PID(0x7E0, 1, pid);
+    statuses.push_back(reply.status);
+}
+
+// Tasks awaiting requests that are dropped on disconnect are resumed
+// with CMD_CANCELLED.
+static bool disconnect_test() {
+    static constexpr unsigned int ECM = 0x7E8;
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.init(device, nullptr, [](bool /*success*/) {});
+
+    // Waiting for discovery.
+    std::vector<CommandStatus> statuses;
+    read_once(obd, 0x0C, statuses).start();
+    bool disconnected = false;
+    obd.disconnect([&disconnected] { disconnected = true; });
+    bool passed = check("Discovery cancelled",
+                        disconnected &&
+                            statuses == std::vector<CommandStatus>{
+                                            neon::CMD_CANCELLED});
+
+    // One request in flight and one queued behind it.
+    device->commands.clear();
+    obd.init(device, nullptr, [](bool /*success*/) {});
+    statuses.clear();
+    read_once(obd, 0x0C, statuses).start();
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0x00, 0x18, 0x00, 0x00}}});
+    read_once(obd, 0x0D, statuses).start();
+    passed &= check("Request in flight", device->commands.size() == 1 &&
+                                             statuses.empty());
+    obd.disconnect([] {});
+    passed &= check("Requests cancelled",
+                    statuses == std::vector<CommandStatus>{
+                                    neon::CMD_CANCELLED, neon::CMD_CANCELLED});
+
+    // A late answer from the device is dropped.
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Late answer dropped", statuses.size() == 2);
+    return passed;
+}
+
+// Answer to service $09 PID $02 on CAN.
+static std::vector<unsigned char> vin_response(const std::string& vin) {
+    std::vector<unsigned char> response{0x49, 0x02, 0x01};
+    response.insert(response.end(), vin.begin(), vin.end());
+    return response;
+}
+
+// The profile of the vehicle last used with the adapter is applied on
+// connect, and replaced if the VIN is another vehicle's.  What was
+// learned is saved on disconnect.
+static bool profile_store_test() {
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+    static const std::string ADAPTER = "00:11:22:33:44:55";
+    static const std::string VIN = "1D4GP00R55B123456";
+    static const std::string OTHER_VIN = "1FTFW1ET5DFC10312";
+
+    const auto path = std::filesystem::temp_directory_path() /
+                      ("obd-test-profiles-" + std::to_string(getpid()));
+    ProfileStore store(path);
+    VehicleProfile profile;
+    profile.adapter_id = ADAPTER;
+    profile.vin = VIN;
+    profile.firmware = "ELM327 v1.5";
+    profile.ecus.push_back({ECM, {}, {}});
+    profile.ecus.back().supported_pids.set(0x0C);
+    store.update(profile);
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    obd.set_profile_store(&store, ADAPTER, FUNCTIONAL);
+    bool connected = false;
+    auto connect = [&obd, &device, &connected] {
+        connected = false;
+        obd.init(device, nullptr,
+                 [&connected](bool success) { connected = success; });
+    };
+    connect();
+    bool passed = check(
+        "VIN requested",
+        !connected && device->applied.firmware == "ELM327 v1.5" &&
+            device->commands.size() == 1 &&
+            device->commands.front().address == FUNCTIONAL &&
+            device->commands.front().service == 0x09 &&
+            device->commands.front().data == std::vector<unsigned char>{0x02});
+    device->respond(neon::CMD_OK, {{ECM, vin_response(VIN)}});
+    passed &= check("Connected", connected && obd.get_VIN() == VIN);
+
+    // The supported PIDs are known, so there is no discovery.
+    obd.get_PID(FUNCTIONAL, 1, 0x0C,
+                [](CommandStatus /*status*/,
+                   const Obd::EcuResults& /*results*/) {});
+    passed &= check("No discovery", device->commands.size() == 1 &&
+                                        device->commands.front().data ==
+                                            std::vector<unsigned char>{0x0C});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    obd.disconnect([] {});
+
+    ProfileStore saved(path);
+    const auto* found = saved.load() ? saved.find(ADAPTER, VIN) : nullptr;
+    passed &= check("Profile saved",
+                    found != nullptr && found->firmware == "ELM327 v2.1" &&
+                        found->ecus.size() == 1 &&
+                        found->ecus.front().supported_pids.test(0x0C));
+
+    // Another vehicle's PIDs are discovered.
+    connect();
+    device->respond(neon::CMD_OK, {{ECM, vin_response(OTHER_VIN)}});
+    obd.get_PID(FUNCTIONAL, 1, 0x0C,
+                [](CommandStatus /*status*/,
+                   const Obd::EcuResults& /*results*/) {});
+    passed &= check("Other vehicle",
+                    connected && obd.get_VIN() == OTHER_VIN &&
+                        device->commands.size() == 1 &&
+                        device->commands.front().data.front() == 0x00);
+    obd.disconnect([] {});
+    passed &= check("Both saved", saved.load() && saved.size() == 2);
+
+    std::filesystem::remove(path);
+    return passed;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    static constexpr unsigned int FUNCTIONAL = 0x7DF;
+    static constexpr unsigned int ECM = 0x7E8;
+    static constexpr unsigned int TCM = 0x7E9;
+
+    auto device = std::make_shared<FakeObdDevice>();
+    Obd obd;
+    bool connected = false;
+    obd.init(device, nullptr, [&connected](bool success) {
+        connected = success;
+    });
+    if (!check("Init", connected)) {
+        return 1;
+    }
+
+    std::vector<Answer> answers;
+    auto request = [&obd, &answers](unsigned char pid) {
+        obd.get_PID(FUNCTIONAL, 1, pid,
+                    [&answers, pid](CommandStatus status,
+                                    const Obd::EcuResults& results) {
+                        answers.push_back({pid, status, results});
+                    });
+    };
+
+    bool passed = true;
+
+    // The first request waits for the supported PID maps.  Both ECUs
+    // support PIDs 01-13.
+    request(0x0B);
+    passed &= check("Discovery",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x00, 0x20, 0x40, 0x60,
+                                                       0x80, 0xA0});
+    device->respond(neon::CMD_OK,
+                    {{ECM, {0x41, 0x00, 0xFF, 0xFF, 0xE0, 0x00}},
+                     {TCM, {0x41, 0x00, 0xFF, 0xFF, 0xE0, 0x00}}});
+
+    // It then goes out alone; the next eight wait for it and are packed
+    // six and two.
+    for (unsigned char pid = 0x0C; pid <= 0x13; ++pid) {
+        request(pid);
+    }
+    passed &= check("First request",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x0B});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0B, 0x64}}});
+
+    passed &= check("Six PID batch",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x0C, 0x0D, 0x0E, 0x0F,
+                                                       0x10, 0x11});
+
+    // Two ECUs answer different parts of the batch.
+    device->respond(neon::CMD_OK,
+                    {{ECM,
+                      {0x41, 0x0C, 0x1A, 0xF8, 0x0D, 0x32, 0x0E, 0x80, 0x10,
+                       0x01, 0x90}},
+                     {TCM, {0x41, 0x0D, 0x33, 0x0F, 0x46}}});
+    passed &= check(
+        "Batch demultiplex",
+        answers.size() == 7 && answers.at(1).pid == 0x0C &&
+            answers.at(1).results ==
+                Obd::EcuResults{{ECM, values({1726})}} &&
+            answers.at(2).results ==
+                Obd::EcuResults{{ECM, values({50})}, {TCM, values({51})}} &&
+            answers.at(4).results == Obd::EcuResults{{TCM, values({30})}} &&
+            answers.at(5).results ==
+                Obd::EcuResults{{ECM, values({400 * 0.01})}} &&
+            answers.at(6).pid == 0x11 &&
+            answers.at(6).status == neon::CMD_NO_DATA);
+
+    passed &= check("Remaining batch",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x12, 0x13});
+
+    // An ECU that rejects the multi-PID request gets single PIDs.
+    device->respond(neon::CMD_OK, {{ECM, {0x7F, 0x01, 0x12}}});
+    passed &= check("Fall back",
+                    answers.size() == 7 && device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x12});
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x12, 0x01}}});
+    passed &= check("Fall back second PID",
+                    device->commands.size() == 1 &&
+                        device->commands.front().data ==
+                            std::vector<unsigned char>{0x13});
+    device->respond(neon::CMD_NO_DATA, {});
+    passed &= check("Fall back results",
+                    answers.size() == 9 &&
+                        answers.at(7).results ==
+                            Obd::EcuResults{{ECM, values({1})}} &&
+                        answers.at(8).status == neon::CMD_NO_DATA);
+
+    request(0x01);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x01, 0x83, 0x07, 0x65, 0x04}}});
+    passed &= check("MIL status",
+                    answers.size() == 10 &&
+                        answers.at(9).results ==
+                            Obd::EcuResults{{ECM, values({1, 3, 0x07, 0x65,
+                                                          0x04})}});
+
+    // Only the ECM answered PID 0C, so it is asked directly; both ECUs
+    // answered PID 0D.
+    request(0x0C);
+    passed &= check("Physical route", device->commands.size() == 1 &&
+                                          device->commands.front().address ==
+                                              0x7E0);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0C, 0x1A, 0xF8}}});
+    passed &= check("Physical result",
+                    answers.size() == 11 &&
+                        answers.back().results ==
+                            Obd::EcuResults{{ECM, values({1726})}});
+    request(0x0D);
+    passed &= check("Functional route", device->commands.size() == 1 &&
+                                            device->commands.front().address ==
+                                                FUNCTIONAL);
+    device->respond(neon::CMD_OK, {{ECM, {0x41, 0x0D, 0x32}}});
+
+    // Neither ECU supports PID 14, so it is not sent.
+    request(0x14);
+    passed &= check("Unsupported PID",
+                    answers.size() == 13 && answers.back().pid == 0x14 &&
+                        answers.back().status == neon::CMD_NO_DATA &&
+                        device->commands.empty());
+
+    bool disconnected = false;
+    obd.disconnect([&disconnected]() { disconnected = true; });
+    passed &= check("Disconnect", disconnected);
+
+    passed &= early_completion_test();
+    passed &= relearn_test();
+    passed &= gear_batch_test();
+    passed &= discovery_test();
+    passed &= polling_test();
+    passed &= subscription_test();
+    passed &= cache_test();
+    passed &= coroutine_test();
+    passed &= partial_rejection_test();
+    passed &= disconnect_test();
+    passed &= profile_store_test();
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "logger.hpp"
+#include "poll-scheduler.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+using Clock = PollScheduler::Clock;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+// Run the polls over a link that answers one request at a time, each
+// taking request_time, for duration.
+static void simulate(PollScheduler& scheduler, Clock::time_point& now,
+                     Clock::duration request_time, Clock::duration duration) {
+    const auto end = now + duration;
+    std::vector<PollScheduler::Id> due;
+    while (now < end) {
+        scheduler.take_due(1, due, now);
+        if (due.empty()) {
+            now = std::max(now + 1ms, *scheduler.next_release());
+            continue;
+        }
+        now += request_time;
+        scheduler.complete(due.front(), true, now);
+    }
+}
+
+static bool order_test() {
+    PollScheduler scheduler;
+    const Clock::time_point start;
+    const auto slow = scheduler.add(10s, start);
+    const auto medium = scheduler.add(1s, start);
+    const auto fast = scheduler.add(50ms, start);
+
+    std::vector<PollScheduler::Id> due;
+    scheduler.take_due(2, due, start);
+    bool passed = check("Rate monotonic order",
+                        due == std::vector<PollScheduler::Id>{fast, medium});
+    scheduler.take_due(2, due, start);
+    passed &= check("In flight limit", due.empty());
+
+    scheduler.complete(fast, true, start + 10ms);
+    scheduler.take_due(2, due, start + 10ms);
+    passed &= check("Released once", due == std::vector<PollScheduler::Id>{
+                                                slow});
+    passed &= check("Next release",
+                    scheduler.next_release() == start + 50ms);
+
+    scheduler.remove(slow);
+    passed &= check("Reused id", scheduler.add(1s, start) == slow &&
+                                     scheduler.size() == 3);
+    return passed;
+}
+
+static bool rate_test() {
+    PollScheduler scheduler;
+    Clock::time_point now;
+    const auto fast = scheduler.add(50ms, now);
+    const auto slow = scheduler.add(1s, now);
+
+    // The link has room for both.
+    simulate(scheduler, now, 10ms, 10s);
+    const auto& fast_stats = scheduler.get_stats(fast);
+    bool passed = check("Requested rate", fast_stats.requested_rate == 20);
+    passed &= check("Achieved rate", fast_stats.achieved_rate > 19.5 &&
+                                         fast_stats.achieved_rate < 20.5);
+    passed &= check("Jitter", fast_stats.jitter.count() ==
+                                      fast_stats.samples - 1 &&
+                                  fast_stats.jitter.max() <= 10ms);
+    passed &= check("Slow rate", scheduler.get_stats(slow).samples >= 10);
+
+    // Saturated: three polls want 31 requests a second, but the link
+    // only carries 25.  The fastest keeps its rate, and the slowest
+    // still gets through.
+    const auto medium = scheduler.add(100ms, now);
+    simulate(scheduler, now, 40ms, 20s);
+    passed &= check("Saturated fast rate",
+                    scheduler.get_stats(fast).achieved_rate > 19);
+    passed &= check("Saturated medium missed",
+                    scheduler.get_stats(medium).missed > 0 &&
+                        scheduler.get_stats(medium).achieved_rate < 10);
+    passed &= check("Saturated slow rate",
+                    scheduler.get_stats(slow).achieved_rate > 0.2);
+
+    // The fast poll alone fills the link, but the slow one still gets
+    // through once it has waited long enough.
+    PollScheduler saturated;
+    const auto hog = saturated.add(50ms, now);
+    const auto starved = saturated.add(1s, now);
+    simulate(saturated, now, 50ms, 20s);
+    passed &= check("Starved poll",
+                    saturated.get_stats(starved).samples >= 4 &&
+                        saturated.get_stats(hog).achieved_rate > 15);
+
+    // Slowing the poll down takes effect at once.
+    scheduler.set_period(fast, 1s);
+    simulate(scheduler, now, 10ms, 10s);
+    passed &= check("Set period",
+                    scheduler.get_stats(fast).requested_rate == 1 &&
+                        scheduler.get_stats(fast).achieved_rate < 2);
+    return passed;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    bool passed = order_test();
+    passed &= rate_test();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "logger.hpp"
+#include "profile-store.hpp"
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+static VehicleProfile make_profile(const std::string& adapter_id,
+                                   const std::string& vin) {
+    VehicleProfile profile;
+    profile.adapter_id = adapter_id;
+    profile.vin = vin;
+    profile.firmware = "ELM327 v1.5";
+    profile.st_firmware = "STN1110 v4.2.0";
+    profile.extensions = EXTENSION_RESPONSE_COUNT | EXTENSION_ST_COMMANDS;
+    profile.protocol = 6;
+
+    EcuProfile ecm;
+    ecm.header = 0x7E8;
+    ecm.response_time = 12345us;
+    for (const std::size_t pid : {0x00, 0x01, 0x0C, 0x0D, 0x20, 0xFF}) {
+        ecm.supported_pids.set(pid);
+    }
+    profile.ecus.push_back(ecm);
+    profile.ecus.push_back({0x18DAF110, 40ms, {}});
+    return profile;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    const auto path = std::filesystem::temp_directory_path() /
+                      ("profile-store-test-" + std::to_string(getpid()));
+    bool passed = true;
+
+    ProfileStore store(path);
+    passed &= check("Missing file", !store.load() && store.size() == 0);
+
+    store.update(make_profile("00:11:22:33:44:55", "1D4GP00R55B123456"));
+    store.update(make_profile("00:11:22:33:44:55", "1FTFW1ET5DFC10312"));
+    store.update(make_profile("/dev/ttyUSB0", "1D4GP00R55B123456"));
+    passed &= check("Save", store.save());
+
+    ProfileStore loaded(path);
+    passed &= check("Load", loaded.load() && loaded.size() == 3);
+
+    const auto* profile =
+        loaded.find("00:11:22:33:44:55", "1D4GP00R55B123456");
+    auto expected = make_profile("00:11:22:33:44:55", "1D4GP00R55B123456");
+    if (profile != nullptr) {
+        expected.last_used = profile->last_used;
+    }
+    passed &= check("Round trip", profile != nullptr &&
+                                      profile->last_used > 0 &&
+                                      *profile == expected);
+    passed &= check("Unknown VIN",
+                    loaded.find("00:11:22:33:44:55", "UNKNOWN") == nullptr);
+    passed &= check("Adapter", loaded.find("/dev/ttyUSB0") != nullptr &&
+                                   loaded.find("/dev/ttyUSB1") == nullptr);
+
+    // Replacing a profile does not add another.
+    loaded.update(make_profile("/dev/ttyUSB0", "1D4GP00R55B123456"));
+    passed &= check("Replace", loaded.size() == 3);
+
+    for (std::size_t i = 0; i < ProfileStore::MAX_PROFILES; ++i) {
+        loaded.update(make_profile("adapter", std::to_string(i)));
+    }
+    passed &= check("Limit", loaded.size() == ProfileStore::MAX_PROFILES);
+
+    // A truncated file is rejected.
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+    passed &= check("Truncated", !loaded.load() && loaded.size() == 0);
+
+    std::ofstream(path) << "not a profile store";
+    passed &= check("Invalid", !loaded.load());
+
+    // A file that can not be created is reported.
+    ProfileStore unwritable(path / "profiles");
+    unwritable.update(make_profile("/dev/ttyUSB0", "1D4GP00R55B123456"));
+    passed &= check("Unwritable", !unwritable.save());
+
+    std::filesystem::remove(path);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks that reads from a serial port wait for their timeout, using a
+// pseudo terminal as the port.  Skipped (exit code 77) if no pseudo
+// terminal can be opened.
+
+#include "event-loop.hpp"
+#include "logger.hpp"
+#include "serial-port.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static constexpr int SKIP = 77;
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+// Time taken by a read when nothing has been received.
+static std::chrono::steady_clock::duration timed_read(SerialPort& port) {
+    std::string buffer;
+    const auto start = std::chrono::steady_clock::now();
+    port.read(buffer);
+    return std::chrono::steady_clock::now() - start;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    const int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        Logger::info << "No pseudo terminal; skipping.\n";
+        return SKIP;
+    }
+    // NOLINTNEXTLINE(concurrency-mt-unsafe)
+    const std::string device_name = ptsname(master);
+
+    EventLoop loop;
+    SerialPort port;
+    loop.add_event_handler(port);
+    bool done = false;
+    bool connected = false;
+    port.connect(device_name, [&done, &connected](bool success) {
+        done = true;
+        connected = success;
+    });
+    while (!done) {
+        loop.run_once(1s);
+    }
+    bool passed = check("Connect", connected);
+
+    // Less than a decisecond still waits for one.
+    port.set_timeout(50ms);
+    passed &= check("Short timeout", timed_read(port) >= 50ms);
+    port.set_timeout(200ms);
+    passed &= check("Timeout", timed_read(port) >= 150ms);
+
+    loop.remove_event_handler(port);
+    close(master);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,345 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Needs a vcan interface:
+//   ip link add dev vcan0 type vcan && ip link set up vcan0
+// Skipped (exit code 77) if there is none.
+
+#include "event-loop.hpp"
+#include "logger.hpp"
+#include "neonobd_exceptions.hpp"
+#include "neonobd_types.hpp"
+#include "obd-device.hpp"
+#include "socket-can-device.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <linux/can.h>
+#include <linux/can/isotp.h>
+#include <linux/can/raw.h>
+#include <map>
+#include <net/if.h>
+#include <span>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+static const std::string INTERFACE = "vcan0";
+static constexpr int SKIP = 77;
+
+static const std::string VIN = "1NEONOBD0TEST0001";
+
+// A raw socket, or an ISO-TP socket if tx_id and rx_id are given.
+static int open_can_socket(canid_t tx_id = 0, canid_t rx_id = 0) {
+    const bool iso_tp = tx_id != 0;
+    const int fd = iso_tp ? ::socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC,
+                                     CAN_ISOTP)
+                          : ::socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    const unsigned int index = if_nametoindex(INTERFACE.c_str());
+    if (fd < 0 || index == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    timeval timeout{.tv_sec = 0, .tv_usec = 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (iso_tp) {
+        can_isotp_options options{};
+        options.flags = CAN_ISOTP_TX_PADDING;
+        setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &options,
+                   sizeof(options));
+    }
+
+    sockaddr_can address{};
+    address.can_family = AF_CAN;
+    address.can_ifindex = static_cast<int>(index);
+    address.can_addr.tp.tx_id = tx_id;
+    address.can_addr.tp.rx_id = rx_id;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Two ECUs on 11 bit CAN.  Both answer PID 0C; the engine ECU asks for
+// more time before answering PID 0D, and also answers the VIN and UDS
+// reads with multi-frame responses through its own ISO-TP socket;
+// nobody answers anything else.
+class EcuEmulator {
+  public:
+    EcuEmulator(int fd, int iso_tp_fd) : m_fd{fd}, m_iso_tp_fd{iso_tp_fd} {
+        m_thread = std::thread([this]() { run(); });
+        m_iso_tp_thread = std::thread([this]() { run_iso_tp(); });
+    }
+    EcuEmulator(const EcuEmulator&) = delete;
+    EcuEmulator& operator=(const EcuEmulator&) = delete;
+    ~EcuEmulator() {
+        m_stop = true;
+        m_thread.join();
+        m_iso_tp_thread.join();
+        close(m_fd);
+        close(m_iso_tp_fd);
+    }
+
+  private:
+    int m_fd;
+    int m_iso_tp_fd;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+    std::thread m_iso_tp_thread;
+
+    void send(unsigned int id, std::span<const unsigned char> data) const {
+        can_frame frame{};
+        frame.can_id = id;
+        frame.len = CAN_MAX_DLEN;
+        frame.data[0] = static_cast<unsigned char>(data.size());
+        std::ranges::copy(data, std::span(frame.data).subspan(1).begin());
+        static_cast<void>(::write(m_fd, &frame, sizeof(frame)));
+    }
+
+    void run() const {
+        while (!m_stop) {
+            can_frame frame{};
+            if (::read(m_fd, &frame, sizeof(frame)) !=
+                static_cast<ssize_t>(sizeof(frame))) {
+                continue;
+            }
+            const auto id = frame.can_id;
+            const bool functional = id == 0x7DF;
+            // Only single frame requests; the rest are for the ISO-TP
+            // socket.
+            if ((!functional && id != 0x7E0 && id != 0x7E1) ||
+                (frame.data[0] & 0xF0) != 0) {
+                continue;
+            }
+
+            const unsigned char pid = frame.data[2];
+            if (frame.data[1] == 0x09 && pid == 0x02 &&
+                (functional || id == 0x7E0)) {
+                std::vector<unsigned char> response{0x49, 0x02, 0x01};
+                response.insert(response.end(), VIN.begin(), VIN.end());
+                static_cast<void>(
+                    ::write(m_iso_tp_fd, response.data(), response.size()));
+            }
+            if (frame.data[1] != 0x01) {
+                continue;
+            }
+            if (pid == 0x0C) {
+                const std::array<unsigned char, 4> rpm{0x41, 0x0C, 0x1A, 0xF8};
+                if (functional || id == 0x7E0) {
+                    send(0x7E8, rpm);
+                }
+                if (functional || id == 0x7E1) {
+                    send(0x7E9, rpm);
+                }
+            } else if (pid == 0x0D && (functional || id == 0x7E0)) {
+                send(0x7E8, std::array<unsigned char, 3>{0x7F, 0x01, 0x78});
+                std::this_thread::sleep_for(80ms);
+                send(0x7E8, std::array<unsigned char, 3>{0x41, 0x0D, 0x32});
+            }
+        }
+    }
+
+    // Answers a UDS read of several identifiers with each identifier
+    // followed by two bytes of data.
+    void run_iso_tp() const {
+        std::array<unsigned char, 64> request{};
+        while (!m_stop) {
+            const auto size = ::read(m_iso_tp_fd, request.data(),
+                                     request.size());
+            if (size < 3 || request[0] != 0x22) {
+                continue;
+            }
+            std::vector<unsigned char> response{0x62};
+            for (std::size_t i = 1; i + 1 < static_cast<std::size_t>(size);
+                 i += 2) {
+                response.insert(response.end(),
+                                {request.at(i), request.at(i + 1), 0xAB,
+                                 0xCD});
+            }
+            static_cast<void>(
+                ::write(m_iso_tp_fd, response.data(), response.size()));
+        }
+    }
+};
+
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+struct Result {
+    CommandStatus status = neon::CMD_ERROR;
+    std::map<unsigned int, std::vector<unsigned char>> frames;
+    std::chrono::steady_clock::duration elapsed{};
+};
+
+static Result request(EventLoop& loop, SocketCanDevice& device,
+                      unsigned int address, unsigned char service,
+                      std::span<const unsigned char> data) {
+    Result result;
+    bool done = false;
+    const auto start = std::chrono::steady_clock::now();
+    device.send_command(
+        address, service, data,
+        [&](CommandStatus status, ObdDevice::CommandResult frames) {
+            done = true;
+            result.status = status;
+            for (const auto& frame : frames) {
+                result.frames[frame.header].assign(frame.data.begin(),
+                                                   frame.data.end());
+            }
+        },
+        {});
+    const auto deadline = start + 10s;
+    while (!done && std::chrono::steady_clock::now() < deadline) {
+        loop.run_once(1s);
+    }
+    result.elapsed = std::chrono::steady_clock::now() - start;
+    return result;
+}
+
+static Result request(EventLoop& loop, SocketCanDevice& device,
+                      unsigned int address, unsigned char pid) {
+    const std::array<unsigned char, 1> data{pid};
+    return request(loop, device, address, 1, data);
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    const int ecu_socket = open_can_socket();
+    const int iso_tp_socket = open_can_socket(0x7E8, 0x7E0);
+    if (ecu_socket < 0 || iso_tp_socket < 0) {
+        Logger::info << INTERFACE << " or ISO-TP not available; skipping.\n";
+        if (ecu_socket >= 0) {
+            close(ecu_socket);
+        }
+        return SKIP;
+    }
+    const EcuEmulator ecus(ecu_socket, iso_tp_socket);
+
+    EventLoop loop;
+    SocketCanDevice device(INTERFACE);
+    loop.add_event_handler(device);
+    // Flow control after every frame.
+    device.set_iso_tp_options({.block_size = 1, .st_min = 0});
+
+    bool done = false;
+    bool connected = false;
+    device.init(nullptr, [&done, &connected](bool success) {
+        done = true;
+        connected = success;
+    });
+    while (!done) {
+        loop.run_once(1s);
+    }
+    if (!check("Init", connected)) {
+        return 1;
+    }
+
+    bool passed = true;
+    const std::vector<unsigned char> rpm{0x41, 0x0C, 0x1A, 0xF8};
+
+    auto result = request(loop, device, 0x7DF, 0x0C);
+    passed &= check("Functional", result.status == neon::CMD_OK &&
+                                      result.frames.size() == 2 &&
+                                      result.frames[0x7E8] == rpm &&
+                                      result.frames[0x7E9] == rpm);
+
+    // A physical request completes as soon as its ECU answers.
+    result = request(loop, device, 0x7E1, 0x0C);
+    passed &= check("Physical", result.status == neon::CMD_OK &&
+                                    result.frames.size() == 1 &&
+                                    result.frames[0x7E9] == rpm &&
+                                    result.elapsed < 40ms);
+
+    result = request(loop, device, 0x7DF, 0x11);
+    passed &= check("No data", result.status == neon::CMD_NO_DATA &&
+                                   result.frames.empty());
+
+    // The answer comes after the normal timeout, but the ECU asked for
+    // more time.
+    result = request(loop, device, 0x7E0, 0x0D);
+    passed &= check("Response pending",
+                    result.status == neon::CMD_OK &&
+                        result.frames[0x7E8] ==
+                            std::vector<unsigned char>{0x41, 0x0D, 0x32});
+
+    // Three frames from the engine ECU, with flow control after each.
+    const std::array<unsigned char, 1> vin_pid{0x02};
+    result = request(loop, device, 0x7DF, 0x09, vin_pid);
+    std::vector<unsigned char> vin{0x49, 0x02, 0x01};
+    vin.insert(vin.end(), VIN.begin(), VIN.end());
+    passed &= check("VIN", result.status == neon::CMD_OK &&
+                               result.frames.size() == 1 &&
+                               result.frames[0x7E8] == vin);
+
+    // Both the request and the response take several frames.
+    const std::array<unsigned char, 8> identifiers{0xF1, 0x90, 0xF1, 0x8C,
+                                                   0xF1, 0x87, 0xF1, 0x89};
+    result = request(loop, device, 0x7E0, 0x22, identifiers);
+    passed &= check("Multi-frame request",
+                    result.status == neon::CMD_OK &&
+                        result.frames[0x7E8].size() == 17 &&
+                        result.frames[0x7E8][0] == 0x62 &&
+                        result.elapsed < 40ms);
+
+    result = request(loop, device, 0x7DF, 0x22, identifiers);
+    passed &= check("Functional multi-frame request",
+                    result.status == neon::CMD_ERROR);
+
+    bool rejected = false;
+    try {
+        device.set_iso_tp_options({});
+    } catch (const neon::InvalidState&) {
+        rejected = true;
+    }
+    passed &= check("Options while connected", rejected);
+
+    passed &= check("Response times",
+                    device.get_response_times().count() >= 6);
+
+    done = false;
+    device.disconnect([&done]() { done = true; });
+    while (!done) {
+        loop.run_once(1s);
+    }
+    loop.remove_event_handler(device);
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/* This file is part of neonobd - OBD diagnostic software.
+ * Copyright (C) 2026  Brian LePage
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "logger.hpp"
+#include "task.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// NOLINTBEGIN(misc-use-anonymous-namespace,misc-use-internal-linkage)
+static bool check(const std::string& name, bool condition) {
+    if (!condition) {
+        Logger::error << name << " failed.\n";
+    }
+    return condition;
+}
+
+// Suspends until the test resumes the waiting coroutine.
+struct Event {
+    std::coroutine_handle<> waiting;
+
+    [[nodiscard]] bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { waiting = handle; }
+    void await_resume() const noexcept {}
+
+    void fire() { std::exchange(waiting, nullptr).resume(); }
+};
+
+static Task<int> add(Event& event, int first, int second) {
+    co_await event;
+    co_return first + second;
+}
+
+static Task<int> fail(Event& event) {
+    co_await event;
+    throw std::runtime_error("Step failed");
+}
+
+// Runs the steps one after another, as a diagnostic sequence does.
+static Task<> sequence(Event& event, std::vector<int>& results) {
+    results.push_back(co_await add(event, 1, 2));
+    results.push_back(co_await add(event, 3, 4));
+    try {
+        co_await fail(event);
+    } catch (const std::runtime_error&) {
+        results.push_back(-1);
+    }
+}
+
+static bool sequence_test() {
+    Event event;
+    std::vector<int> results;
+    auto task = sequence(event, results);
+    bool passed = check("Lazy start", results.empty());
+
+    std::move(task).start();
+    for (int step = 0; step < 3 && event.waiting; ++step) {
+        event.fire();
+    }
+    passed &= check("Sequence", results == std::vector<int>{3, 7, -1} &&
+                                    event.waiting == nullptr);
+    return passed;
+}
+
+static Task<> repeat(Event& event, int& count) {
+    for (int i = 0; i < 2; ++i) {
+        count += co_await add(event, 0, 1);
+    }
+}
+
+// Frames of finished tasks are reused, so running the same sequence
+// again allocates nothing.
+static bool pool_test() {
+    Event event;
+    int count = 0;
+    auto run = [&event, &count] {
+        repeat(event, count).start();
+        while (event.waiting) {
+            event.fire();
+        }
+    };
+
+    run();
+    const std::size_t allocations = FramePool::local().allocations();
+    for (int i = 0; i < 100; ++i) {
+        run();
+    }
+    bool passed = check("Frames reused",
+                        FramePool::local().allocations() == allocations);
+    passed &= check("Repeated sequence", count == 202);
+
+    // An unstarted task is freed with its Task.
+    {
+        auto unstarted = repeat(event, count);
+    }
+    passed &= check("Unstarted task freed",
+                    FramePool::local().allocations() == allocations);
+
+    // Frames too large to pool still work.
+    static constexpr std::size_t LARGE =
+        FramePool::SIZE_STEP * FramePool::SIZE_CLASSES;
+    FramePool pool;
+    void* large = pool.allocate(LARGE);
+    void* small = pool.allocate(1);
+    pool.deallocate(small, 1);
+    pool.deallocate(large, LARGE);
+    passed &= check("Pooled size class",
+                    pool.allocate(FramePool::SIZE_STEP) == small &&
+                        pool.allocations() == 2);
+    pool.deallocate(small, FramePool::SIZE_STEP);
+    return passed;
+}
+// NOLINTEND(misc-use-anonymous-namespace,misc-use-internal-linkage)
+
+int main() {
+#ifdef NDEBUG
+    Logger::setLogLevel(Logger::INFO);
+#else
+    Logger::setLogLevel(Logger::DEBUG);
+#endif
+
+    bool passed = sequence_test();
+    passed &= pool_test();
+    return passed ? 0 : 1;
+}